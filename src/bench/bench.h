@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef BENCH_BENCH_H_INCLUDED
+#define BENCH_BENCH_H_INCLUDED
+
+#include <core/types.h>
+
+namespace geo::bench {
+
+    /// Returns the number of times the global `operator new` has been called, on any thread.
+    u64 get_num_allocations();
+
+    /// Checks that common failures don't allocate, including libzip errors with causes returned by
+    /// `read_stream_bytes`, even when they're wrapped as the causes of other errors. Returns false
+    /// if any allocations were counted.
+    bool run_error_bench();
+
+    /// Compares the time per message of many threads logging through the logger thread, with each
+    /// overflow policy, and through a copy of the logger's old path, which formatted each message
+    /// to stderr one character at a time under a global lock. The messages are written to the
+    /// console, so stderr should be redirected. Always returns true.
+    bool run_log_bench();
+
+} // namespace geo::bench
+
+#endif // BENCH_BENCH_H_INCLUDED
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+
+#include <chrono>
+
+#include <io/stream.h>
+#include <io/zip.h>
+#include <io/zip_directory.h>
+#include <system/debug.h>
+#include <system/error.h>
+
+#include "bench.h"
+
+using namespace geo;
+
+namespace {
+
+    constexpr size_t num_failed_reads = 1'000'000;
+    constexpr size_t num_failed_parses = 100'000;
+
+    // Value of libzip's ZIP_ER_READ, since libzip's headers are private to geo_common.
+    constexpr int zip_er_read = 5;
+
+    // Provider whose streams fail to open with the error ZipArchive reports when libzip fails to
+    // read the archive: a description, a libzip code, and the system error as its cause.
+    class FailingZipProvider : public StreamProvider {
+    public:
+        std::unique_ptr<Stream> open_stream(const char*, Error& out_error) override
+        {
+            out_error = {.description = "zip_fopen_index failed", .code = {zip_er_read, libzip_error_category},
+                         .cause = Error{.code = {EIO, std::generic_category()}}};
+            return {};
+        }
+    };
+
+    // Reports the allocations made by `func`, which runs `count` operations. Returns false if it
+    // allocated at all.
+    template<typename Func>
+    bool measure(const char* name, size_t count, Func func)
+    {
+        u64 start_allocations = bench::get_num_allocations();
+        auto start_time = std::chrono::steady_clock::now();
+
+        func();
+
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        u64 num_allocations = bench::get_num_allocations() - start_allocations;
+
+        LOG_INFO("{}: {} operations in {:.3f} s, {} allocations", name, count, elapsed, num_allocations);
+        return num_allocations == 0;
+    }
+
+} // namespace
+
+bool bench::run_error_bench()
+{
+    // Each failure is passed up through read_stream_bytes and wrapped as the cause of another
+    // error, as asset loaders do.
+    FailingZipProvider provider;
+
+    bool ok = measure("Failed read_stream_bytes calls wrapped as causes", num_failed_reads, [&] {
+        for (size_t i = 0; i < num_failed_reads; ++i) {
+            Error error;
+
+            provider.read_stream_bytes("missing", 4096, error);
+            Error wrapped{.description = "Can't load asset", .cause = std::move(error)};
+        }
+    });
+
+    // A PAK that isn't a ZIP archive fails early, and the failure is wrapped as the cause of
+    // another error, as callers that add context do.
+    static const u8 not_a_zip[256] = {};
+    ZipDirectory directory;
+
+    ok &= measure("Failed ZipDirectory::parse calls wrapped as causes", num_failed_parses, [&] {
+        for (size_t i = 0; i < num_failed_parses; ++i) {
+            Error error;
+
+            directory.parse(not_a_zip, error);
+            Error wrapped{.description = "Can't open PAK", .cause = std::move(error)};
+        }
+    });
+
+    return ok;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <system/debug.h>
+
+#include "bench.h"
+
+using namespace geo;
+
+namespace {
+
+    constexpr size_t messages_per_thread = 100'000;
+    constexpr size_t thread_counts[] = {1, 4, 16};
+
+    struct LogTimes {
+        double caller_ns = 0; // Time per message until every thread has logged its messages
+        double total_ns = 0; // Time per message until every message has been written
+    };
+
+    // Output iterator that calls `fputc(ch, stderr)` each time it's assigned a char, as the logger
+    // did before messages were written by the logger thread.
+    class LegacyLogIterator {
+    public:
+        using difference_type = ptrdiff_t;
+        using iterator_category = std::output_iterator_tag;
+        using pointer = char*;
+        using reference = char&;
+        using value_type = char;
+
+        LegacyLogIterator& operator=(char ch)
+        {
+            fputc(ch, stderr);
+            return *this;
+        }
+
+        LegacyLogIterator& operator*() { return *this; }
+        LegacyLogIterator& operator++() { return *this; }
+        LegacyLogIterator& operator++(int) { return *this; }
+    };
+
+    std::mutex legacy_log_mutex;
+
+    // Writes an info message the way the Unix logger did before the logger thread: under a global
+    // lock, one character at a time to line-buffered stderr.
+    template<typename... Args>
+    void legacy_log_info(const char* file, int line, fmt::format_string<Args...> fmt, Args&&... args)
+    {
+        std::lock_guard lock{legacy_log_mutex};
+
+        fputs("\033[1;34mINFO: \033[0m", stderr);
+        fmt::format_to(LegacyLogIterator{}, fmt, std::forward<Args>(args)...);
+        fprintf(stderr, " \033[2m(%s:%d)", file, line);
+        fputs("\033[0m\n", stderr);
+    }
+
+    // Times `num_threads` threads each logging through the logger thread, or through the legacy
+    // path if `legacy` is set.
+    LogTimes log_from_threads(size_t num_threads, bool legacy)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::vector<std::thread> threads;
+        auto start_time = Clock::now();
+
+        for (size_t i = 0; i < num_threads; ++i) {
+            threads.emplace_back([i, legacy] {
+                for (size_t j = 0; j < messages_per_thread; ++j) {
+                    if (legacy)
+                        legacy_log_info(__FILE__, __LINE__, "Benchmark message {} from thread {}", j, i);
+                    else
+                        LOG_INFO("Benchmark message {} from thread {}", j, i);
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        auto caller_time = Clock::now();
+
+        if (legacy)
+            fflush(stderr);
+        else
+            debug::flush_log();
+
+        auto end_time = Clock::now();
+        double num_messages = double(num_threads * messages_per_thread);
+
+        return {
+            .caller_ns = std::chrono::duration<double, std::nano>(caller_time - start_time).count() / num_messages,
+            .total_ns = std::chrono::duration<double, std::nano>(end_time - start_time).count() / num_messages,
+        };
+    }
+
+} // namespace
+
+bool bench::run_log_bench()
+{
+    // The old logger made stderr line-buffered when it was initialized. Nothing else writes to
+    // stderr through stdio, so it can still be changed here.
+    static char stderr_buffer[BUFSIZ];
+    setvbuf(stderr, stderr_buffer, _IOLBF, sizeof(stderr_buffer));
+
+    // The messages go to the console, so the results are printed to stdout where they can be
+    // separated from them.
+    fmt::print(stdout, "threads   legacy ns/msg   block ns/msg (total)   drop ns/msg (total)\n");
+
+    for (size_t num_threads : thread_counts) {
+        LogTimes legacy_times = log_from_threads(num_threads, true);
+
+        debug::set_log_overflow(debug::LogOverflow::block);
+        LogTimes block_times = log_from_threads(num_threads, false);
+
+        debug::set_log_overflow(debug::LogOverflow::drop);
+        LogTimes drop_times = log_from_threads(num_threads, false);
+
+        debug::set_log_overflow(debug::LogOverflow::block);
+        fmt::print(stdout, "{:>7}   {:>13.0f}   {:>12.0f} ({:>5.0f})   {:>11.0f} ({:>5.0f})\n", num_threads,
+                   legacy_times.total_ns, block_times.caller_ns, block_times.total_ns, drop_times.caller_ns,
+                   drop_times.total_ns);
+        fflush(stdout);
+    }
+
+    return true;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+# include <malloc.h>
+#endif
+
+#include <atomic>
+#include <new>
+
+#include <system/debug.h>
+
+#include "bench.h"
+
+using namespace geo;
+
+//==================================================================================================
+// Allocation counting
+//==================================================================================================
+
+namespace {
+
+    std::atomic<u64> num_allocations = 0;
+
+} // namespace
+
+// The array and nothrow forms of `operator new` and `operator delete` call these by default, but
+// the aligned forms don't call the unaligned ones, so both are replaced.
+void* operator new(size_t size)
+{
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* ptr = malloc(size ? size : 1))
+        return ptr;
+
+    abort();
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef _WIN32
+    void* ptr = _aligned_malloc(size ? size : 1, size_t(alignment));
+#else
+    // The size must be a nonzero multiple of the alignment.
+    size_t align = size_t(alignment);
+    void* ptr = aligned_alloc(align, size ? (size + align - 1) / align * align : align);
+#endif
+
+    if (ptr)
+        return ptr;
+
+    abort();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+
+u64 bench::get_num_allocations()
+{
+    return num_allocations.load(std::memory_order_relaxed);
+}
+
+//==================================================================================================
+// Entry point
+//==================================================================================================
+
+namespace {
+
+    struct Benchmark {
+        OsStringView name = {};
+        bool (*run)() = nullptr;
+    };
+
+    const Benchmark benchmarks[] = {
+        {OSSTR "error", bench::run_error_bench},
+        {OSSTR "log", bench::run_log_bench},
+    };
+
+    int bench_main(int argc, const oschar_t* const argv[])
+    {
+        debug::init_logger();
+        debug::set_max_log_level(LogLevel::info);
+
+        bool ok = true;
+
+        for (int i = 1; i < argc && argv[i]; ++i) {
+            const Benchmark* benchmark = nullptr;
+
+            for (const Benchmark& candidate : benchmarks) {
+                if (candidate.name == argv[i])
+                    benchmark = &candidate;
+            }
+
+            if (!benchmark)
+                FATAL("Invalid benchmark: {}", argv[i]);
+
+            ok &= benchmark->run();
+        }
+
+        if (argc < 2) {
+            for (const Benchmark& benchmark : benchmarks)
+                ok &= benchmark.run();
+        }
+
+        debug::shut_down_logger();
+        return ok ? 0 : 1;
+    }
+
+} // namespace
+
+#ifdef _WIN32
+
+int wmain(int argc, wchar_t* argv[])
+{
+    return bench_main(argc, argv);
+}
+
+#else // !defined(_WIN32)
+
+int main(int argc, char* argv[])
+{
+    return bench_main(argc, argv);
+}
+
+#endif // !defined(_WIN32)
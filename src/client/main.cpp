@@ -10,14 +10,26 @@
 # include <windows.h>
 #endif
 
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
 #include <SDL.h>
 
+#include <core/game_defs.h>
 #include <core/str.h>
-#include <io/stream.h>
+#include <io/asset_cache.h>
+#include <io/directory_provider.h>
+#include <io/disk_cache.h>
+#include <io/layered_provider.h>
+#include <io/pak_verify.h>
+#include <io/resident_pak.h>
+#include <io/tracing_provider.h>
 #include <render/render.h>
 #ifdef _WIN32
 # include <system/windows/win32.h>
 #endif
+#include <system/command_line.h>
 #include <system/debug.h>
 #include <system/system.h>
 
@@ -64,12 +76,16 @@ namespace {
 
     struct ClientParams {
         const oschar_t* assets_path = nullptr;
-    };
-
-    struct Option {
-        OsStringView opt = {};
-        bool expects_param = false;
-        void (*callback)() = nullptr;
+        PakBackend pak_backend = PakBackend::mapped;
+        size_t asset_cache_size = 64*1024*1024;
+        size_t assets_disk_cache_size = 0; // Disabled if zero
+        std::vector<const oschar_t*> overlay_paths{}; // Mounted over the PAK in order
+        const oschar_t* asset_trace_path = nullptr; // Records reads from the PAK if set
+        bool asset_prefetch_decode = false; // Prefetched assets are decoded into the asset cache
+        std::vector<std::string> resident_prefixes{}; // Assets kept compressed in memory
+        bool verify_pak = false; // Checks the PAK's entries and exits instead of starting the game
+        const oschar_t* profile_path = nullptr; // Writes a profile of the last frames on exit if set
+        size_t profile_frames = 300;
     };
 
     LogLevel parse_log_level(OsStringView str)
@@ -92,75 +108,111 @@ namespace {
             FATAL("Invalid log level: {}", str);
     }
 
-    ClientParams client_params = {};
-    const oschar_t* opt_param = nullptr;
-
-    const Option command_line_options[] = {
-        {OSSTR "assets", true, [] { client_params.assets_path = opt_param; }},
-        {OSSTR "console", false, [] { debug::enable_console(); }},
-        {OSSTR "log-level", true, [] { debug::set_max_log_level(parse_log_level(opt_param)); }},
-    };
-
-    const Option& find_option(OsStringView opt)
+    LogCategory parse_log_category(OsStringView str)
     {
-        for (const Option& option : command_line_options)
-            if (option.opt == opt)
-                return option;
-
-        FATAL("Invalid option: --{}", opt);
+        if (str == OSSTR "general")
+            return LogCategory::general;
+        else if (str == OSSTR "client")
+            return LogCategory::client;
+        else if (str == OSSTR "io")
+            return LogCategory::io;
+        else if (str == OSSTR "render")
+            return LogCategory::render;
+        else if (str == OSSTR "system")
+            return LogCategory::system;
+        else if (str == OSSTR "tools")
+            return LogCategory::tools;
+        else
+            FATAL("Invalid log category: {}", str);
     }
 
-    void handle_command_line(int argc, const oschar_t* const argv[])
+    // Sets log levels from a comma-separated list. Each item is either a level, which applies to
+    // every category, or `category=level`, e.g., `warning,render=trace`.
+    void set_log_levels(OsStringView str)
     {
-        if (argc < 1 || !argv || !argv[0])
-            return;
+        OsStringView remaining = str;
+
+        for (;;) {
+            size_t comma_pos = remaining.find(',');
+            OsStringView item = remaining.substr(0, comma_pos);
+            size_t equals_pos = item.find('=');
+
+            if (equals_pos == OsStringView::npos)
+                debug::set_max_log_level(parse_log_level(item));
+            else
+                debug::set_max_log_level(parse_log_category(item.substr(0, equals_pos)),
+                                         parse_log_level(item.substr(equals_pos + 1)));
 
-        for (int i = 1; i < argc; ++i) {
-            if (!argv[i])
+            if (comma_pos == OsStringView::npos)
                 break;
 
-            // Only accept long options, e.g., `--option`.
-            if (argv[i][0] != '-' || argv[i][1] == 0) {
-                FATAL("Unexpected argument: {}", argv[i]);
-            } else if (argv[i][1] != '-') {
-                if (argv[i][2])
-                    FATAL("Invalid option: -{} ({})", argv[i][1], argv[i]);
-                else
-                    FATAL("Invalid option: -{}", argv[i][1]);
-            } else if (argv[i][2] == 0) {
-                FATAL("Unexpected argument: {}", argv[i]);
-            }
+            remaining = remaining.substr(comma_pos + 1);
+        }
+    }
 
-            // Get the option string.
-            OsStringView opt = &argv[i][2];
-            const oschar_t* equals_pos = str::find(opt.data(), '=');
+    // Opens a binary log file, which enables deferred logging.
+    void open_binary_log(const oschar_t* path)
+    {
+        Error error;
 
-            if (equals_pos) {
-                opt = opt.substr(0, size_t(equals_pos - opt.data()));
-                opt_param = equals_pos + 1;
-            } else {
-                opt_param = nullptr;
-            }
+        if (!debug::open_binary_log(path, error))
+            FATAL("{}: {}", path, error);
+    }
 
-            // Find the option entry.
-            const Option& option = find_option(opt);
-
-            if (option.expects_param) {
-                if (!opt_param) {
-                    if (i + 1 < argc && argv[i + 1])
-                        opt_param = argv[++i];
-                    else
-                        FATAL("Missing parameter: {}", argv[i]);
-                }
-            } else if (opt_param) {
-                FATAL("Unexpected parameter: {}", argv[i]);
-            }
+    debug::LogOverflow parse_log_overflow(OsStringView str)
+    {
+        if (str == OSSTR "block")
+            return debug::LogOverflow::block;
+        else if (str == OSSTR "drop")
+            return debug::LogOverflow::drop;
+        else
+            FATAL("Invalid log overflow policy: {}", str);
+    }
 
-            // Handle the option.
-            option.callback();
-        }
+    // Converts an asset name or name prefix to UTF-8 with forward slashes.
+    std::string parse_asset_name(OsStringView str)
+    {
+        std::u8string name = std::filesystem::path{str}.generic_u8string();
+        return {reinterpret_cast<const char*>(name.data()), name.size()};
+    }
+
+    PakBackend parse_pak_backend(OsStringView str)
+    {
+        if (str == OSSTR "mmap")
+            return PakBackend::mapped;
+        else if (str == OSSTR "stdio")
+            return PakBackend::stdio;
+        else
+            FATAL("Invalid PAK backend: {}", str);
     }
 
+    using command_line::parse_size;
+
+    ClientParams client_params = {};
+
+    const CommandLineOption command_line_options[] = {
+        {OSSTR "asset-cache-size", true,
+         [](const oschar_t* param) { client_params.asset_cache_size = parse_size(param); }},
+        {OSSTR "asset-prefetch-decode", false, [](const oschar_t*) { client_params.asset_prefetch_decode = true; }},
+        {OSSTR "assets", true, [](const oschar_t* param) { client_params.assets_path = param; }},
+        {OSSTR "assets-disk-cache", true,
+         [](const oschar_t* param) { client_params.assets_disk_cache_size = parse_size(param); }},
+        {OSSTR "console", false, [](const oschar_t*) { debug::enable_console(); }},
+        {OSSTR "log-binary", true, [](const oschar_t* param) { open_binary_log(param); }},
+        {OSSTR "log-deferred", false, [](const oschar_t*) { debug::set_deferred_logging(true); }},
+        {OSSTR "log-level", true, [](const oschar_t* param) { set_log_levels(param); }},
+        {OSSTR "log-overflow", true, [](const oschar_t* param) { debug::set_log_overflow(parse_log_overflow(param)); }},
+        {OSSTR "overlay", true, [](const oschar_t* param) { client_params.overlay_paths.push_back(param); }},
+        {OSSTR "pak-backend", true,
+         [](const oschar_t* param) { client_params.pak_backend = parse_pak_backend(param); }},
+        {OSSTR "profile", true, [](const oschar_t* param) { client_params.profile_path = param; }},
+        {OSSTR "profile-frames", true, [](const oschar_t* param) { client_params.profile_frames = parse_size(param); }},
+        {OSSTR "record-asset-trace", true, [](const oschar_t* param) { client_params.asset_trace_path = param; }},
+        {OSSTR "resident-assets", true,
+         [](const oschar_t* param) { client_params.resident_prefixes.push_back(parse_asset_name(param)); }},
+        {OSSTR "verify-pak", false, [](const oschar_t*) { client_params.verify_pak = true; }},
+    };
+
 } // namespace
 
 //==================================================================================================
@@ -172,6 +224,7 @@ namespace {
     std::unique_ptr<ClientState> current_state;
     std::unique_ptr<ClientState> pending_state;
     bool quit_requested = false;
+    StreamProvider* assets_provider = nullptr;
 
     void handle_state_transition()
     {
@@ -226,6 +279,8 @@ namespace {
         ASSERT(current_state != nullptr);
 
         while (!quit_requested) {
+            PROFILE_FRAME();
+
             // Handle window and input events.
             while (SDL_PollEvent(&event)) {
                 handle_event(event);
@@ -243,14 +298,20 @@ namespace {
             prev_time_ms = current_time_ms;
 
             // Simulate the frame's game logic.
-            current_state->update(delta_ms);
-            handle_state_transition();
+            {
+                PROFILE_SCOPE("update");
+                current_state->update(delta_ms);
+                handle_state_transition();
+            }
             if (quit_requested)
                 break;
 
             // Render the scene.
             render::begin_draw();
-            current_state->render(delta_ms);
+            {
+                PROFILE_SCOPE("render");
+                current_state->render(delta_ms);
+            }
             render::end_draw();
             render::present();
         }
@@ -271,28 +332,179 @@ void client::quit()
     quit_requested = true;
 }
 
+StreamProvider& client::get_assets()
+{
+    ASSERT(assets_provider != nullptr);
+    return *assets_provider;
+}
+
 //==================================================================================================
 // Entry point
 //==================================================================================================
 
 namespace {
 
+    // Checks the CRC-32 of every entry of the PAK in parallel. Returns the process exit code.
+    int run_pak_verification(const oschar_t* pak_path)
+    {
+        PakVerifyStats stats;
+        Error error;
+
+        LOG_INFO("Verifying {}...", pak_path);
+
+        if (!verify_pak(pak_path, 0, stats, error)) {
+            LOG_ERROR("{}: {}", pak_path, error);
+            return 1;
+        }
+
+        auto elapsed = std::chrono::duration<f64>(stats.elapsed_time).count();
+
+        LOG_INFO("Verified {} entries ({} -> {} bytes) on {} threads in {:.3f} s ({:.1f} MiB/s)",
+                 stats.num_entries, stats.raw_size, stats.decoded_size, stats.num_threads, elapsed,
+                 elapsed > 0.0 ? f64(stats.decoded_size) / (1024.0 * 1024.0) / elapsed : 0.0);
+
+        if (stats.num_failed) {
+            LOG_ERROR("{} of {} entries are corrupt", stats.num_failed, stats.num_entries);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // Keeps the compressed data of the selected assets in memory, if enabled. Other assets are read
+    // from `pak`, and `archive` is only used to read the resident assets' raw data.
+    std::shared_ptr<ResidentPak> open_resident_pak(StreamProvider& pak, ZipArchive& archive)
+    {
+        if (client_params.resident_prefixes.empty())
+            return {};
+
+        auto resident = std::make_shared<ResidentPak>(pak, archive);
+
+        for (std::string& prefix : client_params.resident_prefixes)
+            resident->add_prefix(std::move(prefix));
+
+        return resident;
+    }
+
+    // Opens the persistent cache of decompressed assets, if enabled.
+    std::shared_ptr<DiskCache> open_disk_cache(StreamProvider& pak, const oschar_t* pak_path)
+    {
+        if (!client_params.assets_disk_cache_size)
+            return {};
+
+        OsString cache_dir = system::get_cache_dir();
+        PakIdentity identity;
+        Error error;
+
+        if (cache_dir.empty()) {
+            LOG_WARNING("Can't determine the cache directory, disk cache disabled");
+            return {};
+        } else if (!DiskCache::get_pak_identity(pak_path, identity, error)) {
+            LOG_WARNING("Can't identify PAK, disk cache disabled: {}", error);
+            return {};
+        }
+
+        OsString cache_path = cache_dir + OSSTR "/" PAK_FILENAME ".cache";
+        return std::make_shared<DiskCache>(pak, cache_path.c_str(), identity, client_params.assets_disk_cache_size);
+    }
+
+    // Opens a recorder of the reads from the PAK, if enabled. It's above the disk cache so that
+    // reads served by the cache are recorded too.
+    std::shared_ptr<TracingProvider> open_asset_trace(StreamProvider& pak)
+    {
+        if (!client_params.asset_trace_path)
+            return {};
+
+        Error error;
+        auto trace = std::make_shared<TracingProvider>(pak, client_params.asset_trace_path, error);
+
+        if (error)
+            FATAL("{}: {}", client_params.asset_trace_path, error);
+
+        LOG_INFO("Recording asset trace to: {}", client_params.asset_trace_path);
+        return trace;
+    }
+
+    // Mounts a layer of assets over the existing layers.
+    void mount_assets(LayeredProvider& assets, std::shared_ptr<StreamProvider> provider, const oschar_t* path)
+    {
+        LayerId id;
+        Error error;
+
+        if (!assets.mount(std::move(provider), id, error))
+            FATAL("{}: {}", path, error);
+    }
+
+    // Opens an overlay, which is either a directory of loose files or a PAK.
+    std::shared_ptr<StreamProvider> open_overlay(const oschar_t* path)
+    {
+        std::error_code ec;
+
+        if (std::filesystem::is_directory(path, ec)) {
+            LOG_INFO("Reading asset overrides from: {}", path);
+            return std::make_shared<DirectoryProvider>(path);
+        }
+
+        return system::open_pak(path, client_params.pak_backend);
+    }
+
     int client_main(int argc, const oschar_t* const argv[])
     {
         debug::init_logger();
-        handle_command_line(argc, argv);
+        command_line::parse(argc, argv, command_line_options);
+        OsString pak_path = client_params.assets_path ? client_params.assets_path : system::get_default_pak_path();
+
+        if (client_params.verify_pak) {
+            int result = run_pak_verification(pak_path.c_str());
+            debug::shut_down_logger();
+            return result;
+        }
 
         LOG_INFO("Initializing...");
         display::init();
-        auto pak = system::open_pak(client_params.assets_path);
-        render::init(*pak);
+        ZipArchive* pak_archive = nullptr;
+        std::shared_ptr<StreamProvider> pak = system::open_pak(pak_path.c_str(), client_params.pak_backend, &pak_archive);
+        std::shared_ptr<ResidentPak> resident_pak = open_resident_pak(*pak, *pak_archive);
+        std::shared_ptr<StreamProvider> pak_source = resident_pak ? resident_pak : pak;
+        std::shared_ptr<DiskCache> disk_cache = open_disk_cache(*pak_source, pak_path.c_str());
+        std::shared_ptr<StreamProvider> pak_layer = disk_cache ? disk_cache : pak_source;
+        std::shared_ptr<TracingProvider> asset_trace = open_asset_trace(*pak_layer);
+        LayeredProvider assets;
+        mount_assets(assets, asset_trace ? asset_trace : pak_layer, pak_path.c_str());
+        for (const oschar_t* overlay_path : client_params.overlay_paths)
+            mount_assets(assets, open_overlay(overlay_path), overlay_path);
+        AssetCache asset_cache{assets, client_params.asset_cache_size};
+        asset_cache.set_prefetch_decode(client_params.asset_prefetch_decode);
+        assets_provider = &asset_cache;
+        render::init(asset_cache);
         client::set_state(std::make_unique<Playground>());
 
+        if (client_params.profile_path)
+            debug::start_profiler(client_params.profile_frames);
+
         LOG_INFO("Game started!");
         main_loop();
 
+        if (client_params.profile_path) {
+            Error error;
+
+            if (!debug::write_profile(client_params.profile_path, error))
+                LOG_ERROR("{}: {}", client_params.profile_path, error);
+        }
+
         LOG_INFO("Shutting down...");
+        AssetCacheStats cache_stats = asset_cache.get_stats();
+        LOG_DEBUG("Asset cache: {} hits, {} misses, {} evictions, {} of {} bytes used",
+                  cache_stats.hits, cache_stats.misses, cache_stats.evictions, cache_stats.size, cache_stats.budget);
+
+        if (resident_pak) {
+            ResidencyStats residency_stats = resident_pak->get_stats();
+            LOG_DEBUG("Resident assets: {} entries, {} compressed bytes for {} decoded bytes, {} decodes of {} bytes",
+                      residency_stats.num_entries, residency_stats.compressed_size, residency_stats.decoded_size,
+                      residency_stats.num_decodes, residency_stats.decoded_bytes);
+        }
         render::shut_down();
+        assets_provider = nullptr;
         display::shut_down();
         SDL_Quit();
         debug::shut_down_logger();
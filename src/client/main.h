@@ -15,6 +15,8 @@
 
 namespace geo {
 
+    class StreamProvider;
+
     /// Client main loop event handler.
     class ClientState {
     public:
@@ -37,6 +39,10 @@ namespace geo {
         void set_state(std::unique_ptr<ClientState>&& state);
         void quit();
 
+        /// Gets the provider of the game's assets. States can pass the assets they will need soon
+        /// to @ref StreamProvider::prefetch from `begin_state` or `update` to hide load latency.
+        StreamProvider& get_assets();
+
     } // namespace client
 
 } // namespace geo
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef CORE_ENDIAN_H_INCLUDED
+#define CORE_ENDIAN_H_INCLUDED
+
+#include "types.h"
+
+namespace geo {
+
+    /// Functions for encoding and decoding fixed-endian integers in byte buffers.
+    namespace endian {
+
+        /// Loads a little-endian 16-bit integer from `src`.
+        constexpr u16 load_le16(const u8* src)
+        {
+            return u16(src[0] | (src[1] << 8));
+        }
+
+        /// Loads a little-endian 32-bit integer from `src`.
+        constexpr u32 load_le32(const u8* src)
+        {
+            return u32(src[0]) | (u32(src[1]) << 8) | (u32(src[2]) << 16) | (u32(src[3]) << 24);
+        }
+
+        /// Loads a little-endian 64-bit integer from `src`.
+        constexpr u64 load_le64(const u8* src)
+        {
+            return u64(load_le32(src)) | (u64(load_le32(src + 4)) << 32);
+        }
+
+        /// Stores a little-endian 16-bit integer into `dst`.
+        constexpr void store_le16(u8* dst, u16 value)
+        {
+            dst[0] = u8(value);
+            dst[1] = u8(value >> 8);
+        }
+
+        /// Stores a little-endian 32-bit integer into `dst`.
+        constexpr void store_le32(u8* dst, u32 value)
+        {
+            dst[0] = u8(value);
+            dst[1] = u8(value >> 8);
+            dst[2] = u8(value >> 16);
+            dst[3] = u8(value >> 24);
+        }
+
+        /// Stores a little-endian 64-bit integer into `dst`.
+        constexpr void store_le64(u8* dst, u64 value)
+        {
+            store_le32(dst, u32(value));
+            store_le32(dst + 4, u32(value >> 32));
+        }
+
+    } // namespace endian
+
+} // namespace geo
+
+#endif // CORE_ENDIAN_H_INCLUDED
@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "asset_cache.h"
+
+using namespace geo;
+
+namespace {
+
+    // Memory stream that keeps a reference to its buffer.
+    class SharedBufferStream : public MemoryStream {
+    public:
+        explicit SharedBufferStream(SharedBuffer&& buffer)
+            : MemoryStream{buffer->bytes()}
+            , buffer_{std::move(buffer)}
+        {
+        }
+
+    private:
+        SharedBuffer buffer_;
+    };
+
+} // namespace
+
+AssetCache::AssetCache(StreamProvider& source, size_t budget)
+    : source_{source}
+    , budget_{budget}
+{
+}
+
+AssetCache::~AssetCache()
+{
+    std::unique_lock lock{mutex_};
+    prefetch_done_.wait(lock, [this] { return num_pending_prefetches_ == 0; });
+}
+
+void AssetCache::clear()
+{
+    std::lock_guard lock{mutex_};
+    evict_to(0);
+}
+
+void AssetCache::evict_to(size_t budget)
+{
+    while (size_ > budget) {
+        Entry& entry = entries_.back();
+
+        size_ -= entry.buffer->size();
+        names_.erase(entry.name);
+
+        for (const std::string& alias : entry.aliases)
+            names_.erase(alias);
+
+        if (entry.content_id)
+            contents_.erase(entry.content_id);
+
+        entries_.pop_back();
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void AssetCache::add_alias(std::string_view name, EntryList::iterator it)
+{
+    if (names_.emplace(name, it).second)
+        it->aliases.emplace_back(name);
+}
+
+SharedBuffer AssetCache::find(const char* name, u64& out_content_id, bool count)
+{
+    std::unique_lock lock{mutex_};
+    auto it = names_.find(std::string_view{name});
+    EntryList::iterator entry_it;
+
+    out_content_id = 0;
+
+    if (it != names_.end()) {
+        entry_it = it->second;
+    } else {
+        // The content ID is looked up without holding the lock, since the source may be slow.
+        lock.unlock();
+        u64 content_id = source_.get_stream_content_id(name);
+        lock.lock();
+
+        auto content_it = content_id ? contents_.find(content_id) : contents_.end();
+
+        if (content_it == contents_.end()) {
+            out_content_id = content_id;
+
+            if (count)
+                misses_.fetch_add(1, std::memory_order_relaxed);
+
+            return {};
+        }
+
+        entry_it = content_it->second;
+        add_alias(name, entry_it);
+    }
+
+    // Move the entry to the front of the list.
+    entries_.splice(entries_.begin(), entries_, entry_it);
+
+    if (count)
+        hits_.fetch_add(1, std::memory_order_relaxed);
+
+    return entry_it->buffer;
+}
+
+SharedBuffer AssetCache::get(const char* name, size_t max_size, Error& out_error)
+{
+    u64 content_id;
+
+    if (SharedBuffer buffer = find(name, content_id)) {
+        if (buffer->size() > max_size) {
+            out_error = {.code = IoErrorCode::stream_too_long};
+            return {};
+        }
+
+        return buffer;
+    }
+
+    ByteBuffer data = source_.read_stream_buffer(name, max_size, out_error);
+
+    if (out_error)
+        return {};
+
+    auto buffer = std::make_shared<const ByteBuffer>(std::move(data));
+
+    if (!source_.is_stream_cacheable(name))
+        return buffer;
+
+    return insert(name, content_id, std::move(buffer));
+}
+
+AssetCacheStats AssetCache::get_stats() const
+{
+    std::lock_guard lock{mutex_};
+
+    return {
+        .hits = hits_.load(std::memory_order_relaxed),
+        .misses = misses_.load(std::memory_order_relaxed),
+        .evictions = evictions_.load(std::memory_order_relaxed),
+        .num_entries = entries_.size(),
+        .size = size_,
+        .budget = budget_,
+    };
+}
+
+bool AssetCache::get_stream_names(std::vector<std::string>& out_names, Error& out_error)
+{
+    return source_.get_stream_names(out_names, out_error);
+}
+
+i64 AssetCache::get_stream_size(const char* name, Error& out_error)
+{
+    {
+        std::lock_guard lock{mutex_};
+        auto it = names_.find(std::string_view{name});
+
+        if (it != names_.end())
+            return i64(it->second->buffer->size());
+    }
+
+    return source_.get_stream_size(name, out_error);
+}
+
+u64 AssetCache::get_stream_content_id(const char* name)
+{
+    return source_.get_stream_content_id(name);
+}
+
+bool AssetCache::is_stream_cacheable(const char* name)
+{
+    return source_.is_stream_cacheable(name);
+}
+
+SharedBuffer AssetCache::insert(std::string_view name, u64 content_id, SharedBuffer&& buffer)
+{
+    // Buffers that don't own their memory, e.g., views into a memory-mapped PAK, are already
+    // cheap to read and aren't worth caching.
+    if (!buffer->owns_memory())
+        return std::move(buffer);
+
+    std::lock_guard lock{mutex_};
+
+    if (buffer->size() > budget_)
+        return std::move(buffer);
+
+    auto it = names_.find(name);
+
+    if (it != names_.end())
+        return it->second->buffer;
+
+    // Another name with the same contents may have been cached.
+    auto content_it = content_id ? contents_.find(content_id) : contents_.end();
+
+    if (content_it != contents_.end()) {
+        add_alias(name, content_it->second);
+        return content_it->second->buffer;
+    }
+
+    evict_to(budget_ - buffer->size());
+    entries_.push_front({.name = std::string{name}, .buffer = std::move(buffer), .content_id = content_id});
+    names_.emplace(entries_.front().name, entries_.begin());
+    size_ += entries_.front().buffer->size();
+
+    if (content_id)
+        contents_.emplace(content_id, entries_.begin());
+
+    return entries_.front().buffer;
+}
+
+ByteBuffer AssetCache::make_byte_buffer(SharedBuffer buffer)
+{
+    std::span<const u8> bytes = buffer->bytes();
+    bool owns_memory = buffer->owns_memory();
+
+    return ByteBuffer::adopt(bytes, [](void* context) { delete static_cast<SharedBuffer*>(context); },
+                             new SharedBuffer{std::move(buffer)}, owns_memory);
+}
+
+std::unique_ptr<Stream> AssetCache::open_stream(const char* name, Error& out_error)
+{
+    u64 content_id;
+
+    if (SharedBuffer buffer = find(name, content_id))
+        return std::make_unique<SharedBufferStream>(std::move(buffer));
+
+    // Stream large, unsized, or uncacheable streams directly from the source instead of caching
+    // them.
+    Error local_error;
+    i64 size = source_.get_stream_size(name, local_error);
+
+    if (size < 0 || u64(size) > budget_ || !source_.is_stream_cacheable(name))
+        return source_.open_stream(name, out_error);
+
+    ByteBuffer data = source_.read_stream_buffer(name, size_t(size), out_error);
+
+    if (out_error)
+        return {};
+
+    SharedBuffer buffer = insert(name, content_id, std::make_shared<const ByteBuffer>(std::move(data)));
+    return std::make_unique<SharedBufferStream>(std::move(buffer));
+}
+
+void AssetCache::prefetch(std::span<const std::string> names)
+{
+    if (!prefetch_decode_.load(std::memory_order_relaxed)) {
+        source_.prefetch(names);
+        return;
+    }
+
+    // Find the streams that aren't cached. Unlike `find`, this doesn't count hits or misses.
+    std::vector<std::string> missing_names;
+    std::vector<u64> missing_content_ids;
+    size_t max_size;
+
+    for (const std::string& name : names) {
+        if (!source_.is_stream_cacheable(name.c_str()))
+            continue;
+
+        u64 content_id = source_.get_stream_content_id(name.c_str());
+        std::lock_guard lock{mutex_};
+
+        if (names_.contains(std::string_view{name}))
+            continue;
+
+        auto content_it = content_id ? contents_.find(content_id) : contents_.end();
+
+        if (content_it != contents_.end()) {
+            add_alias(name, content_it->second);
+            continue;
+        }
+
+        missing_names.push_back(name);
+        missing_content_ids.push_back(content_id);
+    }
+
+    if (missing_names.empty())
+        return;
+
+    {
+        std::lock_guard lock{mutex_};
+        max_size = budget_;
+        ++num_pending_prefetches_;
+    }
+
+    auto remaining = std::make_shared<std::atomic<size_t>>(missing_names.size());
+    auto finish = [this] {
+        // Notify while locked, since the cache may be destroyed as soon as the count is zero.
+        std::lock_guard lock{mutex_};
+        --num_pending_prefetches_;
+        prefetch_done_.notify_all();
+    };
+
+    // Streams that fail to read are ignored, since they will be read again when they're used.
+    bool async = source_.read_streams_async(missing_names, max_size,
+        [this, remaining, finish, missing_names, missing_content_ids](size_t index, ByteBuffer&& data, Error& error) {
+            if (!error)
+                insert(missing_names[index], missing_content_ids[index], std::make_shared<const ByteBuffer>(std::move(data)));
+
+            if (remaining->fetch_sub(1, std::memory_order_acq_rel) == 1)
+                finish();
+        });
+
+    if (!async) {
+        finish();
+        source_.prefetch(missing_names);
+    }
+}
+
+ByteBuffer AssetCache::read_stream_buffer(const char* name, size_t max_size, Error& out_error)
+{
+    SharedBuffer buffer = get(name, max_size, out_error);
+
+    if (!buffer)
+        return {};
+
+    return make_byte_buffer(std::move(buffer));
+}
+
+bool AssetCache::read_streams_async(std::span<const std::string> names, size_t max_size,
+                                    ReadStreamsCallback callback)
+{
+    std::vector<SharedBuffer> cached(names.size());
+    std::vector<std::string> missing_names;
+    std::vector<size_t> missing_indices;
+    std::vector<u64> missing_content_ids;
+
+    // Hits and misses aren't counted until the read is accepted, since the caller falls back to
+    // `get` otherwise, which counts them again.
+    for (size_t i = 0; i < names.size(); ++i) {
+        u64 content_id;
+        cached[i] = find(names[i].c_str(), content_id, false);
+
+        if (!cached[i]) {
+            missing_names.push_back(names[i]);
+            missing_indices.push_back(i);
+            missing_content_ids.push_back(content_id);
+        }
+    }
+
+    auto shared_callback = std::make_shared<ReadStreamsCallback>(std::move(callback));
+
+    // Read the missing streams first, since the callback must not be called if the source doesn't
+    // support asynchronous reads.
+    if (!missing_names.empty()) {
+        bool async = source_.read_streams_async(missing_names, max_size,
+            [this, shared_callback, missing_names, missing_indices, missing_content_ids](size_t index, ByteBuffer&& data, Error& error) {
+                if (error) {
+                    (*shared_callback)(missing_indices[index], {}, error);
+                } else if (!source_.is_stream_cacheable(missing_names[index].c_str())) {
+                    (*shared_callback)(missing_indices[index], std::move(data), error);
+                } else {
+                    SharedBuffer buffer = insert(missing_names[index], missing_content_ids[index],
+                                                 std::make_shared<const ByteBuffer>(std::move(data)));
+                    (*shared_callback)(missing_indices[index], make_byte_buffer(std::move(buffer)), error);
+                }
+            });
+
+        if (!async)
+            return false;
+    }
+
+    hits_.fetch_add(names.size() - missing_names.size(), std::memory_order_relaxed);
+    misses_.fetch_add(missing_names.size(), std::memory_order_relaxed);
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!cached[i])
+            continue;
+
+        Error error;
+
+        if (cached[i]->size() > max_size) {
+            error = {.code = IoErrorCode::stream_too_long};
+            (*shared_callback)(i, {}, error);
+        } else {
+            (*shared_callback)(i, make_byte_buffer(std::move(cached[i])), error);
+        }
+    }
+
+    return true;
+}
+
+void AssetCache::set_budget(size_t budget)
+{
+    std::lock_guard lock{mutex_};
+    budget_ = budget;
+    evict_to(budget);
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_ASSET_CACHE_H_INCLUDED
+#define IO_ASSET_CACHE_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include "stream.h"
+
+namespace geo {
+
+    /// Shared reference to an immutable buffer held by an @ref AssetCache.
+    using SharedBuffer = std::shared_ptr<const ByteBuffer>;
+
+    /// Counters reported by @ref AssetCache::get_stats.
+    struct AssetCacheStats {
+        u64 hits = 0;
+        u64 misses = 0;
+        u64 evictions = 0;
+        size_t num_entries = 0;
+        size_t size = 0;
+        size_t budget = 0;
+    };
+
+    /// Stream provider that keeps recently read streams from another provider in memory, so that
+    /// reading them again doesn't require decompressing them again. When the total size of the
+    /// cached streams exceeds the budget, the least recently used streams are evicted. Evicted
+    /// buffers remain valid for as long as they are referenced. Streams that the source reports
+    /// as having the same contents share a buffer, which is only counted against the budget once.
+    /// The cache may be used from multiple threads if the wrapped provider allows it.
+    class AssetCache : public StreamProvider {
+    public:
+        AssetCache(const AssetCache&) = delete;
+        explicit AssetCache(StreamProvider& source, size_t budget);
+
+        /// Waits for streams that are being decoded by @ref prefetch.
+        ~AssetCache();
+
+        /// Evicts all streams.
+        void clear();
+
+        /// Gets a stream's contents, reading it from the source if it isn't cached. Streams larger
+        /// than the budget, or that the source reports as not cacheable, are returned without being
+        /// cached.
+        SharedBuffer get(const char* name, size_t max_size, Error& out_error);
+
+        AssetCacheStats get_stats() const;
+
+        /// Sets the maximum total size of the cached streams, evicting streams if necessary.
+        void set_budget(size_t budget);
+
+        /// Sets whether @ref prefetch reads and decodes streams into the cache in the background,
+        /// rather than only passing the hint to the source. Disabled by default.
+        void set_prefetch_decode(bool enabled) { prefetch_decode_.store(enabled, std::memory_order_relaxed); }
+
+        bool get_stream_names(std::vector<std::string>& out_names, Error& out_error) override;
+        i64 get_stream_size(const char* name, Error& out_error) override;
+        u64 get_stream_content_id(const char* name) override;
+        bool is_stream_cacheable(const char* name) override;
+        std::unique_ptr<Stream> open_stream(const char* name, Error& out_error) override;
+
+        /// If prefetch decoding is enabled, starts reading the streams that aren't cached through
+        /// the source's asynchronous reads, and caches them as they're decoded. Streams in layers
+        /// of a @ref LayeredProvider that can't read asynchronously are read before this returns.
+        /// Otherwise, or if the source doesn't support asynchronous reads, the hint is passed to
+        /// the source.
+        void prefetch(std::span<const std::string> names) override;
+
+        /// Returns a reference to the cached buffer rather than a copy.
+        ByteBuffer read_stream_buffer(const char* name, size_t max_size, Error& out_error) override;
+
+        /// Loads the streams into the cache through the source's asynchronous reads, if supported.
+        bool read_streams_async(std::span<const std::string> names, size_t max_size,
+                                ReadStreamsCallback callback) override;
+
+        /// Wraps a shared buffer in a @ref ByteBuffer that keeps a reference to it.
+        static ByteBuffer make_byte_buffer(SharedBuffer buffer);
+
+    private:
+        struct StringHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+        };
+
+        struct Entry {
+            std::string name;
+            SharedBuffer buffer;
+            u64 content_id = 0;
+            std::vector<std::string> aliases{}; // Other names that share the buffer
+        };
+
+        using EntryList = std::list<Entry>;
+
+        StreamProvider& source_;
+        size_t budget_;
+        size_t size_ = 0;
+        EntryList entries_; // Most recently used first
+        std::unordered_map<std::string, EntryList::iterator, StringHash, std::equal_to<>> names_;
+        std::unordered_map<u64, EntryList::iterator> contents_; // Entries with a content ID
+        mutable std::mutex mutex_;
+        std::condition_variable prefetch_done_;
+        size_t num_pending_prefetches_ = 0; // Batches started by `prefetch`
+        std::atomic<bool> prefetch_decode_ = false;
+        std::atomic<u64> hits_ = 0;
+        std::atomic<u64> misses_ = 0;
+        std::atomic<u64> evictions_ = 0;
+
+        // Looks up a cached buffer by name, or by the stream's content ID, and marks it as recently
+        // used. Sets `out_content_id` to the ID if the buffer isn't cached. Counts a hit or miss
+        // unless `count` is false.
+        SharedBuffer find(const char* name, u64& out_content_id, bool count = true);
+
+        // Adds a buffer to the cache, evicting other buffers if necessary. Returns the cached
+        // buffer, which may differ if another thread cached the same stream or contents first.
+        SharedBuffer insert(std::string_view name, u64 content_id, SharedBuffer&& buffer);
+
+        // Adds a name for a cached entry. Requires `mutex_`.
+        void add_alias(std::string_view name, EntryList::iterator it);
+
+        // Evicts least recently used buffers until the size is within `budget`. Requires `mutex_`.
+        void evict_to(size_t budget);
+    };
+
+} // namespace geo
+
+#endif // IO_ASSET_CACHE_H_INCLUDED
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#if defined(__x86_64__) || defined(_M_X64)
+# define CRC32_X86_64 1
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#elif defined(__ARM_FEATURE_CRC32)
+# define CRC32_ARM 1
+# include <arm_acle.h>
+#endif
+
+#include <array>
+#include <cstring>
+
+#include "crc32.h"
+
+using namespace geo;
+
+namespace {
+
+    constexpr u32 polynomial = 0xedb88320;
+
+    // Tables for slicing-by-8. `tables[0]` is the usual byte-wise table, and `tables[k][i]` is the
+    // CRC of byte `i` followed by `k` zero bytes.
+    constexpr std::array<std::array<u32, 256>, 8> make_tables()
+    {
+        std::array<std::array<u32, 256>, 8> tables{};
+
+        for (u32 i = 0; i < 256; ++i) {
+            u32 crc = i;
+
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+
+            tables[0][i] = crc;
+        }
+
+        for (size_t k = 1; k < 8; ++k) {
+            for (size_t i = 0; i < 256; ++i)
+                tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xff];
+        }
+
+        return tables;
+    }
+
+    constexpr std::array<std::array<u32, 256>, 8> tables = make_tables();
+
+    // Portable implementation. `crc` is the inverted running CRC.
+    u32 update_tables(u32 crc, const u8* data, size_t size)
+    {
+        for (; size >= 8; data += 8, size -= 8) {
+            u32 lo = crc ^ (u32(data[0]) | u32(data[1]) << 8 | u32(data[2]) << 16 | u32(data[3]) << 24);
+            u32 hi = u32(data[4]) | u32(data[5]) << 8 | u32(data[6]) << 16 | u32(data[7]) << 24;
+
+            crc = tables[7][lo & 0xff] ^ tables[6][(lo >> 8) & 0xff]
+                ^ tables[5][(lo >> 16) & 0xff] ^ tables[4][lo >> 24]
+                ^ tables[3][hi & 0xff] ^ tables[2][(hi >> 8) & 0xff]
+                ^ tables[1][(hi >> 16) & 0xff] ^ tables[0][hi >> 24];
+        }
+
+        for (; size > 0; ++data, --size)
+            crc = (crc >> 8) ^ tables[0][(crc ^ *data) & 0xff];
+
+        return crc;
+    }
+
+#if CRC32_X86_64
+
+    // The SSE4.2 `crc32` instruction uses the Castagnoli polynomial rather than ZIP's, so the
+    // accelerated path folds the data with carry-less multiplication instead, as described in
+    // Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction". The
+    // constants are those of the bit-reflected ZIP polynomial given in the paper.
+# ifdef _MSC_VER
+#  define CRC32_TARGET_PCLMUL
+# else
+#  define CRC32_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+# endif
+
+    constexpr size_t pclmul_min_size = 64;
+
+    // Requires at least `pclmul_min_size` bytes, and processes a multiple of 16 bytes of them.
+    // Returns the number of bytes processed through `out_size`.
+    CRC32_TARGET_PCLMUL u32 update_pclmul(u32 crc, const u8* data, size_t size, size_t& out_size)
+    {
+        alignas(16) static const u64 k1k2[] = {0x0154442bd4, 0x01c6e41596};
+        alignas(16) static const u64 k3k4[] = {0x01751997d0, 0x00ccaa009e};
+        alignas(16) static const u64 k5k0[] = {0x0163cd6124, 0x0000000000};
+        alignas(16) static const u64 poly[] = {0x01db710641, 0x01f7011641};
+
+        const u8* start = data;
+        const u8* end = data + (size & ~size_t(15));
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+        // Load the first 64 bytes into four accumulators.
+        x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+        x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+        x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(int(crc)));
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+        data += 64;
+
+        // Fold 64 bytes at a time.
+        while (end - data >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00)));
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10)));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20)));
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30)));
+            data += 64;
+        }
+
+        // Fold the accumulators into one.
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+
+        for (__m128i next : {x2, x3, x4}) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+        }
+
+        // Fold the remaining 16-byte blocks.
+        for (; data < end; data += 16) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data))), x5);
+        }
+
+        // Fold 128 bits to 64 bits.
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+        x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, x0, 0x00), x2);
+
+        // Barrett reduction to 32 bits.
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        out_size = size_t(data - start);
+        return u32(_mm_extract_epi32(x1, 1));
+    }
+
+    bool detect_pclmul()
+    {
+# ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 1)) && (info[2] & (1 << 19));
+# else
+        return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+# endif
+    }
+
+    const bool has_pclmul = detect_pclmul();
+
+#endif // CRC32_X86_64
+
+} // namespace
+
+u32 crc32::update(u32 crc, std::span<const u8> data)
+{
+    const u8* ptr = data.data();
+    size_t size = data.size();
+
+    crc = ~crc;
+
+#if CRC32_X86_64
+    if (has_pclmul && size >= pclmul_min_size) {
+        size_t processed;
+        crc = update_pclmul(crc, ptr, size, processed);
+        ptr += processed;
+        size -= processed;
+    }
+#elif CRC32_ARM
+    // ARMv8's CRC32 instructions use ZIP's polynomial.
+    for (; size >= 8; ptr += 8, size -= 8) {
+        u64 word;
+        std::memcpy(&word, ptr, 8);
+        crc = __crc32d(crc, word);
+    }
+
+    for (; size > 0; ++ptr, --size)
+        crc = __crc32b(crc, *ptr);
+#endif
+
+    return ~update_tables(crc, ptr, size);
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_CRC32_H_INCLUDED
+#define IO_CRC32_H_INCLUDED
+
+#include <span>
+
+#include <core/types.h>
+
+namespace geo {
+
+    /// CRC-32 checksum functions, using the same polynomial as ZIP and zlib. On x86-64 CPUs with
+    /// PCLMULQDQ and on ARMv8 CPUs with CRC32 instructions, the checksum is computed with them.
+    namespace crc32 {
+
+        /// Updates a running CRC-32 with `data`. The initial CRC should be zero.
+        u32 update(u32 crc, std::span<const u8> data);
+
+    } // namespace crc32
+
+} // namespace geo
+
+#endif // IO_CRC32_H_INCLUDED
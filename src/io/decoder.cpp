@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+
+#include <math/math.h>
+#include <system/debug.h>
+
+#include "crc32.h"
+#include "decoder.h"
+
+using namespace geo;
+
+namespace {
+
+    constexpr size_t input_buffer_size = 64*1024;
+    constexpr size_t skip_buffer_size = 16*1024;
+
+    Error make_truncated_error()
+    {
+        return {.description = "Compressed data is truncated", .code = IoErrorCode::end_of_stream};
+    }
+
+} // namespace
+
+//==================================================================================================
+// Decoder
+//==================================================================================================
+
+Decoder::~Decoder()
+{
+}
+
+bool Decoder::decode_buffer(std::span<const u8> in, std::span<u8> out, Error& out_error)
+{
+    bool frame_end = true;
+
+    reset();
+
+    while (!in.empty()) {
+        size_t in_size = in.size();
+        size_t out_size = out.size();
+
+        if (!decode(in, out, frame_end, out_error))
+            return false;
+
+        // If no progress was made, the output buffer is full.
+        if (in.size() == in_size && out.size() == out_size) {
+            out_error = {.code = IoErrorCode::stream_too_long};
+            return false;
+        }
+    }
+
+    if (!frame_end || !out.empty()) {
+        out_error = make_truncated_error();
+        return false;
+    }
+
+    return true;
+}
+
+//==================================================================================================
+// DecoderStream
+//==================================================================================================
+
+DecoderStream::DecoderStream(std::unique_ptr<Stream>&& raw, std::unique_ptr<Decoder>&& decoder, i64 size)
+    : raw_{std::move(raw)}
+    , decoder_{std::move(decoder)}
+    , input_{new u8[input_buffer_size]}
+    , size_{size}
+{
+    ASSERT(raw_ != nullptr && decoder_ != nullptr);
+}
+
+DecoderStream::~DecoderStream()
+{
+    close();
+}
+
+void DecoderStream::close(Error& out_error)
+{
+    if (raw_)
+        raw_->close(out_error);
+
+    raw_.reset();
+    decoder_.reset();
+    input_.reset();
+    input_pos_ = 0;
+    input_end_ = 0;
+    raw_position_ = 0;
+    position_ = 0;
+    size_ = -1;
+    checkpoints_.clear();
+    skip_buffer_.reset();
+    expected_crc_.reset();
+}
+
+i64 DecoderStream::get_position(Error& out_error) const
+{
+    if (!raw_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    }
+
+    return i64(position_);
+}
+
+i64 DecoderStream::get_size(Error& out_error) const
+{
+    if (!raw_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    } else if (size_ < 0) {
+        out_error = {.code = IoErrorCode::stream_size_undefined};
+        return -1;
+    }
+
+    return size_;
+}
+
+size_t DecoderStream::read_partial(void* dst, size_t size, Error& out_error)
+{
+    Error local_error;
+
+    if (!raw_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return 0;
+    }
+
+    // Never decode beyond the declared size.
+    if (size_ >= 0)
+        size = size_t(math::min(u64(size), u64(size_) - position_));
+
+    std::span<u8> out{static_cast<u8*>(dst), size};
+
+    // Decode until at least one byte is produced.
+    while (!out.empty() && out.size() == size) {
+        if (input_pos_ == input_end_) {
+            size_t pass_result = raw_->read_partial(input_.get(), input_buffer_size, local_error);
+
+            if (local_error) {
+                out_error = std::move(local_error);
+                return 0;
+            } else if (!pass_result) {
+                if (!at_frame_start_ || (size_ >= 0 && position_ < u64(size_)))
+                    out_error = make_truncated_error();
+                else if (crc_valid_ && expected_crc_ && crc_ != *expected_crc_)
+                    out_error = {.code = IoErrorCode::checksum_mismatch};
+                return 0;
+            }
+
+            input_pos_ = 0;
+            input_end_ = pass_result;
+            raw_position_ += pass_result;
+        }
+
+        // Record a checkpoint at the start of each frame.
+        if (at_frame_start_) {
+            u64 frame_raw_position = raw_position_ - (input_end_ - input_pos_);
+
+            if (checkpoints_.empty() || frame_raw_position > checkpoints_.back().raw_position)
+                checkpoints_.push_back({frame_raw_position, position_});
+
+            at_frame_start_ = false;
+        }
+
+        std::span<const u8> in{&input_[input_pos_], input_end_ - input_pos_};
+
+        if (!decoder_->decode(in, out, at_frame_start_, local_error)) {
+            out_error = std::move(local_error);
+            return 0;
+        }
+
+        input_pos_ = input_end_ - in.size();
+    }
+
+    size_t result = size - out.size();
+
+    if (crc_valid_)
+        crc_ = crc32::update(crc_, {static_cast<const u8*>(dst), result});
+
+    position_ += result;
+
+    // Verify the checksum once all of the data has been decoded.
+    if (result && crc_valid_ && expected_crc_ && size_ >= 0 && position_ == u64(size_) && crc_ != *expected_crc_)
+        out_error = {.code = IoErrorCode::checksum_mismatch};
+
+    return result;
+}
+
+i64 DecoderStream::seek(i64 offset, SeekOrigin origin, Error& out_error)
+{
+    i64 base;
+
+    if (!raw_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    }
+
+    switch (origin) {
+        case SeekOrigin::set:
+            base = 0;
+            break;
+        case SeekOrigin::current:
+            base = i64(position_);
+            break;
+        case SeekOrigin::end:
+            if (size_ < 0) {
+                out_error = {.code = IoErrorCode::stream_size_undefined};
+                return -1;
+            }
+            base = size_;
+            break;
+        default:
+            base = -1;
+            break;
+    }
+
+    if (base < 0 || offset < -base || (size_ >= 0 && offset > size_ - base)) {
+        out_error = {.code = std::make_error_code(std::errc::invalid_argument)};
+        return -1;
+    }
+
+    u64 target = u64(base + offset);
+
+    if (target == position_)
+        return i64(position_);
+
+    // The checksum can only be verified if the data is decoded sequentially.
+    crc_valid_ = false;
+
+    // Restart at the nearest checkpoint if seeking backward, or if a checkpoint is closer to the
+    // target than the current position. Otherwise, continue decoding from the current position.
+    auto it = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), target,
+                               [](u64 t, const Checkpoint& cp) { return t < cp.position; });
+    Checkpoint nearest = it != checkpoints_.begin() ? *std::prev(it) : Checkpoint{0, 0};
+
+    if (target < position_ || nearest.position > position_) {
+        if (!restart_at(nearest, out_error))
+            return -1;
+    }
+
+    if (!skip(target - position_, out_error))
+        return -1;
+
+    return i64(position_);
+}
+
+bool DecoderStream::restart_at(const Checkpoint& checkpoint, Error& out_error)
+{
+    if (raw_->seek(i64(checkpoint.raw_position), SeekOrigin::set, out_error) < 0)
+        return false;
+
+    decoder_->reset();
+    input_pos_ = 0;
+    input_end_ = 0;
+    raw_position_ = checkpoint.raw_position;
+    position_ = checkpoint.position;
+    at_frame_start_ = true;
+    return true;
+}
+
+bool DecoderStream::skip(u64 count, Error& out_error)
+{
+    Error local_error;
+    size_t pass_result;
+
+    if (!skip_buffer_)
+        skip_buffer_.reset(new u8[skip_buffer_size]);
+
+    while (count) {
+        pass_result = read_partial(skip_buffer_.get(), size_t(math::min(count, u64(skip_buffer_size))), local_error);
+
+        if (local_error) {
+            out_error = std::move(local_error);
+            return false;
+        } else if (!pass_result) {
+            out_error = {.code = IoErrorCode::end_of_stream};
+            return false;
+        }
+
+        count -= pass_result;
+    }
+
+    return true;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_DECODER_H_INCLUDED
+#define IO_DECODER_H_INCLUDED
+
+#include <optional>
+
+#include "stream.h"
+
+namespace geo {
+
+    /// Interface for streaming decompressors whose input is made up of independently decodable
+    /// frames.
+    class Decoder {
+    public:
+        virtual ~Decoder() = 0;
+
+        Decoder& operator=(const Decoder&) = delete;
+
+        /// Decodes data from `in` into `out`, advancing both spans past the consumed and produced
+        /// bytes. Sets `out_frame_end` to indicate whether the end of a frame was reached, in which
+        /// case the next call begins decoding a new frame.
+        virtual bool decode(std::span<const u8>& in, std::span<u8>& out, bool& out_frame_end, Error& out_error) = 0;
+
+        /// Discards any partially decoded frame so decoding can restart at a frame boundary.
+        virtual void reset() = 0;
+
+        /// Decodes all of `in`, which must consist of complete frames, into `out`, which must be
+        /// exactly the size of the decoded data.
+        bool decode_buffer(std::span<const u8> in, std::span<u8> out, Error& out_error);
+    };
+
+    /// Input stream that decodes compressed data read from another stream. If the raw stream is
+    /// seekable, the start of each frame is recorded as a checkpoint so that seeking only has to
+    /// decode from the nearest preceding frame rather than from the start of the stream.
+    class DecoderStream : public Stream {
+    public:
+        using Stream::close;
+
+        DecoderStream() = default;
+        DecoderStream(const DecoderStream&) = delete;
+        explicit DecoderStream(std::unique_ptr<Stream>&& raw, std::unique_ptr<Decoder>&& decoder, i64 size = -1);
+        ~DecoderStream();
+
+        /// Verifies the decoded data against a CRC-32 when it is read to the end without seeking.
+        void set_expected_crc(u32 crc) { expected_crc_ = crc; }
+
+        void close(Error& out_error) override;
+        i64 get_position(Error& out_error) const override;
+        i64 get_size(Error& out_error) const override;
+        bool is_open() const override { return raw_ != nullptr; }
+        bool is_readable() const override { return true; }
+        bool is_seekable() const override { return raw_ && raw_->is_seekable(); }
+        size_t read_partial(void* dst, size_t size, Error& out_error) override;
+        i64 seek(i64 offset, SeekOrigin origin, Error& out_error) override;
+
+    private:
+        struct Checkpoint {
+            u64 raw_position;
+            u64 position;
+        };
+
+        std::unique_ptr<Stream> raw_{};
+        std::unique_ptr<Decoder> decoder_{};
+        std::unique_ptr<u8[]> input_{};
+        size_t input_pos_ = 0;
+        size_t input_end_ = 0;
+        u64 raw_position_ = 0; // Raw stream position corresponding to `input_end_`
+        u64 position_ = 0;
+        i64 size_ = -1;
+        bool at_frame_start_ = true;
+        std::vector<Checkpoint> checkpoints_{};
+        std::unique_ptr<u8[]> skip_buffer_{};
+        std::optional<u32> expected_crc_{};
+        u32 crc_ = 0;
+        bool crc_valid_ = true;
+
+        // Restarts decoding at a checkpoint.
+        bool restart_at(const Checkpoint& checkpoint, Error& out_error);
+
+        // Decodes and discards `count` bytes.
+        bool skip(u64 count, Error& out_error);
+    };
+
+} // namespace geo
+
+#endif // IO_DECODER_H_INCLUDED
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <limits>
+#include <string_view>
+
+#include <system/mapping.h>
+
+#include "directory_provider.h"
+
+using namespace geo;
+
+namespace {
+
+    // Converts a filesystem error, reporting missing files as @ref IoErrorCode::not_found.
+    Error make_filesystem_error(ErrorDescription description, std::error_code ec)
+    {
+        if (ec == std::errc::no_such_file_or_directory)
+            return {.code = IoErrorCode::not_found};
+
+        return {.description = std::move(description), .code = ec};
+    }
+
+} // namespace
+
+DirectoryProvider::DirectoryProvider(const oschar_t* root)
+    : root_{root}
+{
+}
+
+bool DirectoryProvider::get_path(const char* name, std::filesystem::path& out_path, Error& out_error) const
+{
+    std::string_view remaining = name;
+
+    if (remaining.empty() || remaining.starts_with('/')) {
+        out_error = {.code = IoErrorCode::not_found};
+        return false;
+    }
+
+    // Reject components that could escape the root directory or are interpreted differently on
+    // some platforms.
+    while (!remaining.empty()) {
+        size_t end = remaining.find('/');
+        std::string_view component = remaining.substr(0, end);
+
+        if (component.empty() || component == "." || component == ".."
+            || component.find_first_of("\\:") != std::string_view::npos)
+        {
+            out_error = {.code = IoErrorCode::not_found};
+            return false;
+        }
+
+        remaining = end == std::string_view::npos ? std::string_view{} : remaining.substr(end + 1);
+    }
+
+    std::u8string_view utf8_name{reinterpret_cast<const char8_t*>(name), std::strlen(name)};
+    out_path = root_ / std::filesystem::path{utf8_name};
+    return true;
+}
+
+bool DirectoryProvider::get_stream_names(std::vector<std::string>& out_names, Error& out_error)
+{
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator it{root_, ec};
+
+    for (; !ec && it != std::filesystem::recursive_directory_iterator{}; it.increment(ec)) {
+        std::error_code type_ec;
+
+        if (!it->is_regular_file(type_ec))
+            continue;
+
+        std::u8string name = it->path().lexically_relative(root_).generic_u8string();
+        out_names.emplace_back(reinterpret_cast<const char*>(name.data()), name.size());
+    }
+
+    if (ec) {
+        out_error = make_filesystem_error("Can't list directory", ec);
+        return false;
+    }
+
+    return true;
+}
+
+i64 DirectoryProvider::get_stream_size(const char* name, Error& out_error)
+{
+    std::filesystem::path path;
+    std::error_code ec;
+
+    if (!get_path(name, path, out_error))
+        return -1;
+
+    u64 size = std::filesystem::file_size(path, ec);
+
+    if (ec) {
+        out_error = make_filesystem_error("Can't get file size", ec);
+        return -1;
+    } else if (size > u64(std::numeric_limits<i64>::max())) {
+        out_error = {.code = IoErrorCode::stream_size_undefined};
+        return -1;
+    }
+
+    return i64(size);
+}
+
+std::unique_ptr<Stream> DirectoryProvider::open_stream(const char* name, Error& out_error)
+{
+    ByteBuffer buffer = read_stream_buffer(name, std::numeric_limits<size_t>::max(), out_error);
+
+    if (out_error)
+        return {};
+
+    return std::make_unique<ByteBufferStream>(std::move(buffer));
+}
+
+ByteBuffer DirectoryProvider::read_stream_buffer(const char* name, size_t max_size, Error& out_error)
+{
+    std::filesystem::path path;
+
+    if (!get_path(name, path, out_error))
+        return {};
+
+    auto mapping = std::make_unique<FileMapping>();
+
+    if (!mapping->open(path.c_str(), out_error)) {
+        if (out_error.code == std::errc::no_such_file_or_directory)
+            out_error = {.code = IoErrorCode::not_found};
+
+        return {};
+    } else if (mapping->bytes().size() > max_size) {
+        out_error = {.code = IoErrorCode::stream_too_long};
+        return {};
+    }
+
+    std::span<const u8> bytes = mapping->bytes();
+
+    return ByteBuffer::adopt(bytes, [](void* context) { delete static_cast<FileMapping*>(context); },
+                             mapping.release());
+}
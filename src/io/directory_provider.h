@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_DIRECTORY_PROVIDER_H_INCLUDED
+#define IO_DIRECTORY_PROVIDER_H_INCLUDED
+
+#include <filesystem>
+
+#include "stream.h"
+
+namespace geo {
+
+    /// Stream provider that reads loose files from a directory, e.g., development overrides of
+    /// packed assets. Stream names are UTF-8 paths relative to the root directory, separated by
+    /// `/`. Files are memory-mapped when read.
+    class DirectoryProvider : public StreamProvider {
+    public:
+        DirectoryProvider(const DirectoryProvider&) = delete;
+        explicit DirectoryProvider(const oschar_t* root);
+
+        const std::filesystem::path& root() const { return root_; }
+
+        bool get_stream_names(std::vector<std::string>& out_names, Error& out_error) override;
+        i64 get_stream_size(const char* name, Error& out_error) override;
+        std::unique_ptr<Stream> open_stream(const char* name, Error& out_error) override;
+
+        /// Returns a view of the file's memory mapping.
+        ByteBuffer read_stream_buffer(const char* name, size_t max_size, Error& out_error) override;
+
+    private:
+        std::filesystem::path root_;
+
+        // Gets the path of a stream's file. Fails if the name could refer to a file outside of the
+        // root directory.
+        bool get_path(const char* name, std::filesystem::path& out_path, Error& out_error) const;
+    };
+
+} // namespace geo
+
+#endif // IO_DIRECTORY_PROVIDER_H_INCLUDED
@@ -0,0 +1,542 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <filesystem>
+
+#include <core/endian.h>
+#include <system/debug.h>
+#include <system/system.h>
+
+#include "crc32.h"
+#include "disk_cache.h"
+#include "zip_directory.h"
+
+using namespace geo;
+
+namespace {
+
+    // Cache file layout (all integers are little-endian):
+    //
+    //   Header (padded to `page_size`):
+    //     u32 magic, u32 version, u64 pak_size, i64 pak_mtime, u32 directory_crc, u32 num_entries,
+    //     u64 table_offset, u64 table_size
+    //   Entry data, each aligned to `page_size`
+    //   Table: per entry, u64 offset, u64 size, u32 crc, u16 name_size, name
+    constexpr u32 cache_magic = 0x31434447; // "GDC1"
+    constexpr u32 cache_version = 2;
+    constexpr size_t header_size = 48;
+    constexpr size_t table_record_size = 22;
+    constexpr u64 page_size = 4096;
+    constexpr size_t max_name_size = 0xFFFF;
+
+    Error make_invalid_cache_error()
+    {
+        return {.description = "invalid disk cache", .code = IoErrorCode::invalid_archive};
+    }
+
+    u64 align_to_page(u64 offset)
+    {
+        return (offset + page_size - 1) & ~(page_size - 1);
+    }
+
+    bool write_bytes(FILE* fp, const void* data, size_t size, Error& out_error)
+    {
+        if (size && fwrite(data, 1, size, fp) != size) {
+            out_error = {.description = "fwrite failed", .code = {errno, std::generic_category()}};
+            return false;
+        }
+
+        return true;
+    }
+
+} // namespace
+
+//==================================================================================================
+// DiskCache
+//==================================================================================================
+
+DiskCache::DiskCache(StreamProvider& source, const oschar_t* path, const PakIdentity& identity,
+                     size_t max_size)
+    : source_{source}
+    , path_{path}
+    , identity_{identity}
+    , max_size_{max_size}
+{
+    Error error;
+
+    if (!load(error) && !error.matches(std::make_error_condition(std::errc::no_such_file_or_directory)))
+        LOG_DEBUG("Discarding disk cache: {}", error);
+}
+
+DiskCache::~DiskCache()
+{
+    Error error;
+
+    if (!saved_ && !save(error))
+        LOG_WARNING("Can't save disk cache: {}", error);
+}
+
+bool DiskCache::find_mapped(std::string_view name, ByteBuffer& out_data)
+{
+    std::unique_lock lock{mutex_};
+    auto it = entries_.find(name);
+
+    if (saved_ || it == entries_.end() || !it->second.is_mapped)
+        return false;
+
+    // Entries are never erased, so the reference stays valid while the lock is released.
+    Entry& entry = it->second;
+    std::shared_ptr<const FileMapping> mapping = mapping_;
+
+    // Entries are checked when they're first used rather than when the file is loaded, so that
+    // loading doesn't read the whole file. The lock isn't held while checking, since the entry may
+    // be large.
+    if (!entry.verified) {
+        std::span<const u8> data = entry.mapped;
+        u32 crc = entry.crc;
+
+        lock.unlock();
+        bool valid = crc32::update(0, data) == crc;
+        lock.lock();
+
+        if (!valid) {
+            LOG_WARNING("Disk cache entry is corrupt: {}", name);
+            entry.is_mapped = false;
+            return false;
+        }
+
+        entry.verified = true;
+    }
+
+    if (!entry.used) {
+        entry.used = true;
+        used_names_.push_back(it->first);
+        used_size_ += entry.mapped.size();
+    }
+
+    out_data = ByteBuffer::share(entry.mapped, std::move(mapping));
+    return true;
+}
+
+bool DiskCache::get_pak_identity(const oschar_t* path, PakIdentity& out_identity, Error& out_error)
+{
+    FileInfo info;
+
+    if (!system::get_file_info(path, info, out_error))
+        return false;
+
+    // The central directory covers every entry's name, size and CRC-32, so its checksum detects
+    // rebuilt PAKs even if the size and modification time happen to match.
+    FileMapping mapping;
+    ZipDirectory directory;
+
+    if (!mapping.open(path, out_error) || !directory.parse(mapping.bytes(), out_error))
+        return false;
+
+    out_identity = {.size = info.size, .mtime = info.mtime, .directory_crc = directory.get_crc()};
+    return true;
+}
+
+bool DiskCache::get_stream_names(std::vector<std::string>& out_names, Error& out_error)
+{
+    return source_.get_stream_names(out_names, out_error);
+}
+
+i64 DiskCache::get_stream_size(const char* name, Error& out_error)
+{
+    {
+        std::lock_guard lock{mutex_};
+        auto it = entries_.find(std::string_view{name});
+
+        if (!saved_ && it != entries_.end() && it->second.is_mapped)
+            return i64(it->second.mapped.size());
+    }
+
+    return source_.get_stream_size(name, out_error);
+}
+
+u64 DiskCache::get_stream_content_id(const char* name)
+{
+    return source_.get_stream_content_id(name);
+}
+
+bool DiskCache::is_stream_cacheable(const char* name)
+{
+    return source_.is_stream_cacheable(name);
+}
+
+ByteBuffer DiskCache::insert(const char* name, ByteBuffer&& data)
+{
+    // Buffers that don't own their memory, e.g., stored entries in a memory-mapped PAK, are
+    // already cheap to read. Streams the source doesn't want cached, e.g., resident streams, are
+    // left out too.
+    if (!data.owns_memory() || !source_.is_stream_cacheable(name))
+        return std::move(data);
+
+    SharedBuffer buffer = std::make_shared<const ByteBuffer>(std::move(data));
+    std::lock_guard lock{mutex_};
+
+    if (saved_ || used_size_ + buffer->size() > max_size_)
+        return AssetCache::make_byte_buffer(std::move(buffer));
+
+    auto it = entries_.try_emplace(std::string{name}).first;
+    Entry& entry = it->second;
+
+    if (!entry.used) {
+        entry.buffer = buffer;
+        entry.used = true;
+        used_names_.push_back(it->first);
+        used_size_ += buffer->size();
+        modified_ = true;
+    }
+
+    return AssetCache::make_byte_buffer(std::move(buffer));
+}
+
+bool DiskCache::load(Error& out_error)
+{
+    auto mapping = std::make_shared<FileMapping>();
+
+    if (!mapping->open(path_.c_str(), out_error))
+        return false;
+
+    mapping_ = std::move(mapping);
+    std::span<const u8> file = mapping_->bytes();
+
+    if (file.size() < header_size || endian::load_le32(&file[0]) != cache_magic
+        || endian::load_le32(&file[4]) != cache_version)
+    {
+        mapping_.reset();
+        out_error = make_invalid_cache_error();
+        return false;
+    }
+
+    PakIdentity identity = {
+        .size = endian::load_le64(&file[8]),
+        .mtime = i64(endian::load_le64(&file[16])),
+        .directory_crc = endian::load_le32(&file[24]),
+    };
+
+    if (identity != identity_) {
+        mapping_.reset();
+        out_error = {.description = "PAK has changed"};
+        return false;
+    }
+
+    u32 num_entries = endian::load_le32(&file[28]);
+    u64 table_offset = endian::load_le64(&file[32]);
+    u64 table_size = endian::load_le64(&file[40]);
+
+    if (table_offset > file.size() || table_size > file.size() - table_offset) {
+        mapping_.reset();
+        out_error = make_invalid_cache_error();
+        return false;
+    }
+
+    std::span<const u8> table = file.subspan(size_t(table_offset), size_t(table_size));
+    size_t pos = 0;
+
+    for (u32 i = 0; i < num_entries; ++i) {
+        if (table.size() - pos < table_record_size) {
+            entries_.clear();
+            mapping_.reset();
+            out_error = make_invalid_cache_error();
+            return false;
+        }
+
+        u64 offset = endian::load_le64(&table[pos]);
+        u64 size = endian::load_le64(&table[pos + 8]);
+        u32 crc = endian::load_le32(&table[pos + 16]);
+        size_t name_size = endian::load_le16(&table[pos + 20]);
+
+        pos += table_record_size;
+
+        if (table.size() - pos < name_size || offset > table_offset || size > table_offset - offset) {
+            entries_.clear();
+            mapping_.reset();
+            out_error = make_invalid_cache_error();
+            return false;
+        }
+
+        std::string name{reinterpret_cast<const char*>(&table[pos]), name_size};
+
+        pos += name_size;
+        entries_[std::move(name)] = {
+            .mapped = file.subspan(size_t(offset), size_t(size)),
+            .crc = crc,
+            .is_mapped = true,
+        };
+    }
+
+    return true;
+}
+
+std::unique_ptr<Stream> DiskCache::open_stream(const char* name, Error& out_error)
+{
+    ByteBuffer data;
+
+    if (find_mapped(name, data))
+        return std::make_unique<ByteBufferStream>(std::move(data));
+
+    // Streams opened incrementally aren't recorded, since they may be too large to buffer.
+    return source_.open_stream(name, out_error);
+}
+
+void DiskCache::prefetch(std::span<const std::string> names)
+{
+    std::vector<std::string> missing_names;
+
+    {
+        std::lock_guard lock{mutex_};
+
+        for (const std::string& name : names) {
+            auto it = entries_.find(name);
+
+            if (!saved_ && it != entries_.end() && it->second.is_mapped)
+                mapping_->prefetch(it->second.mapped);
+            else
+                missing_names.push_back(name);
+        }
+    }
+
+    if (!missing_names.empty())
+        source_.prefetch(missing_names);
+}
+
+ByteBuffer DiskCache::read_stream_buffer(const char* name, size_t max_size, Error& out_error)
+{
+    ByteBuffer data;
+
+    if (find_mapped(name, data)) {
+        if (data.size() > max_size) {
+            out_error = {.code = IoErrorCode::stream_too_long};
+            return {};
+        }
+
+        return data;
+    }
+
+    ByteBuffer buffer = source_.read_stream_buffer(name, max_size, out_error);
+
+    if (out_error)
+        return {};
+
+    return insert(name, std::move(buffer));
+}
+
+bool DiskCache::read_streams_async(std::span<const std::string> names, size_t max_size,
+                                   ReadStreamsCallback callback)
+{
+    // Cached streams that haven't been checked against their CRC-32 yet would be checked on this
+    // thread, so the caller reads the batch on its own threads instead.
+    {
+        std::lock_guard lock{mutex_};
+
+        for (const std::string& name : names) {
+            auto it = entries_.find(name);
+
+            if (!saved_ && it != entries_.end() && it->second.is_mapped && !it->second.verified)
+                return false;
+        }
+    }
+
+    std::vector<ByteBuffer> mapped(names.size());
+    std::vector<bool> is_mapped(names.size());
+    std::vector<std::string> missing_names;
+    std::vector<size_t> missing_indices;
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        is_mapped[i] = find_mapped(names[i], mapped[i]);
+
+        if (!is_mapped[i]) {
+            missing_names.push_back(names[i]);
+            missing_indices.push_back(i);
+        }
+    }
+
+    auto shared_callback = std::make_shared<ReadStreamsCallback>(std::move(callback));
+
+    // Read the missing streams first, since the callback must not be called if the source doesn't
+    // support asynchronous reads.
+    if (!missing_names.empty()) {
+        bool async = source_.read_streams_async(missing_names, max_size,
+            [this, shared_callback, missing_names, missing_indices](size_t index, ByteBuffer&& data, Error& error) {
+                if (error)
+                    (*shared_callback)(missing_indices[index], {}, error);
+                else
+                    (*shared_callback)(missing_indices[index], insert(missing_names[index].c_str(), std::move(data)), error);
+            });
+
+        if (!async)
+            return false;
+    }
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!is_mapped[i])
+            continue;
+
+        Error error;
+
+        if (mapped[i].size() > max_size) {
+            error = {.code = IoErrorCode::stream_too_long};
+            (*shared_callback)(i, {}, error);
+        } else {
+            (*shared_callback)(i, std::move(mapped[i]), error);
+        }
+    }
+
+    return true;
+}
+
+bool DiskCache::save(Error& out_error)
+{
+    std::lock_guard lock{mutex_};
+
+    if (saved_)
+        return true;
+
+    saved_ = true;
+
+    // Leave the existing file alone if nothing new was read.
+    if (!modified_) {
+        mapping_.reset();
+        return true;
+    }
+
+    std::filesystem::path path{path_};
+    std::filesystem::path temp_path{path_ + OSSTR ".tmp"};
+    std::error_code ec;
+
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    if (ec) {
+        mapping_.reset();
+        out_error = {.description = "can't create cache directory", .code = ec};
+        return false;
+    }
+
+    bool result = write(temp_path.c_str(), out_error);
+
+    // The mapping must be closed before the file can be replaced on some platforms. If streams or
+    // buffers from the old file are still alive there, replacing it fails and the new file is
+    // discarded.
+    mapping_.reset();
+
+    if (!result) {
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+
+    std::filesystem::rename(temp_path, path, ec);
+
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        out_error = {.description = "can't replace disk cache", .code = ec};
+        return false;
+    }
+
+    return true;
+}
+
+bool DiskCache::write(const oschar_t* path, Error& out_error)
+{
+    // Streams used in this run come first, in the order they were first used, so that they're
+    // read sequentially on the next run. Unused streams from the existing file fill any remaining
+    // space.
+    std::vector<const std::string*> names;
+    size_t total_size = used_size_;
+
+    for (const std::string& name : used_names_) {
+        if (name.size() <= max_name_size)
+            names.push_back(&name);
+    }
+
+    for (const auto& [name, entry] : entries_) {
+        if (!entry.used && entry.is_mapped && name.size() <= max_name_size
+            && total_size + entry.mapped.size() <= max_size_)
+        {
+            names.push_back(&name);
+            total_size += entry.mapped.size();
+        }
+    }
+
+    std::unique_ptr<FILE, decltype(&fclose)> fp{nullptr, &fclose};
+
+#ifdef _WIN32
+    fp.reset(_wfopen(path, L"wb"));
+#else
+    fp.reset(fopen(path, "wb"));
+#endif
+
+    if (!fp) {
+        out_error = {.description = "fopen failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    static const u8 zeros[page_size] = {};
+    std::vector<u8> table;
+    u64 offset = page_size;
+
+    if (fseek(fp.get(), long(offset), SEEK_SET) != 0) {
+        out_error = {.description = "fseek failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    for (const std::string* name : names) {
+        const Entry& entry = entries_.find(*name)->second;
+        std::span<const u8> data = entry.buffer ? entry.buffer->bytes() : entry.mapped;
+        u32 crc = entry.buffer ? crc32::update(0, data) : entry.crc;
+        u64 padding = align_to_page(offset + data.size()) - offset - data.size();
+        size_t name_size = name->size();
+        size_t pos = table.size();
+
+        if (!write_bytes(fp.get(), data.data(), data.size(), out_error)
+            || !write_bytes(fp.get(), zeros, size_t(padding), out_error))
+        {
+            return false;
+        }
+
+        table.resize(pos + table_record_size + name_size);
+        endian::store_le64(&table[pos], offset);
+        endian::store_le64(&table[pos + 8], data.size());
+        endian::store_le32(&table[pos + 16], crc);
+        endian::store_le16(&table[pos + 20], u16(name_size));
+        std::memcpy(&table[pos + table_record_size], name->data(), name_size);
+        offset += data.size() + padding;
+    }
+
+    if (!write_bytes(fp.get(), table.data(), table.size(), out_error))
+        return false;
+
+    u8 header[header_size];
+
+    endian::store_le32(&header[0], cache_magic);
+    endian::store_le32(&header[4], cache_version);
+    endian::store_le64(&header[8], identity_.size);
+    endian::store_le64(&header[16], u64(identity_.mtime));
+    endian::store_le32(&header[24], identity_.directory_crc);
+    endian::store_le32(&header[28], u32(names.size()));
+    endian::store_le64(&header[32], offset);
+    endian::store_le64(&header[40], table.size());
+
+    // The header is written last so that a truncated file is never mistaken for a valid cache.
+    if (fseek(fp.get(), 0, SEEK_SET) != 0) {
+        out_error = {.description = "fseek failed", .code = {errno, std::generic_category()}};
+        return false;
+    } else if (!write_bytes(fp.get(), header, header_size, out_error)) {
+        return false;
+    } else if (fclose(fp.release()) != 0) {
+        out_error = {.description = "fclose failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    return true;
+}
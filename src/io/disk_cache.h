@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_DISK_CACHE_H_INCLUDED
+#define IO_DISK_CACHE_H_INCLUDED
+
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include <system/mapping.h>
+
+#include "asset_cache.h"
+
+namespace geo {
+
+    /// Identifies the contents of a PAK file so that a @ref DiskCache can detect when the PAK has
+    /// changed.
+    struct PakIdentity {
+        u64 size = 0;
+        i64 mtime = 0;
+        u32 directory_crc = 0;
+
+        bool operator==(const PakIdentity&) const = default;
+    };
+
+    /// Stream provider that keeps decompressed copies of streams from another provider in a cache
+    /// file, so that later runs can map them instead of decompressing them again. Streams that are
+    /// read during a run are written to a new cache file when the cache is saved, up to the size
+    /// limit, so the cache holds the streams that were most recently used. Each stream's data is
+    /// aligned to a page boundary in the file. The cache is discarded if the PAK's identity
+    /// changes. Each stream's CRC-32 is checked the first time it's used, and corrupt streams are
+    /// read from the source instead.
+    class DiskCache : public StreamProvider {
+    public:
+        DiskCache(const DiskCache&) = delete;
+        explicit DiskCache(StreamProvider& source, const oschar_t* path, const PakIdentity& identity,
+                           size_t max_size);
+        ~DiskCache();
+
+        /// Writes the streams used in this run to the cache file. This is called automatically
+        /// when the cache is destroyed. The cache can't be used afterward. Streams and buffers
+        /// that were returned earlier keep the old file mapped until they're destroyed.
+        bool save(Error& out_error);
+
+        bool get_stream_names(std::vector<std::string>& out_names, Error& out_error) override;
+        i64 get_stream_size(const char* name, Error& out_error) override;
+        u64 get_stream_content_id(const char* name) override;
+        bool is_stream_cacheable(const char* name) override;
+        std::unique_ptr<Stream> open_stream(const char* name, Error& out_error) override;
+
+        /// Prefetches cached streams from the cache file, and forwards the others to the source.
+        void prefetch(std::span<const std::string> names) override;
+
+        /// Returns a view of the cache file's mapping if the stream is cached. The view keeps the
+        /// mapping alive.
+        ByteBuffer read_stream_buffer(const char* name, size_t max_size, Error& out_error) override;
+
+        /// Returns views of cached streams, and forwards the others to the source. Declines batches
+        /// with cached streams that haven't been checked against their CRC-32 yet, since checking
+        /// one reads all of it.
+        bool read_streams_async(std::span<const std::string> names, size_t max_size,
+                                ReadStreamsCallback callback) override;
+
+        /// Gets the identity of the PAK file at `path`.
+        static bool get_pak_identity(const oschar_t* path, PakIdentity& out_identity, Error& out_error);
+
+    private:
+        struct StringHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+        };
+
+        struct Entry {
+            std::span<const u8> mapped{}; // Data in the existing cache file
+            SharedBuffer buffer{}; // Data read from the source during this run
+            u32 crc = 0; // CRC-32 of the mapped data
+            bool is_mapped = false;
+            bool verified = false; // Whether the mapped data matched its CRC-32
+            bool used = false;
+        };
+
+        StreamProvider& source_;
+        OsString path_;
+        PakIdentity identity_;
+        size_t max_size_;
+        std::shared_ptr<const FileMapping> mapping_;
+        std::unordered_map<std::string, Entry, StringHash, std::equal_to<>> entries_;
+        std::vector<std::string> used_names_; // In order of first use
+        size_t used_size_ = 0;
+        bool modified_ = false;
+        bool saved_ = false;
+        std::mutex mutex_;
+
+        // Loads the existing cache file, if it is valid.
+        bool load(Error& out_error);
+
+        // Looks up a stream in the existing cache file and marks it as used. Returns false if the
+        // stream isn't in the cache file or is corrupt. The buffer keeps the mapping alive.
+        bool find_mapped(std::string_view name, ByteBuffer& out_data);
+
+        // Records a stream read from the source so that it's written to the cache file, unless the
+        // source reports it as not cacheable.
+        ByteBuffer insert(const char* name, ByteBuffer&& data);
+
+        // Writes the cache file to `path`.
+        bool write(const oschar_t* path, Error& out_error);
+    };
+
+} // namespace geo
+
+#endif // IO_DISK_CACHE_H_INCLUDED
@@ -26,9 +26,12 @@ namespace {
                 case IoErrorCode::not_readable:
                 case IoErrorCode::not_writable:
                 case IoErrorCode::not_seekable:
+                case IoErrorCode::entry_compressed:
                     return cond == std::errc::not_supported;
                 case IoErrorCode::stream_too_long:
                     return cond == std::errc::file_too_large;
+                case IoErrorCode::checksum_mismatch:
+                    return cond == std::errc::io_error;
                 default:
                     return false;
             }
@@ -47,6 +50,9 @@ namespace {
                 case IoErrorCode::end_of_stream: return "Unexpected end of stream";
                 case IoErrorCode::stream_size_undefined: return "Stream size is not defined";
                 case IoErrorCode::stream_too_long: return "Stream exceeds maximum size";
+                case IoErrorCode::invalid_archive: return "Invalid or corrupt archive";
+                case IoErrorCode::entry_compressed: return "Archive entry is compressed";
+                case IoErrorCode::checksum_mismatch: return "Checksum mismatch";
                 default: return fmt::format("I/O error code {}", value);
             }
         }
@@ -25,6 +25,9 @@ namespace geo {
         end_of_stream,
         stream_size_undefined,
         stream_too_long,
+        invalid_archive,
+        entry_compressed,
+        checksum_mismatch,
     };
 
     /// Error category corresponding to @ref IoErrorCode values.
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <mutex>
+
+#include "layered_provider.h"
+
+using namespace geo;
+
+std::shared_ptr<StreamProvider> LayeredProvider::find(std::string_view name, Error& out_error,
+                                                      LayerId* out_layer) const
+{
+    std::shared_lock lock{mutex_};
+    auto it = index_.find(name);
+
+    if (it == index_.end()) {
+        out_error = {.code = IoErrorCode::not_found};
+        return {};
+    }
+
+    if (out_layer)
+        *out_layer = it->second.back();
+
+    return layers_.find(it->second.back())->second.provider;
+}
+
+size_t LayeredProvider::get_num_layers() const
+{
+    std::shared_lock lock{mutex_};
+    return layers_.size();
+}
+
+bool LayeredProvider::get_stream_names(std::vector<std::string>& out_names, Error&)
+{
+    std::shared_lock lock{mutex_};
+
+    for (const auto& [name, layers] : index_)
+        out_names.push_back(name);
+
+    return true;
+}
+
+i64 LayeredProvider::get_stream_size(const char* name, Error& out_error)
+{
+    auto provider = find(name, out_error);
+
+    if (!provider)
+        return -1;
+
+    return provider->get_stream_size(name, out_error);
+}
+
+u64 LayeredProvider::get_stream_content_id(const char* name)
+{
+    LayerId layer;
+    Error error;
+    auto provider = find(name, error, &layer);
+    u64 id = provider ? provider->get_stream_content_id(name) : 0;
+
+    // Qualify the ID with the layer, since each layer's IDs are independent.
+    if (!id || id >> 48 || layer >> 16)
+        return 0;
+
+    return u64(layer) << 48 | id;
+}
+
+bool LayeredProvider::is_stream_cacheable(const char* name)
+{
+    Error error;
+    auto provider = find(name, error);
+    return !provider || provider->is_stream_cacheable(name);
+}
+
+void LayeredProvider::index_layer(LayerId id, const std::vector<std::string>& names)
+{
+    for (const std::string& name : names) {
+        std::vector<LayerId>& layers = index_[name];
+        auto it = std::lower_bound(layers.begin(), layers.end(), id);
+
+        // Layers are usually mounted in order, so this normally appends. Names that a provider
+        // lists more than once are only indexed once.
+        if (it == layers.end() || *it != id)
+            layers.insert(it, id);
+    }
+}
+
+bool LayeredProvider::mount(std::shared_ptr<StreamProvider> provider, LayerId& out_id, Error& out_error)
+{
+    // Enumerate the streams before locking, since it may be slow.
+    std::vector<std::string> names;
+
+    if (!provider->get_stream_names(names, out_error))
+        return false;
+
+    std::lock_guard lock{mutex_};
+    LayerId id = next_id_++;
+
+    index_layer(id, names);
+    layers_.emplace(id, Layer{std::move(provider), std::move(names)});
+    out_id = id;
+    return true;
+}
+
+std::unique_ptr<Stream> LayeredProvider::open_stream(const char* name, Error& out_error)
+{
+    auto provider = find(name, out_error);
+
+    if (!provider)
+        return {};
+
+    return provider->open_stream(name, out_error);
+}
+
+void LayeredProvider::prefetch(std::span<const std::string> names)
+{
+    // Group the streams by provider, so each layer gets one batch.
+    std::vector<std::pair<std::shared_ptr<StreamProvider>, std::vector<std::string>>> groups;
+
+    for (const std::string& name : names) {
+        Error error;
+        auto provider = find(name, error);
+
+        if (!provider)
+            continue;
+
+        auto it = std::find_if(groups.begin(), groups.end(), [&](const auto& group) { return group.first == provider; });
+
+        if (it == groups.end())
+            it = groups.insert(groups.end(), {std::move(provider), {}});
+
+        it->second.push_back(name);
+    }
+
+    for (auto& [provider, provider_names] : groups)
+        provider->prefetch(provider_names);
+}
+
+ByteBuffer LayeredProvider::read_stream_buffer(const char* name, size_t max_size, Error& out_error)
+{
+    auto provider = find(name, out_error);
+
+    if (!provider)
+        return {};
+
+    return provider->read_stream_buffer(name, max_size, out_error);
+}
+
+bool LayeredProvider::read_streams_async(std::span<const std::string> names, size_t max_size,
+                                         ReadStreamsCallback callback)
+{
+    // Group the streams by provider.
+    struct Group {
+        std::shared_ptr<StreamProvider> provider{};
+        std::vector<std::string> names{};
+        std::vector<size_t> indices{};
+    };
+
+    std::vector<Group> groups;
+    std::vector<size_t> missing_indices;
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        Error error;
+        auto provider = find(names[i], error);
+
+        if (!provider) {
+            missing_indices.push_back(i);
+            continue;
+        }
+
+        auto it = std::find_if(groups.begin(), groups.end(), [&](const Group& group) { return group.provider == provider; });
+
+        if (it == groups.end())
+            it = groups.insert(groups.end(), Group{std::move(provider)});
+
+        it->names.push_back(names[i]);
+        it->indices.push_back(i);
+    }
+
+    // Results are held back until every layer has accepted its streams, since the callback must
+    // not be called if any layer declines. In that case, the reads already started are discarded,
+    // and the caller reads the streams on its own threads instead.
+    struct HeldResult {
+        size_t index;
+        ByteBuffer data;
+        Error error;
+    };
+
+    struct Gate {
+        std::mutex mutex;
+        bool open = false;
+        bool declined = false;
+        std::vector<HeldResult> held;
+    };
+
+    auto shared_callback = std::make_shared<ReadStreamsCallback>(std::move(callback));
+    auto gate = std::make_shared<Gate>();
+
+    for (Group& group : groups) {
+        bool async = group.provider->read_streams_async(group.names, max_size,
+            [shared_callback, gate, indices = group.indices](size_t index, ByteBuffer&& data, Error& error) {
+                {
+                    std::lock_guard lock{gate->mutex};
+
+                    if (gate->declined)
+                        return;
+
+                    if (!gate->open) {
+                        gate->held.push_back({indices[index], std::move(data), std::move(error)});
+                        return;
+                    }
+                }
+
+                (*shared_callback)(indices[index], std::move(data), error);
+            });
+
+        if (!async) {
+            std::lock_guard lock{gate->mutex};
+            gate->declined = true;
+            gate->held.clear();
+            return false;
+        }
+    }
+
+    std::vector<HeldResult> held;
+
+    {
+        std::lock_guard lock{gate->mutex};
+        gate->open = true;
+        held = std::move(gate->held);
+    }
+
+    for (HeldResult& result : held)
+        (*shared_callback)(result.index, std::move(result.data), result.error);
+
+    for (size_t index : missing_indices) {
+        Error error = {.code = IoErrorCode::not_found};
+        (*shared_callback)(index, {}, error);
+    }
+
+    return true;
+}
+
+bool LayeredProvider::remount(LayerId id, std::shared_ptr<StreamProvider> provider, Error& out_error)
+{
+    std::vector<std::string> names;
+
+    if (!provider->get_stream_names(names, out_error))
+        return false;
+
+    std::lock_guard lock{mutex_};
+    auto it = layers_.find(id);
+
+    if (it == layers_.end()) {
+        out_error = {.code = IoErrorCode::not_found};
+        return false;
+    }
+
+    unindex_layer(id, it->second.names);
+    index_layer(id, names);
+    it->second = {std::move(provider), std::move(names)};
+    return true;
+}
+
+bool LayeredProvider::remount(LayerId id, Error& out_error)
+{
+    std::shared_ptr<StreamProvider> provider;
+
+    {
+        std::shared_lock lock{mutex_};
+        auto it = layers_.find(id);
+
+        if (it == layers_.end()) {
+            out_error = {.code = IoErrorCode::not_found};
+            return false;
+        }
+
+        provider = it->second.provider;
+    }
+
+    return remount(id, std::move(provider), out_error);
+}
+
+void LayeredProvider::unindex_layer(LayerId id, const std::vector<std::string>& names)
+{
+    for (const std::string& name : names) {
+        auto it = index_.find(name);
+
+        if (it == index_.end())
+            continue;
+
+        std::vector<LayerId>& layers = it->second;
+        auto layer_it = std::lower_bound(layers.begin(), layers.end(), id);
+
+        if (layer_it != layers.end() && *layer_it == id)
+            layers.erase(layer_it);
+
+        if (layers.empty())
+            index_.erase(it);
+    }
+}
+
+bool LayeredProvider::unmount(LayerId id)
+{
+    std::lock_guard lock{mutex_};
+    auto it = layers_.find(id);
+
+    if (it == layers_.end())
+        return false;
+
+    unindex_layer(id, it->second.names);
+    layers_.erase(it);
+    return true;
+}
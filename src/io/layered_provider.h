@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_LAYERED_PROVIDER_H_INCLUDED
+#define IO_LAYERED_PROVIDER_H_INCLUDED
+
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include "stream.h"
+
+namespace geo {
+
+    /// Identifies a layer mounted in a @ref LayeredProvider.
+    using LayerId = u32;
+
+    /// Stream provider that stacks other providers, e.g., the base PAK, patch and DLC PAKs, and
+    /// loose development overrides. Streams in later layers hide streams with the same name in
+    /// earlier layers. The names of every layer's streams are merged into one hash index when the
+    /// layer is mounted, so lookups take constant time regardless of the number of layers.
+    /// Remounting a layer only updates the index entries of that layer. The provider may be used
+    /// from multiple threads, including while layers are mounted.
+    class LayeredProvider : public StreamProvider {
+    public:
+        LayeredProvider() = default;
+        LayeredProvider(const LayeredProvider&) = delete;
+
+        /// Mounts a provider on top of the existing layers. The provider must be able to enumerate
+        /// its streams with @ref StreamProvider::get_stream_names.
+        bool mount(std::shared_ptr<StreamProvider> provider, LayerId& out_id, Error& out_error);
+
+        /// Replaces a layer's provider, keeping its position in the stack.
+        bool remount(LayerId id, std::shared_ptr<StreamProvider> provider, Error& out_error);
+
+        /// Enumerates a layer's streams again, e.g., after files were added to a directory.
+        bool remount(LayerId id, Error& out_error);
+
+        /// Removes a layer. Streams that were opened from it remain valid.
+        bool unmount(LayerId id);
+
+        size_t get_num_layers() const;
+
+        bool get_stream_names(std::vector<std::string>& out_names, Error& out_error) override;
+        i64 get_stream_size(const char* name, Error& out_error) override;
+        u64 get_stream_content_id(const char* name) override;
+        bool is_stream_cacheable(const char* name) override;
+        std::unique_ptr<Stream> open_stream(const char* name, Error& out_error) override;
+
+        /// Forwards the names to the layers that provide them.
+        void prefetch(std::span<const std::string> names) override;
+
+        ByteBuffer read_stream_buffer(const char* name, size_t max_size, Error& out_error) override;
+
+        /// Forwards the streams to their layers' asynchronous reads. Returns false if any of the
+        /// layers doesn't support them, in which case the reads already started are discarded.
+        bool read_streams_async(std::span<const std::string> names, size_t max_size,
+                                ReadStreamsCallback callback) override;
+
+    private:
+        struct StringHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+        };
+
+        struct Layer {
+            std::shared_ptr<StreamProvider> provider;
+            std::vector<std::string> names;
+        };
+
+        // IDs are assigned in mount order, so a higher ID is a higher layer.
+        std::unordered_map<LayerId, Layer> layers_;
+
+        // Maps each stream name to the layers that contain it, in ascending order. The last layer
+        // is the one that provides the stream.
+        std::unordered_map<std::string, std::vector<LayerId>, StringHash, std::equal_to<>> index_;
+
+        LayerId next_id_ = 1;
+        mutable std::shared_mutex mutex_;
+
+        // Gets the provider of a stream. Sets `out_error` to @ref IoErrorCode::not_found if no
+        // layer has the stream.
+        std::shared_ptr<StreamProvider> find(std::string_view name, Error& out_error,
+                                             LayerId* out_layer = nullptr) const;
+
+        // Adds or removes a layer's names from the index. Requires an exclusive lock on `mutex_`.
+        void index_layer(LayerId id, const std::vector<std::string>& names);
+        void unindex_layer(LayerId id, const std::vector<std::string>& names);
+    };
+
+} // namespace geo
+
+#endif // IO_LAYERED_PROVIDER_H_INCLUDED
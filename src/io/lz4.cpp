@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <lz4frame.h>
+
+#include <system/debug.h>
+
+#include "lz4.h"
+
+using namespace geo;
+
+//==================================================================================================
+// lz4_error_category
+//==================================================================================================
+
+namespace {
+
+    // LZ4F functions return errors as negated error codes, which are stored as positive values.
+    class Lz4ErrorCategory : public std::error_category {
+        std::string message(int value) const override
+        {
+            return LZ4F_getErrorName(LZ4F_errorCode_t(0) - LZ4F_errorCode_t(value));
+        }
+
+        const char* name() const noexcept override { return "lz4"; }
+    } constinit const lz4_error_category_instance;
+
+    Error make_lz4_error(ErrorDescription description, size_t result)
+    {
+        return {.description = std::move(description), .code = {int(0 - result), lz4_error_category_instance}};
+    }
+
+} // namespace
+
+constinit const std::error_category& geo::lz4_error_category = lz4_error_category_instance;
+
+//==================================================================================================
+// Lz4Decoder
+//==================================================================================================
+
+Lz4Decoder::Lz4Decoder()
+{
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx_, LZ4F_VERSION)))
+        FATAL("LZ4F_createDecompressionContext failed");
+}
+
+Lz4Decoder::~Lz4Decoder()
+{
+    LZ4F_freeDecompressionContext(dctx_);
+}
+
+bool Lz4Decoder::decode(std::span<const u8>& in, std::span<u8>& out, bool& out_frame_end, Error& out_error)
+{
+    size_t in_size = in.size();
+    size_t out_size = out.size();
+    size_t result = LZ4F_decompress(dctx_, out.data(), &out_size, in.data(), &in_size, nullptr);
+
+    if (LZ4F_isError(result)) {
+        out_error = make_lz4_error("LZ4F_decompress failed", result);
+        return false;
+    }
+
+    in = in.subspan(in_size);
+    out = out.subspan(out_size);
+    out_frame_end = result == 0;
+    return true;
+}
+
+void Lz4Decoder::reset()
+{
+    LZ4F_resetDecompressionContext(dctx_);
+}
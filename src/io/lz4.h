@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_LZ4_H_INCLUDED
+#define IO_LZ4_H_INCLUDED
+
+#include "decoder.h"
+
+struct LZ4F_dctx_s;
+
+namespace geo {
+
+    /// Streaming decoder for LZ4 frames. LZ4 compresses worse than Zstandard, but decodes several
+    /// times faster, so it suits assets whose load time is dominated by decoding.
+    class Lz4Decoder : public Decoder {
+    public:
+        Lz4Decoder();
+        Lz4Decoder(const Lz4Decoder&) = delete;
+        ~Lz4Decoder();
+
+        bool decode(std::span<const u8>& in, std::span<u8>& out, bool& out_frame_end, Error& out_error) override;
+        void reset() override;
+
+    private:
+        struct ::LZ4F_dctx_s* dctx_ = nullptr;
+    };
+
+    /// Error category corresponding to LZ4 frame error codes.
+    extern constinit const std::error_category& lz4_error_category;
+
+} // namespace geo
+
+#endif // IO_LZ4_H_INCLUDED
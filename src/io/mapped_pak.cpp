@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <limits>
+
+#include "mapped_pak.h"
+
+using namespace geo;
+
+MappedPak::MappedPak(const oschar_t* path, Error& out_error)
+{
+    open(path, out_error);
+}
+
+MappedPak::~MappedPak()
+{
+    close();
+}
+
+void MappedPak::close()
+{
+    // The mapping is unmapped once the archive's streams and buffers release it as well.
+    archive_.close();
+    directory_.clear();
+    mapping_.reset();
+}
+
+bool MappedPak::open(const oschar_t* path, Error& out_error)
+{
+    close();
+
+    auto mapping = std::make_shared<FileMapping>();
+
+    if (!mapping->open(path, out_error))
+        return false;
+
+    mapping_ = std::move(mapping);
+
+    // Index the entries so stored data can be located within the mapping.
+    if (!directory_.parse(mapping_->bytes(), out_error)) {
+        close();
+        return false;
+    }
+
+    // Compressed entries are decoded by libzip, whose handles keep the mapping alive. The path lets
+    // the archive read compressed entries asynchronously.
+    if (!archive_.open(mapping_->bytes(), mapping_, path, out_error)) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+std::span<const u8> MappedPak::get_stored_bytes(const char* name, Error& out_error) const
+{
+    if (!is_open()) {
+        out_error = {.code = IoErrorCode::archive_closed};
+        return {};
+    }
+
+    const ZipDirectoryEntry* entry = directory_.find(name);
+
+    if (!entry) {
+        out_error = {.code = IoErrorCode::not_found};
+        return {};
+    } else if (entry->method != zip_method::store) {
+        out_error = {.code = IoErrorCode::entry_compressed};
+        return {};
+    }
+
+    return ZipDirectory::get_data(mapping_->bytes(), *entry, out_error);
+}
+
+bool MappedPak::get_stream_names(std::vector<std::string>& out_names, Error& out_error)
+{
+    if (!is_open()) {
+        out_error = {.code = IoErrorCode::archive_closed};
+        return false;
+    }
+
+    for (const ZipDirectoryEntry& entry : directory_.entries()) {
+        if (ZipDirectory::is_stream_name(entry.name))
+            out_names.push_back(entry.name);
+    }
+
+    return true;
+}
+
+i64 MappedPak::get_stream_size(const char* name, Error& out_error)
+{
+    if (!is_open()) {
+        out_error = {.code = IoErrorCode::archive_closed};
+        return -1;
+    }
+
+    const ZipDirectoryEntry* entry = directory_.find(name);
+
+    if (!entry) {
+        out_error = {.code = IoErrorCode::not_found};
+        return -1;
+    } else if (entry->size > u64(std::numeric_limits<i64>::max())) {
+        out_error = {.code = IoErrorCode::stream_size_undefined};
+        return -1;
+    }
+
+    return i64(entry->size);
+}
+
+u64 MappedPak::get_stream_content_id(const char* name)
+{
+    const ZipDirectoryEntry* entry = is_open() ? directory_.find(name) : nullptr;
+
+    // Names of a deduplicated entry share its local header.
+    return entry ? entry->header_offset + 1 : 0;
+}
+
+std::unique_ptr<Stream> MappedPak::open_stream(const char* name, Error& out_error)
+{
+    Error local_error;
+    std::span<const u8> data = get_stored_bytes(name, local_error);
+
+    if (local_error.matches(IoErrorCode::entry_compressed)) {
+        return archive_.open_stream(name, out_error);
+    } else if (local_error) {
+        out_error = std::move(local_error);
+        return {};
+    }
+
+    return std::make_unique<ByteBufferStream>(ByteBuffer::share(data, mapping_));
+}
+
+void MappedPak::prefetch(std::span<const std::string> names)
+{
+    if (!is_open())
+        return;
+
+    for (const std::string& name : names) {
+        if (const ZipDirectoryEntry* entry = directory_.find(name))
+            mapping_->prefetch(ZipDirectory::get_raw_range(mapping_->bytes(), *entry));
+    }
+}
+
+ByteBuffer MappedPak::read_stream_buffer(const char* name, size_t max_size, Error& out_error)
+{
+    Error local_error;
+    std::span<const u8> data = get_stored_bytes(name, local_error);
+
+    if (local_error.matches(IoErrorCode::entry_compressed)) {
+        return StreamProvider::read_stream_buffer(name, max_size, out_error);
+    } else if (local_error) {
+        out_error = std::move(local_error);
+        return {};
+    } else if (data.size() > max_size) {
+        out_error = {.code = IoErrorCode::stream_too_long};
+        return {};
+    }
+
+    return ByteBuffer::share(data, mapping_);
+}
+
+bool MappedPak::read_streams_async(std::span<const std::string> names, size_t max_size,
+                                   ReadStreamsCallback callback)
+{
+    if (!is_open())
+        return false;
+
+    std::vector<bool> is_compressed(names.size());
+    std::vector<std::string> compressed_names;
+    std::vector<size_t> compressed_indices;
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        const ZipDirectoryEntry* entry = directory_.find(names[i]);
+        is_compressed[i] = entry && entry->method != zip_method::store;
+
+        if (is_compressed[i]) {
+            compressed_names.push_back(names[i]);
+            compressed_indices.push_back(i);
+        }
+    }
+
+    auto shared_callback = std::make_shared<ReadStreamsCallback>(std::move(callback));
+
+    // Decode the compressed entries on the archive's worker threads first, since the callback must
+    // not be called if the archive doesn't support asynchronous reads.
+    if (!compressed_names.empty()) {
+        bool async = archive_.read_streams_async(compressed_names, max_size,
+            [shared_callback, compressed_indices](size_t index, ByteBuffer&& data, Error& error) {
+                (*shared_callback)(compressed_indices[index], std::move(data), error);
+            });
+
+        if (!async)
+            return false;
+    }
+
+    // Stored entries are views into the mapping, so they're cheap to return immediately.
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (is_compressed[i])
+            continue;
+
+        Error error;
+        ByteBuffer data = read_stream_buffer(names[i].c_str(), max_size, error);
+        (*shared_callback)(i, std::move(data), error);
+    }
+
+    return true;
+}
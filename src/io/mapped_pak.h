@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_MAPPED_PAK_H_INCLUDED
+#define IO_MAPPED_PAK_H_INCLUDED
+
+#include <system/mapping.h>
+
+#include "zip.h"
+#include "zip_directory.h"
+
+namespace geo {
+
+    /// Reads entries from a memory-mapped ZIP archive. Stored (uncompressed) entries are read
+    /// directly from the mapping without copying. Compressed entries are decoded by libzip, which
+    /// also reads from the mapping rather than through stdio. Streams and buffers read from the PAK
+    /// hold a reference to the mapping, so they remain valid after the PAK is closed.
+    class MappedPak : public StreamProvider {
+    public:
+        MappedPak() = default;
+        MappedPak(const MappedPak&) = delete;
+        explicit MappedPak(const oschar_t* path, Error& out_error);
+        ~MappedPak();
+
+        void close();
+        bool is_open() const { return mapping_ != nullptr; }
+        bool open(const oschar_t* path, Error& out_error);
+
+        /// Gets the archive that decodes compressed entries from the mapping.
+        ZipArchive& get_archive() { return archive_; }
+
+        /// Gets a stored entry's contents from the mapping. Unlike the results of
+        /// @ref read_stream_buffer, the span is only valid until the PAK is closed. Sets
+        /// `out_error` to @ref IoErrorCode::entry_compressed if the entry is compressed, in which
+        /// case @ref open_stream must be used instead.
+        std::span<const u8> get_stored_bytes(const char* name, Error& out_error) const;
+
+        bool get_stream_names(std::vector<std::string>& out_names, Error& out_error) override;
+        i64 get_stream_size(const char* name, Error& out_error) override;
+        u64 get_stream_content_id(const char* name) override;
+        std::unique_ptr<Stream> open_stream(const char* name, Error& out_error) override;
+
+        /// Asks the OS to read the entries' pages of the mapping ahead.
+        void prefetch(std::span<const std::string> names) override;
+
+        /// Returns a view into the mapping for stored entries. Compressed entries are decoded into
+        /// an owned buffer.
+        ByteBuffer read_stream_buffer(const char* name, size_t max_size, Error& out_error) override;
+
+        /// Returns views into the mapping for stored entries, and reads compressed entries through
+        /// the archive's asynchronous path, which reads the file with @ref AsyncFile and decodes
+        /// them on its worker threads.
+        bool read_streams_async(std::span<const std::string> names, size_t max_size,
+                                ReadStreamsCallback callback) override;
+
+    private:
+        std::shared_ptr<const FileMapping> mapping_;
+        ZipDirectory directory_;
+        ZipArchive archive_;
+    };
+
+} // namespace geo
+
+#endif // IO_MAPPED_PAK_H_INCLUDED
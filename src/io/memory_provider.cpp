@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "memory_provider.h"
+
+using namespace geo;
+
+void MemoryProvider::add(std::string_view name, ByteBuffer&& data)
+{
+    auto buffer = std::make_shared<const ByteBuffer>(std::move(data));
+    std::lock_guard lock{mutex_};
+    auto it = streams_.find(name);
+
+    if (it != streams_.end())
+        it->second = std::move(buffer);
+    else
+        streams_.emplace(name, std::move(buffer));
+}
+
+void MemoryProvider::clear()
+{
+    std::lock_guard lock{mutex_};
+    streams_.clear();
+}
+
+std::shared_ptr<const ByteBuffer> MemoryProvider::find(std::string_view name) const
+{
+    std::lock_guard lock{mutex_};
+    auto it = streams_.find(name);
+
+    if (it == streams_.end())
+        return {};
+
+    return it->second;
+}
+
+bool MemoryProvider::get_stream_names(std::vector<std::string>& out_names, Error&)
+{
+    std::lock_guard lock{mutex_};
+
+    for (const auto& [name, buffer] : streams_)
+        out_names.push_back(name);
+
+    return true;
+}
+
+i64 MemoryProvider::get_stream_size(const char* name, Error& out_error)
+{
+    auto buffer = find(name);
+
+    if (!buffer) {
+        out_error = {.code = IoErrorCode::not_found};
+        return -1;
+    }
+
+    return i64(buffer->size());
+}
+
+std::unique_ptr<Stream> MemoryProvider::open_stream(const char* name, Error& out_error)
+{
+    auto buffer = find(name);
+
+    if (!buffer) {
+        out_error = {.code = IoErrorCode::not_found};
+        return {};
+    }
+
+    return std::make_unique<ByteBufferStream>(share(std::move(buffer)));
+}
+
+ByteBuffer MemoryProvider::read_stream_buffer(const char* name, size_t max_size, Error& out_error)
+{
+    auto buffer = find(name);
+
+    if (!buffer) {
+        out_error = {.code = IoErrorCode::not_found};
+        return {};
+    } else if (buffer->size() > max_size) {
+        out_error = {.code = IoErrorCode::stream_too_long};
+        return {};
+    }
+
+    return share(std::move(buffer));
+}
+
+bool MemoryProvider::remove(std::string_view name)
+{
+    std::lock_guard lock{mutex_};
+    auto it = streams_.find(name);
+
+    if (it == streams_.end())
+        return false;
+
+    streams_.erase(it);
+    return true;
+}
+
+ByteBuffer MemoryProvider::share(std::shared_ptr<const ByteBuffer> buffer)
+{
+    std::span<const u8> bytes = buffer->bytes();
+
+    return ByteBuffer::adopt(bytes, [](void* context) { delete static_cast<std::shared_ptr<const ByteBuffer>*>(context); },
+                             new std::shared_ptr<const ByteBuffer>{std::move(buffer)});
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_MEMORY_PROVIDER_H_INCLUDED
+#define IO_MEMORY_PROVIDER_H_INCLUDED
+
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include "stream.h"
+
+namespace geo {
+
+    /// Stream provider whose streams are buffers held in memory, e.g., generated assets or
+    /// overrides set at runtime. Streams may be added and removed from any thread. Buffers that are
+    /// being read remain valid after they are removed.
+    class MemoryProvider : public StreamProvider {
+    public:
+        MemoryProvider() = default;
+        MemoryProvider(const MemoryProvider&) = delete;
+
+        /// Adds a stream, replacing any existing stream with the same name.
+        void add(std::string_view name, ByteBuffer&& data);
+        void add(std::string_view name, std::vector<u8>&& data) { add(name, ByteBuffer::adopt(std::move(data))); }
+
+        void clear();
+
+        /// Removes a stream. Returns false if there is no stream with the name.
+        bool remove(std::string_view name);
+
+        bool get_stream_names(std::vector<std::string>& out_names, Error& out_error) override;
+        i64 get_stream_size(const char* name, Error& out_error) override;
+        std::unique_ptr<Stream> open_stream(const char* name, Error& out_error) override;
+
+        /// Returns a reference to the stored buffer rather than a copy.
+        ByteBuffer read_stream_buffer(const char* name, size_t max_size, Error& out_error) override;
+
+    private:
+        struct StringHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+        };
+
+        std::unordered_map<std::string, std::shared_ptr<const ByteBuffer>, StringHash, std::equal_to<>> streams_;
+        mutable std::mutex mutex_;
+
+        // Gets a reference to a stream's buffer, or null if it doesn't exist.
+        std::shared_ptr<const ByteBuffer> find(std::string_view name) const;
+
+        // Wraps a shared buffer in a @ref ByteBuffer that keeps a reference to it.
+        static ByteBuffer share(std::shared_ptr<const ByteBuffer> buffer);
+    };
+
+} // namespace geo
+
+#endif // IO_MEMORY_PROVIDER_H_INCLUDED
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+#include <system/debug.h>
+#include <system/mapping.h>
+
+#include "crc32.h"
+#include "lz4.h"
+#include "pak_verify.h"
+#include "zip.h"
+#include "zstd.h"
+
+using namespace geo;
+
+namespace {
+
+    // Size of each thread's buffer for decoded data, which is checked a chunk at a time.
+    constexpr size_t decode_buffer_size = 1024 * 1024;
+
+    struct VerifyState {
+        std::span<const u8> archive{};
+        std::vector<const ZipDirectoryEntry*> entries{}; // Sorted by header offset
+        std::shared_ptr<const ZstdDictionary> dictionary{};
+        ZipArchive* libzip_archive = nullptr; // Opened if any entries are deflated
+        std::atomic<size_t> next_entry = 0;
+        std::atomic<size_t> num_failed = 0;
+        std::atomic<u64> raw_size = 0;
+        std::atomic<u64> decoded_size = 0;
+    };
+
+    // Decodes `in` a chunk at a time into `buffer` and checks the decoded data's size and CRC-32.
+    bool check_decoded(Decoder& decoder, std::span<const u8> in, std::span<u8> buffer,
+                       const ZipDirectoryEntry& entry, Error& out_error)
+    {
+        u64 size = 0;
+        u32 crc = 0;
+        bool frame_end = true;
+
+        decoder.reset();
+
+        while (!in.empty()) {
+            size_t in_size = in.size();
+            std::span<u8> out = buffer;
+
+            if (!decoder.decode(in, out, frame_end, out_error))
+                return false;
+
+            size_t out_size = buffer.size() - out.size();
+
+            if (in.size() == in_size && out_size == 0) {
+                out_error = {.description = "Decoder made no progress", .code = IoErrorCode::invalid_archive};
+                return false;
+            } else if (out_size > entry.size - size) {
+                out_error = {.code = IoErrorCode::stream_too_long};
+                return false;
+            }
+
+            crc = crc32::update(crc, buffer.first(out_size));
+            size += out_size;
+        }
+
+        if (!frame_end || size != entry.size) {
+            out_error = {.description = "Compressed data is truncated", .code = IoErrorCode::end_of_stream};
+            return false;
+        } else if (crc != entry.crc) {
+            out_error = {.code = IoErrorCode::checksum_mismatch};
+            return false;
+        }
+
+        return true;
+    }
+
+    // Checks an entry using a thread's decoders and buffer.
+    bool check_entry(VerifyState& state, const ZipDirectoryEntry& entry,
+                     std::unique_ptr<Decoder> (&decoders)[3], std::span<u8> buffer, Error& out_error)
+    {
+        if (entry.method == zip_method::deflate) {
+            if (entry.size > u64(std::numeric_limits<size_t>::max())) {
+                out_error = {.code = IoErrorCode::stream_too_long};
+                return false;
+            }
+
+            // libzip checks the CRC-32 when the entry is read to the end.
+            ByteBuffer data = state.libzip_archive->read_stream_buffer(entry.name.c_str(), size_t(entry.size), out_error);
+
+            if (out_error)
+                return false;
+            else if (crc32::update(0, data.bytes()) != entry.crc) {
+                out_error = {.code = IoErrorCode::checksum_mismatch};
+                return false;
+            }
+
+            state.raw_size.fetch_add(entry.compressed_size, std::memory_order_relaxed);
+            state.decoded_size.fetch_add(entry.size, std::memory_order_relaxed);
+            return true;
+        }
+
+        std::span<const u8> raw = ZipDirectory::get_data(state.archive, entry, out_error);
+
+        if (out_error)
+            return false;
+
+        if (entry.method == zip_method::store) {
+            if (raw.size() != entry.size) {
+                out_error = {.description = "Stored entry size mismatch", .code = IoErrorCode::invalid_archive};
+                return false;
+            } else if (crc32::update(0, raw) != entry.crc) {
+                out_error = {.code = IoErrorCode::checksum_mismatch};
+                return false;
+            }
+        } else {
+            std::unique_ptr<Decoder>* decoder;
+
+            switch (entry.method) {
+                case zip_method::zstd:
+                    decoder = &decoders[0];
+                    if (!*decoder)
+                        *decoder = std::make_unique<ZstdDecoder>();
+                    break;
+                case zip_method::zstd_dict:
+                    decoder = &decoders[1];
+                    if (!*decoder && state.dictionary)
+                        *decoder = std::make_unique<ZstdDecoder>(state.dictionary);
+                    break;
+                case zip_method::lz4:
+                    decoder = &decoders[2];
+                    if (!*decoder)
+                        *decoder = std::make_unique<Lz4Decoder>();
+                    break;
+                default:
+                    decoder = nullptr;
+                    break;
+            }
+
+            if (!decoder || !*decoder) {
+                out_error = {.description = fmt::format("Can't decode compression method {}", entry.method),
+                             .code = std::make_error_code(std::errc::not_supported)};
+                return false;
+            }
+
+            if (!check_decoded(**decoder, raw, buffer, entry, out_error))
+                return false;
+        }
+
+        state.raw_size.fetch_add(raw.size(), std::memory_order_relaxed);
+        state.decoded_size.fetch_add(entry.size, std::memory_order_relaxed);
+        return true;
+    }
+
+    void verify_thread(VerifyState& state)
+    {
+        std::unique_ptr<Decoder> decoders[3];
+        std::unique_ptr<u8[]> buffer{new u8[decode_buffer_size]};
+
+        for (;;) {
+            size_t index = state.next_entry.fetch_add(1, std::memory_order_relaxed);
+
+            if (index >= state.entries.size())
+                break;
+
+            const ZipDirectoryEntry& entry = *state.entries[index];
+            Error error;
+
+            if (!check_entry(state, entry, decoders, {buffer.get(), decode_buffer_size}, error)) {
+                LOG_ERROR("{}: {}", entry.name, error);
+                state.num_failed.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+} // namespace
+
+bool geo::verify_pak(const oschar_t* path, size_t num_threads, PakVerifyStats& out_stats, Error& out_error)
+{
+    auto start_time = std::chrono::steady_clock::now();
+    FileMapping mapping;
+    ZipDirectory directory;
+    VerifyState state;
+
+    if (!mapping.open(path, out_error) || !directory.parse(mapping.bytes(), out_error))
+        return false;
+
+    // Ask the OS to read the whole file ahead, since all of it will be read.
+    state.archive = mapping.bytes();
+    mapping.prefetch(state.archive);
+
+    // Entries are checked in file order so that the threads read the file roughly sequentially.
+    bool has_deflated_entries = false;
+
+    for (const ZipDirectoryEntry& entry : directory.entries()) {
+        state.entries.push_back(&entry);
+        has_deflated_entries |= entry.method == zip_method::deflate;
+    }
+
+    std::stable_sort(state.entries.begin(), state.entries.end(),
+                     [](const ZipDirectoryEntry* a, const ZipDirectoryEntry* b) {
+                         return a->header_offset < b->header_offset;
+                     });
+
+    // Entries that share a local header share their data, so only the first, which the header
+    // was written for, is decoded. Its aliases must describe the same data, or readers that trust
+    // the alias's central directory record would get the wrong size or fail the CRC check.
+    std::vector<const ZipDirectoryEntry*> owners;
+
+    for (const ZipDirectoryEntry* entry : state.entries) {
+        if (owners.empty() || owners.back()->header_offset != entry->header_offset) {
+            owners.push_back(entry);
+            continue;
+        }
+
+        const ZipDirectoryEntry& owner = *owners.back();
+
+        if (entry->method != owner.method || entry->crc != owner.crc
+            || entry->compressed_size != owner.compressed_size || entry->size != owner.size)
+        {
+            LOG_ERROR("{}: Alias doesn't match {}", entry->name, owner.name);
+            state.num_failed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    state.entries = std::move(owners);
+
+    // Load the dictionary. If it's missing or corrupt, the entries that use it fail, but the
+    // others are still checked.
+    if (const ZipDirectoryEntry* entry = directory.find(zstd_dictionary_name)) {
+        Error error;
+        std::span<const u8> data = ZipDirectory::get_data(state.archive, *entry, error);
+
+        if (!error && entry->method == zip_method::store && crc32::update(0, data) == entry->crc)
+            state.dictionary = ZstdDictionary::load(data, error);
+    }
+
+    ZipArchive libzip_archive;
+
+    if (has_deflated_entries) {
+        if (!libzip_archive.open(state.archive, out_error))
+            return false;
+
+        state.libzip_archive = &libzip_archive;
+    }
+
+    // Check the entries.
+    if (!num_threads)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    num_threads = std::max<size_t>(1, std::min(num_threads, state.entries.size()));
+    std::vector<std::thread> threads;
+
+    for (size_t i = 1; i < num_threads; ++i)
+        threads.emplace_back([&state] { verify_thread(state); });
+
+    verify_thread(state);
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    out_stats = {
+        .num_entries = state.entries.size(),
+        .num_failed = state.num_failed.load(std::memory_order_relaxed),
+        .raw_size = state.raw_size.load(std::memory_order_relaxed),
+        .decoded_size = state.decoded_size.load(std::memory_order_relaxed),
+        .num_threads = num_threads,
+        .elapsed_time = std::chrono::steady_clock::now() - start_time,
+    };
+
+    return true;
+}
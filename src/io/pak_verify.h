@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_PAK_VERIFY_H_INCLUDED
+#define IO_PAK_VERIFY_H_INCLUDED
+
+#include <chrono>
+
+#include "error.h"
+
+namespace geo {
+
+    /// Results of @ref verify_pak.
+    struct PakVerifyStats {
+        size_t num_entries = 0; ///< Entries whose data was checked
+        size_t num_failed = 0; ///< Entries that couldn't be decoded, whose CRC-32 didn't match, or
+                               ///< that don't match the entry whose data they share
+        u64 raw_size = 0; ///< Bytes of raw (possibly compressed) data read
+        u64 decoded_size = 0; ///< Bytes of decoded data checked
+        size_t num_threads = 0;
+        std::chrono::steady_clock::duration elapsed_time{};
+    };
+
+    /// Checks every entry of a PAK against the CRC-32 in its central directory record. The PAK is
+    /// memory-mapped, and its entries are decoded and checked in parallel on `num_threads` threads,
+    /// or one per hardware thread if zero. Entries that share their data with another entry are
+    /// decoded once, and the others' method, CRC-32 and sizes must match it. Deflated entries are
+    /// decoded by libzip, and all others by our own decoders.
+    ///
+    /// Entries that fail are logged as errors and counted in `out_stats`. Returns false only if
+    /// the PAK itself can't be read.
+    bool verify_pak(const oschar_t* path, size_t num_threads, PakVerifyStats& out_stats, Error& out_error);
+
+} // namespace geo
+
+#endif // IO_PAK_VERIFY_H_INCLUDED
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <math/math.h>
+#include <system/debug.h>
+
+#include "preloader.h"
+
+using namespace geo;
+
+//==================================================================================================
+// PreloadBatch
+//==================================================================================================
+
+PreloadBatch::PreloadBatch(std::vector<std::string> names, size_t max_size, PreloadCallback&& callback)
+    : results_(names.size())
+    , callback_{std::move(callback)}
+    , max_size_{max_size}
+    , remaining_{names.size()}
+    , start_time_{std::chrono::steady_clock::now()}
+{
+    for (size_t i = 0; i < names.size(); ++i)
+        results_[i].name = std::move(names[i]);
+
+    if (names.empty()) {
+        end_time_ = start_time_;
+        done_ = true;
+    }
+}
+
+void PreloadBatch::complete(size_t index, ByteBuffer&& data, Error& error)
+{
+    PreloadResult& result = results_[index];
+
+    result.data = std::move(data);
+    result.error = std::move(error);
+
+    if (callback_)
+        callback_(result);
+
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    // Summarize the batch before waking waiters, which may consume the results as soon as they
+    // see that it's done.
+    u64 total_size = 0;
+
+    for (const PreloadResult& batch_result : results_)
+        total_size += batch_result.data.size();
+
+    size_t num_streams = results_.size();
+    f64 elapsed;
+
+    {
+        // Hold the lock so that a thread in wait() can't miss the notification.
+        std::lock_guard lock{mutex_};
+        end_time_ = std::chrono::steady_clock::now();
+        elapsed = std::chrono::duration<f64>(end_time_ - start_time_).count();
+        done_.store(true, std::memory_order_release);
+        done_cond_.notify_all();
+    }
+
+    LOG_DEBUG("Preloaded {} streams ({} bytes) in {:.3f} ms ({:.1f} MiB/s)",
+              num_streams, total_size, elapsed * 1000.0,
+              elapsed > 0.0 ? f64(total_size) / (1024.0 * 1024.0) / elapsed : 0.0);
+}
+
+u64 PreloadBatch::get_total_size() const
+{
+    ASSERT(is_done());
+
+    u64 total = 0;
+
+    for (const PreloadResult& result : results_)
+        total += result.data.size();
+
+    return total;
+}
+
+std::span<PreloadResult> PreloadBatch::results()
+{
+    ASSERT(is_done());
+    return results_;
+}
+
+void PreloadBatch::wait()
+{
+    std::unique_lock lock{mutex_};
+    done_cond_.wait(lock, [this] { return is_done(); });
+}
+
+//==================================================================================================
+// Preloader
+//==================================================================================================
+
+Preloader::Preloader(StreamProvider& provider, size_t max_threads)
+    : provider_{provider}
+    , max_threads_{max_threads}
+{
+    if (!max_threads_)
+        max_threads_ = math::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+}
+
+Preloader::~Preloader()
+{
+    // Workers finish the remaining tasks before exiting so that no batch is left incomplete.
+    {
+        std::lock_guard lock{mutex_};
+        stopping_ = true;
+    }
+
+    task_available_.notify_all();
+
+    for (std::thread& thread : threads_)
+        thread.join();
+}
+
+std::shared_ptr<PreloadBatch> Preloader::load(std::vector<std::string> names, size_t max_size,
+                                              PreloadCallback callback)
+{
+    std::shared_ptr<PreloadBatch> batch{new PreloadBatch{names, max_size, std::move(callback)}};
+    size_t num_tasks = batch->results_.size();
+
+    if (!num_tasks)
+        return batch;
+
+    // Prefer the provider's asynchronous reads, which can overlap I/O with decoding.
+    bool async = provider_.read_streams_async(names, max_size, [batch](size_t index, ByteBuffer&& data, Error& error) {
+        batch->complete(index, std::move(data), error);
+    });
+
+    if (async)
+        return batch;
+
+    {
+        std::lock_guard lock{mutex_};
+
+        for (size_t i = 0; i < num_tasks; ++i)
+            tasks_.push_back({batch, i});
+
+        // Start more workers if there are more tasks than idle workers.
+        while (threads_.size() < max_threads_ && idle_threads_ < tasks_.size()) {
+            threads_.emplace_back([this] { run_worker(); });
+            ++idle_threads_;
+        }
+    }
+
+    task_available_.notify_all();
+    return batch;
+}
+
+void Preloader::run_worker()
+{
+    std::unique_lock lock{mutex_};
+
+    for (;;) {
+        task_available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+
+        if (tasks_.empty())
+            return;
+
+        Task task = std::move(tasks_.front());
+        tasks_.pop_front();
+        --idle_threads_;
+        lock.unlock();
+
+        // Load the stream.
+        PreloadBatch& batch = *task.batch;
+        Error error;
+        ByteBuffer data = provider_.read_stream_buffer(batch.results_[task.index].name.c_str(), batch.max_size_, error);
+
+        batch.complete(task.index, std::move(data), error);
+
+        lock.lock();
+        ++idle_threads_;
+    }
+}
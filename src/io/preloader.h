@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_PRELOADER_H_INCLUDED
+#define IO_PRELOADER_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "stream.h"
+
+namespace geo {
+
+    /// Result of loading one stream in a @ref PreloadBatch.
+    struct PreloadResult {
+        std::string name{};
+        ByteBuffer data{};
+        Error error{};
+    };
+
+    /// Called on a worker thread when a stream in a batch has been loaded.
+    using PreloadCallback = std::function<void(const PreloadResult& result)>;
+
+    /// Handle to a batch of streams being loaded by a @ref Preloader.
+    class PreloadBatch {
+        friend class Preloader;
+
+    public:
+        PreloadBatch(const PreloadBatch&) = delete;
+
+        PreloadBatch& operator=(const PreloadBatch&) = delete;
+
+        bool is_done() const { return done_.load(std::memory_order_acquire); }
+
+        /// Blocks until every stream in the batch has been loaded.
+        void wait();
+
+        /// Gets the results in the order the names were given. Must not be called until the batch
+        /// is done.
+        std::span<PreloadResult> results();
+
+        /// Gets the total number of bytes loaded. Must not be called until the batch is done.
+        u64 get_total_size() const;
+
+        /// Gets the time from submitting the batch until the last stream was loaded. Must not be
+        /// called until the batch is done.
+        std::chrono::steady_clock::duration get_elapsed_time() const { return end_time_ - start_time_; }
+
+    private:
+        std::vector<PreloadResult> results_;
+        PreloadCallback callback_;
+        size_t max_size_;
+        std::atomic<size_t> remaining_;
+        std::atomic<bool> done_ = false;
+        std::chrono::steady_clock::time_point start_time_;
+        std::chrono::steady_clock::time_point end_time_{};
+        std::mutex mutex_;
+        std::condition_variable done_cond_;
+
+        PreloadBatch(std::vector<std::string> names, size_t max_size, PreloadCallback&& callback);
+
+        // Stores the result of loading a stream and calls the callback.
+        void complete(size_t index, ByteBuffer&& data, Error& error);
+    };
+
+    /// Loads batches of named streams. If the stream provider supports
+    /// @ref StreamProvider::read_streams_async, it is used to load the batch. Otherwise, the streams
+    /// are loaded on a pool of worker threads, in which case the stream provider must allow streams
+    /// to be read concurrently, e.g., @ref ZipArchive or @ref MappedPak.
+    class Preloader {
+    public:
+        Preloader(const Preloader&) = delete;
+        explicit Preloader(StreamProvider& provider, size_t max_threads = 0);
+        ~Preloader();
+
+        Preloader& operator=(const Preloader&) = delete;
+
+        /// Starts loading a batch of streams. Worker threads are started as needed, up to the
+        /// maximum given to the constructor (by default, one per hardware thread). If `callback` is
+        /// provided, it is called as each stream is loaded, typically on a worker thread.
+        std::shared_ptr<PreloadBatch> load(std::vector<std::string> names, size_t max_size,
+                                           PreloadCallback callback = {});
+
+    private:
+        struct Task {
+            std::shared_ptr<PreloadBatch> batch;
+            size_t index;
+        };
+
+        StreamProvider& provider_;
+        size_t max_threads_;
+        std::vector<std::thread> threads_;
+        size_t idle_threads_ = 0;
+        std::deque<Task> tasks_;
+        std::mutex mutex_;
+        std::condition_variable task_available_;
+        bool stopping_ = false;
+
+        void run_worker();
+    };
+
+} // namespace geo
+
+#endif // IO_PRELOADER_H_INCLUDED
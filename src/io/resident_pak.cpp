@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <limits>
+
+#include <core/finally.h>
+
+#include "crc32.h"
+#include "resident_pak.h"
+
+using namespace geo;
+
+namespace {
+
+    // Memory stream over an entry's resident data that keeps a reference to it.
+    class ResidentStream : public MemoryStream {
+    public:
+        explicit ResidentStream(std::shared_ptr<const ZipRawEntry>&& entry)
+            : MemoryStream{entry->data}
+            , entry_{std::move(entry)}
+        {
+        }
+
+    private:
+        std::shared_ptr<const ZipRawEntry> entry_;
+    };
+
+} // namespace
+
+ResidentPak::ResidentPak(StreamProvider& fallback, ZipArchive& archive)
+    : fallback_{fallback}
+    , archive_{archive}
+{
+}
+
+std::unique_ptr<Decoder> ResidentPak::acquire_decoder(u16 method)
+{
+    {
+        std::lock_guard lock{mutex_};
+        auto it = decoders_.find(method);
+
+        if (it != decoders_.end()) {
+            std::unique_ptr<Decoder> decoder = std::move(it->second);
+            decoders_.erase(it);
+            return decoder;
+        }
+    }
+
+    return archive_.create_decoder(method);
+}
+
+void ResidentPak::add_prefix(std::string prefix)
+{
+    prefixes_.push_back(std::move(prefix));
+}
+
+ResidentPak::ResidentEntry ResidentPak::get_entry(const char* name, Error& out_error)
+{
+    if (!is_selected(name))
+        return {};
+
+    {
+        std::lock_guard lock{mutex_};
+        auto it = entries_.find(std::string_view{name});
+
+        if (it != entries_.end())
+            return it->second;
+    }
+
+    // Read the entry without holding the lock, since it may be slow.
+    u64 content_id = fallback_.get_stream_content_id(name);
+    ZipRawEntry raw;
+    Error error;
+
+    {
+        std::lock_guard lock{mutex_};
+        auto it = content_id ? contents_.find(content_id) : contents_.end();
+
+        if (it != contents_.end())
+            return entries_.emplace(name, it->second).first->second;
+    }
+
+    if (!archive_.read_raw_entry(name, raw, error)) {
+        if (!error.matches(std::make_error_condition(std::errc::not_supported))) {
+            out_error = std::move(error);
+            return {};
+        }
+
+        std::lock_guard lock{mutex_};
+        return entries_.emplace(name, nullptr).first->second;
+    }
+
+    auto entry = std::make_shared<const ZipRawEntry>(std::move(raw));
+    std::lock_guard lock{mutex_};
+    auto [it, inserted] = entries_.emplace(name, entry);
+
+    // Another thread may have read the entry first.
+    if (!inserted)
+        return it->second;
+
+    if (content_id)
+        contents_.emplace(content_id, entry);
+
+    ++stats_.num_entries;
+    stats_.compressed_size += entry->data.size();
+    stats_.decoded_size += entry->size;
+    return entry;
+}
+
+ResidencyStats ResidentPak::get_stats() const
+{
+    std::lock_guard lock{mutex_};
+    ResidencyStats stats = stats_;
+
+    stats.num_decodes = num_decodes_.load(std::memory_order_relaxed);
+    stats.decoded_bytes = decoded_bytes_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool ResidentPak::get_stream_names(std::vector<std::string>& out_names, Error& out_error)
+{
+    return fallback_.get_stream_names(out_names, out_error);
+}
+
+i64 ResidentPak::get_stream_size(const char* name, Error& out_error)
+{
+    return fallback_.get_stream_size(name, out_error);
+}
+
+u64 ResidentPak::get_stream_content_id(const char* name)
+{
+    return fallback_.get_stream_content_id(name);
+}
+
+bool ResidentPak::is_selected(std::string_view name) const
+{
+    for (const std::string& prefix : prefixes_) {
+        if (name.starts_with(prefix))
+            return true;
+    }
+
+    return false;
+}
+
+bool ResidentPak::is_stream_cacheable(const char* name)
+{
+    if (!is_selected(name))
+        return fallback_.is_stream_cacheable(name);
+
+    // Selected entries that turned out not to be resident are cached as usual.
+    {
+        std::lock_guard lock{mutex_};
+        auto it = entries_.find(std::string_view{name});
+
+        if (it == entries_.end() || it->second)
+            return false;
+    }
+
+    return fallback_.is_stream_cacheable(name);
+}
+
+std::unique_ptr<Stream> ResidentPak::open_stream(const char* name, Error& out_error)
+{
+    ResidentEntry entry = get_entry(name, out_error);
+
+    if (out_error)
+        return {};
+    else if (!entry)
+        return fallback_.open_stream(name, out_error);
+
+    if (entry->method == zip_method::store)
+        return std::make_unique<ResidentStream>(std::move(entry));
+
+    i64 size = entry->size <= u64(std::numeric_limits<i64>::max()) ? i64(entry->size) : -1;
+    u16 method = entry->method;
+    u32 crc = entry->crc;
+    auto stream = std::make_unique<DecoderStream>(std::make_unique<ResidentStream>(std::move(entry)),
+                                                  archive_.create_decoder(method), size);
+
+    stream->set_expected_crc(crc);
+    num_decodes_.fetch_add(1, std::memory_order_relaxed);
+
+    if (size > 0)
+        decoded_bytes_.fetch_add(u64(size), std::memory_order_relaxed);
+
+    return stream;
+}
+
+void ResidentPak::prefetch(std::span<const std::string> names)
+{
+    // Selected entries that aren't resident yet are read from the archive on first access too.
+    fallback_.prefetch(names);
+}
+
+ByteBuffer ResidentPak::read_stream_buffer(const char* name, size_t max_size, Error& out_error)
+{
+    ResidentEntry entry = get_entry(name, out_error);
+
+    if (out_error)
+        return {};
+    else if (!entry)
+        return fallback_.read_stream_buffer(name, max_size, out_error);
+    else if (entry->size > max_size) {
+        out_error = {.code = IoErrorCode::stream_too_long};
+        return {};
+    }
+
+    if (entry->method == zip_method::store) {
+        return ByteBuffer::adopt(entry->data, [](void* context) { delete static_cast<ResidentEntry*>(context); },
+                                 new ResidentEntry{std::move(entry)});
+    }
+
+    std::unique_ptr<u8[]> decoded{new u8[entry->size]};
+    std::span<u8> out{decoded.get(), size_t(entry->size)};
+    std::unique_ptr<Decoder> decoder = acquire_decoder(entry->method);
+    Finally release = [&] { release_decoder(entry->method, std::move(decoder)); };
+
+    if (!decoder->decode_buffer(entry->data, out, out_error))
+        return {};
+
+    if (crc32::update(0, out) != entry->crc) {
+        out_error = {.code = IoErrorCode::checksum_mismatch};
+        return {};
+    }
+
+    num_decodes_.fetch_add(1, std::memory_order_relaxed);
+    decoded_bytes_.fetch_add(entry->size, std::memory_order_relaxed);
+    return ByteBuffer::adopt(std::move(decoded), out.size());
+}
+
+bool ResidentPak::read_streams_async(std::span<const std::string> names, size_t max_size,
+                                     ReadStreamsCallback callback)
+{
+    std::vector<std::string> fallback_names;
+    std::vector<size_t> fallback_indices;
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!is_selected(names[i])) {
+            fallback_names.push_back(names[i]);
+            fallback_indices.push_back(i);
+        }
+    }
+
+    auto shared_callback = std::make_shared<ReadStreamsCallback>(std::move(callback));
+
+    // Read the other streams first, since the callback must not be called if the fallback doesn't
+    // support asynchronous reads.
+    if (!fallback_names.empty()) {
+        bool async = fallback_.read_streams_async(fallback_names, max_size,
+            [shared_callback, fallback_indices](size_t index, ByteBuffer&& data, Error& error) {
+                (*shared_callback)(fallback_indices[index], std::move(data), error);
+            });
+
+        if (!async)
+            return false;
+    }
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!is_selected(names[i]))
+            continue;
+
+        Error error;
+        ByteBuffer data = read_stream_buffer(names[i].c_str(), max_size, error);
+        (*shared_callback)(i, std::move(data), error);
+    }
+
+    return true;
+}
+
+void ResidentPak::release_decoder(u16 method, std::unique_ptr<Decoder>&& decoder)
+{
+    std::lock_guard lock{mutex_};
+    decoders_.emplace(method, std::move(decoder));
+}
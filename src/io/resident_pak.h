@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_RESIDENT_PAK_H_INCLUDED
+#define IO_RESIDENT_PAK_H_INCLUDED
+
+#include <atomic>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include "zip.h"
+
+namespace geo {
+
+    /// Counters reported by @ref ResidentPak::get_stats.
+    struct ResidencyStats {
+        size_t num_entries = 0; ///< Entries whose raw data is resident
+        u64 compressed_size = 0; ///< Bytes of raw data held in memory
+        u64 decoded_size = 0; ///< Bytes the resident entries would take if they were held decoded
+        u64 num_decodes = 0; ///< Reads served by decoding resident data
+        u64 decoded_bytes = 0; ///< Bytes decoded by those reads
+    };
+
+    /// Stream provider that keeps the raw, compressed data of selected entries of a
+    /// @ref ZipArchive in memory, and decodes it on every read instead of keeping decoded copies or
+    /// reading the entry from disk again. This trades decoding time for memory on low-memory
+    /// targets, and suits small, frequently reused assets that compress well.
+    ///
+    /// Entries are selected by name prefix, and their raw data is read from the archive when
+    /// they're first accessed and kept until the provider is destroyed. Names that share the data
+    /// of a deduplicated entry share its resident data. Everything else, including entries that
+    /// can only be decoded by libzip, is forwarded to the fallback provider, e.g., the
+    /// @ref MappedPak that owns the archive. Resident streams are reported as not cacheable, so an
+    /// @ref AssetCache above the provider doesn't keep decoded copies of them. The provider may be
+    /// used from multiple threads.
+    class ResidentPak : public StreamProvider {
+    public:
+        ResidentPak(const ResidentPak&) = delete;
+        /// `archive` must read the same entries as `fallback`. It's only used to read the raw data
+        /// of resident entries.
+        ResidentPak(StreamProvider& fallback, ZipArchive& archive);
+
+        /// Keeps entries whose names start with `prefix` resident. An entry's full name selects only
+        /// that entry. Must be called before any streams are read.
+        void add_prefix(std::string prefix);
+
+        ResidencyStats get_stats() const;
+
+        bool get_stream_names(std::vector<std::string>& out_names, Error& out_error) override;
+        i64 get_stream_size(const char* name, Error& out_error) override;
+        u64 get_stream_content_id(const char* name) override;
+        bool is_stream_cacheable(const char* name) override;
+
+        /// Resident streams are decoded incrementally from memory by @ref DecoderStream.
+        std::unique_ptr<Stream> open_stream(const char* name, Error& out_error) override;
+
+        void prefetch(std::span<const std::string> names) override;
+
+        /// Decodes resident streams into a new buffer. Stored streams are returned as views of the
+        /// resident data.
+        ByteBuffer read_stream_buffer(const char* name, size_t max_size, Error& out_error) override;
+
+        /// Reads streams that aren't selected through the fallback's asynchronous reads, and
+        /// decodes resident streams before returning.
+        bool read_streams_async(std::span<const std::string> names, size_t max_size,
+                                ReadStreamsCallback callback) override;
+
+    private:
+        struct StringHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+        };
+
+        using ResidentEntry = std::shared_ptr<const ZipRawEntry>;
+
+        StreamProvider& fallback_;
+        ZipArchive& archive_;
+        std::vector<std::string> prefixes_;
+
+        // Resident entries by name. Entries that were selected but can't be resident are null.
+        std::unordered_map<std::string, ResidentEntry, StringHash, std::equal_to<>> entries_;
+        std::unordered_map<u64, ResidentEntry> contents_; // Resident entries by content ID
+
+        // Idle decoders by method, reused by read_stream_buffer.
+        std::unordered_multimap<u16, std::unique_ptr<Decoder>> decoders_;
+
+        ResidencyStats stats_;
+        mutable std::mutex mutex_;
+        std::atomic<u64> num_decodes_ = 0;
+        std::atomic<u64> decoded_bytes_ = 0;
+
+        bool is_selected(std::string_view name) const;
+
+        // Gets an entry's resident data, reading it on first access. Returns null without setting
+        // `out_error` if the entry isn't resident.
+        ResidentEntry get_entry(const char* name, Error& out_error);
+
+        std::unique_ptr<Decoder> acquire_decoder(u16 method);
+        void release_decoder(u16 method, std::unique_ptr<Decoder>&& decoder);
+    };
+
+} // namespace geo
+
+#endif // IO_RESIDENT_PAK_H_INCLUDED
@@ -6,6 +6,8 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
+#include <cstring>
+
 #include <math/math.h>
 #include <system/debug.h>
 
@@ -13,6 +15,91 @@
 
 using namespace geo;
 
+//==================================================================================================
+// ByteBuffer
+//==================================================================================================
+
+ByteBuffer::ByteBuffer(ByteBuffer&& other)
+    : data_{other.data_}
+    , release_{other.release_}
+    , context_{other.context_}
+    , owns_memory_{other.owns_memory_}
+{
+    other.data_ = {};
+    other.release_ = nullptr;
+    other.context_ = nullptr;
+    other.owns_memory_ = false;
+}
+
+ByteBuffer::~ByteBuffer()
+{
+    reset();
+}
+
+ByteBuffer& ByteBuffer::operator=(ByteBuffer&& other)
+{
+    if (&other != this) {
+        reset();
+        std::swap(data_, other.data_);
+        std::swap(release_, other.release_);
+        std::swap(context_, other.context_);
+        std::swap(owns_memory_, other.owns_memory_);
+    }
+    return *this;
+}
+
+ByteBuffer ByteBuffer::borrow(std::span<const u8> data)
+{
+    ByteBuffer buffer;
+
+    buffer.data_ = data;
+    return buffer;
+}
+
+ByteBuffer ByteBuffer::adopt(std::span<const u8> data, ReleaseProc release, void* context, bool owns_memory)
+{
+    ByteBuffer buffer;
+
+    buffer.data_ = data;
+    buffer.release_ = release;
+    buffer.context_ = context;
+    buffer.owns_memory_ = owns_memory;
+    return buffer;
+}
+
+ByteBuffer ByteBuffer::share(std::span<const u8> data, std::shared_ptr<const void> owner)
+{
+    auto ref = new std::shared_ptr<const void>{std::move(owner)};
+
+    return adopt(data, [](void* context) { delete static_cast<std::shared_ptr<const void>*>(context); }, ref,
+                 false);
+}
+
+ByteBuffer ByteBuffer::adopt(std::unique_ptr<u8[]>&& data, size_t size)
+{
+    u8* ptr = data.release();
+
+    return adopt({ptr, size}, [](void* context) { delete[] static_cast<u8*>(context); }, ptr);
+}
+
+ByteBuffer ByteBuffer::adopt(std::vector<u8>&& data)
+{
+    auto vec = new std::vector<u8>{std::move(data)};
+
+    return adopt(*vec, [](void* context) { delete static_cast<std::vector<u8>*>(context); }, vec);
+}
+
+void ByteBuffer::reset()
+{
+    if (release_)
+        release_(context_);
+
+    data_ = {};
+    release_ = nullptr;
+    context_ = nullptr;
+    owns_memory_ = false;
+}
+
 //==================================================================================================
 // Stream
 //==================================================================================================
@@ -94,6 +181,12 @@ size_t Stream::read_partial(void*, size_t, Error& out_error)
     return 0;
 }
 
+i64 Stream::seek(i64, SeekOrigin, Error& out_error)
+{
+    out_error = {.code = IoErrorCode::not_seekable};
+    return -1;
+}
+
 size_t Stream::write(const void* src, size_t size, Error& out_error)
 {
     Error local_error;
@@ -126,69 +219,522 @@ size_t Stream::write_partial(const void*, size_t, Error& out_error)
     return 0;
 }
 
+//==================================================================================================
+// BufferedStream
+//==================================================================================================
+
+BufferedStream::BufferedStream(BufferedStream&& other)
+    : inner_{std::move(other.inner_)}
+    , buffer_{std::move(other.buffer_)}
+    , buffer_size_{other.buffer_size_}
+    , pos_{other.pos_}
+    , end_{other.end_}
+{
+    other.buffer_size_ = 0;
+    other.pos_ = 0;
+    other.end_ = 0;
+}
+
+BufferedStream::BufferedStream(std::unique_ptr<Stream>&& inner, size_t buffer_size)
+    : inner_{std::move(inner)}
+    , buffer_{new u8[math::max(buffer_size, size_t(16))]}
+    , buffer_size_{math::max(buffer_size, size_t(16))}
+{
+}
+
+BufferedStream::~BufferedStream()
+{
+    close();
+}
+
+BufferedStream& BufferedStream::operator=(BufferedStream&& other)
+{
+    if (&other != this) {
+        close();
+        std::swap(inner_, other.inner_);
+        std::swap(buffer_, other.buffer_);
+        std::swap(buffer_size_, other.buffer_size_);
+        std::swap(pos_, other.pos_);
+        std::swap(end_, other.end_);
+    }
+    return *this;
+}
+
+std::span<const u8> BufferedStream::peek(size_t size, Error& out_error)
+{
+    size = math::min(fill(size, out_error), size);
+
+    if (!size)
+        return {};
+
+    return {&buffer_[pos_], size};
+}
+
+size_t BufferedStream::read_until(u8 delim, std::string& out_str, size_t max_size, Error& out_error)
+{
+    size_t total = 0;
+
+    for (;;) {
+        if (!available() && !fill(1, out_error))
+            return total;
+
+        // Copy up to and including the delimiter if it's in the buffer.
+        const u8* start = &buffer_[pos_];
+        const u8* found = static_cast<const u8*>(std::memchr(start, delim, available()));
+        size_t chunk_size = found ? size_t(found - start) + 1 : available();
+
+        if (out_str.size() + chunk_size > max_size) {
+            out_error = {.code = IoErrorCode::stream_too_long};
+            return total;
+        }
+
+        out_str.append(reinterpret_cast<const char*>(start), chunk_size);
+        pos_ += chunk_size;
+        total += chunk_size;
+
+        if (found)
+            return total;
+    }
+}
+
+bool BufferedStream::read_line(std::string& out_line, size_t max_size, Error& out_error)
+{
+    Error local_error;
+
+    out_line.clear();
+
+    // Allow room for the line terminator, which is stripped.
+    if (!read_until('\n', out_line, max_size + 2, local_error) || local_error) {
+        if (local_error)
+            out_error = std::move(local_error);
+        return false;
+    }
+
+    if (!out_line.empty() && out_line.back() == '\n')
+        out_line.pop_back();
+    if (!out_line.empty() && out_line.back() == '\r')
+        out_line.pop_back();
+
+    if (out_line.size() > max_size) {
+        out_error = {.code = IoErrorCode::stream_too_long};
+        return false;
+    }
+
+    return true;
+}
+
+void BufferedStream::close(Error& out_error)
+{
+    if (inner_)
+        inner_->close(out_error);
+
+    inner_.reset();
+    buffer_.reset();
+    buffer_size_ = 0;
+    pos_ = 0;
+    end_ = 0;
+}
+
+i64 BufferedStream::get_position(Error& out_error) const
+{
+    if (!inner_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    }
+
+    i64 inner_pos = inner_->get_position(out_error);
+
+    if (inner_pos < 0)
+        return -1;
+
+    return inner_pos - i64(available());
+}
+
+i64 BufferedStream::get_size(Error& out_error) const
+{
+    if (!inner_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    }
+
+    return inner_->get_size(out_error);
+}
+
+size_t BufferedStream::read_partial(void* dst, size_t size, Error& out_error)
+{
+    if (!inner_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return 0;
+    }
+
+    // Large reads bypass the buffer once it's drained.
+    if (!available()) {
+        if (size >= buffer_size_)
+            return inner_->read_partial(dst, size, out_error);
+        else if (!fill(1, out_error))
+            return 0;
+    }
+
+    size = math::min(size, available());
+    std::memcpy(dst, &buffer_[pos_], size);
+    pos_ += size;
+    return size;
+}
+
+i64 BufferedStream::seek(i64 offset, SeekOrigin origin, Error& out_error)
+{
+    if (!inner_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    }
+
+    // Relative seeks that land within the buffer don't need to touch the underlying stream.
+    if (origin == SeekOrigin::current && offset >= -i64(pos_) && offset <= i64(available())) {
+        Error local_error;
+        i64 inner_pos = inner_->get_position(local_error);
+
+        if (inner_pos >= 0) {
+            pos_ = size_t(i64(pos_) + offset);
+            return inner_pos - i64(available());
+        }
+    }
+
+    // The underlying stream is ahead of our position by the number of buffered bytes.
+    if (origin == SeekOrigin::current)
+        offset -= i64(available());
+
+    i64 result = inner_->seek(offset, origin, out_error);
+
+    if (result >= 0) {
+        pos_ = 0;
+        end_ = 0;
+    }
+
+    return result;
+}
+
+size_t BufferedStream::fill(size_t size, Error& out_error)
+{
+    Error local_error;
+    size_t pass_result;
+
+    if (!inner_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return 0;
+    }
+
+    size = math::min(size, buffer_size_);
+
+    if (!available()) {
+        pos_ = 0;
+        end_ = 0;
+    }
+
+    // Move the unread data to the start of the buffer if there isn't enough room after it.
+    if (buffer_size_ - pos_ < size) {
+        std::memmove(&buffer_[0], &buffer_[pos_], available());
+        end_ -= pos_;
+        pos_ = 0;
+    }
+
+    while (available() < size) {
+        pass_result = inner_->read_partial(&buffer_[end_], buffer_size_ - end_, local_error);
+        end_ += pass_result;
+
+        if (local_error) {
+            out_error = std::move(local_error);
+            break;
+        } else if (!pass_result) {
+            break;
+        }
+    }
+
+    return available();
+}
+
+//==================================================================================================
+// MemoryStream
+//==================================================================================================
+
+MemoryStream::MemoryStream(MemoryStream&& other)
+    : data_{other.data_}
+    , position_{other.position_}
+    , is_open_{other.is_open_}
+{
+    other.data_ = {};
+    other.position_ = 0;
+    other.is_open_ = false;
+}
+
+MemoryStream::MemoryStream(std::span<const u8> data)
+    : data_{data}
+    , is_open_{true}
+{
+}
+
+MemoryStream::~MemoryStream()
+{
+}
+
+MemoryStream& MemoryStream::operator=(MemoryStream&& other)
+{
+    if (&other != this) {
+        std::swap(data_, other.data_);
+        std::swap(position_, other.position_);
+        std::swap(is_open_, other.is_open_);
+    }
+    return *this;
+}
+
+void MemoryStream::close(Error&)
+{
+    data_ = {};
+    position_ = 0;
+    is_open_ = false;
+}
+
+i64 MemoryStream::get_position(Error& out_error) const
+{
+    if (!is_open_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    }
+
+    return i64(position_);
+}
+
+i64 MemoryStream::get_size(Error& out_error) const
+{
+    if (!is_open_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    }
+
+    return i64(data_.size());
+}
+
+size_t MemoryStream::read_partial(void* dst, size_t size, Error& out_error)
+{
+    if (!is_open_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return 0;
+    }
+
+    size = math::min(size, data_.size() - position_);
+
+    if (size) {
+        std::memcpy(dst, data_.data() + position_, size);
+        position_ += size;
+    }
+
+    return size;
+}
+
+i64 MemoryStream::seek(i64 offset, SeekOrigin origin, Error& out_error)
+{
+    i64 base;
+
+    if (!is_open_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    }
+
+    switch (origin) {
+        case SeekOrigin::set: base = 0; break;
+        case SeekOrigin::current: base = i64(position_); break;
+        case SeekOrigin::end: base = i64(data_.size()); break;
+        default: base = -1; break;
+    }
+
+    if (base < 0 || offset < -base || offset > i64(data_.size()) - base) {
+        out_error = {.code = std::make_error_code(std::errc::invalid_argument)};
+        return -1;
+    }
+
+    position_ = size_t(base + offset);
+    return i64(position_);
+}
+
+//==================================================================================================
+// ByteBufferStream
+//==================================================================================================
+
+ByteBufferStream::ByteBufferStream(ByteBuffer&& buffer)
+    : MemoryStream{buffer.bytes()}
+    , buffer_{std::move(buffer)}
+{
+}
+
 //==================================================================================================
 // StreamProvider
 //==================================================================================================
 
+namespace {
+
+    // Initial buffer size used when reading a stream of unknown size.
+    constexpr size_t min_read_size = 4096;
+
+    // Opens a named stream, treating a missing or closed stream as an error.
+    std::unique_ptr<Stream> open_input_stream(StreamProvider& provider, const char* name, Error& out_error)
+    {
+        Error local_error;
+        auto stream = provider.open_stream(name, local_error);
+
+        if (local_error) {
+            out_error = std::move(local_error);
+            return {};
+        } else if (!stream || !stream->is_open()) {
+            out_error = {.code = IoErrorCode::not_found};
+            return {};
+        }
+
+        return stream;
+    }
+
+    // Makes sure the stream does not continue beyond the data that has already been read.
+    void check_end_of_stream(Stream& stream, Error& out_error)
+    {
+        Error local_error;
+        u8 excess_byte;
+
+        if (stream.read_partial(&excess_byte, 1, local_error))
+            out_error = {.code = IoErrorCode::stream_too_long};
+    }
+
+} // namespace
+
 StreamProvider::~StreamProvider()
 {
 }
 
+bool StreamProvider::get_stream_names(std::vector<std::string>&, Error& out_error)
+{
+    out_error = {.code = std::make_error_code(std::errc::operation_not_supported)};
+    return false;
+}
+
+i64 StreamProvider::get_stream_size(const char* name, Error& out_error)
+{
+    auto stream = open_input_stream(*this, name, out_error);
+
+    if (!stream)
+        return -1;
+
+    return stream->get_size(out_error);
+}
+
+u64 StreamProvider::get_stream_content_id(const char*)
+{
+    return 0;
+}
+
+bool StreamProvider::is_stream_cacheable(const char*)
+{
+    return true;
+}
+
+void StreamProvider::prefetch(std::span<const std::string>)
+{
+}
+
 std::vector<u8> StreamProvider::read_stream_bytes(const char* name, size_t max_size, Error& out_error)
 {
     Error local_error;
 
     // Open the stream for reading.
-    auto stream = open_stream(name, local_error);
+    auto stream = open_input_stream(*this, name, out_error);
 
-    if (local_error) {
-        out_error = std::move(local_error);
+    if (!stream)
         return {};
-    } else if (!stream || !stream->is_open()) {
-        out_error = {.code = IoErrorCode::not_found};
-        return {};
-    }
 
-    // Allocate the output buffer.
+    // Allocate the output buffer. If the stream size is known, the data is read in one pass.
     std::vector<u8> data;
     i64 stream_size = stream->get_size(local_error);
+    size_t size = 0;
+    size_t pass_result;
 
     local_error.clear();
 
-    if (stream_size > 0) {
-        if (u64(stream_size) > max_size) {
-            out_error = {.code = IoErrorCode::stream_too_long};
-            return {};
-        }
-        data.reserve(math::min(size_t(stream_size), max_size));
+    if (stream_size >= 0 && u64(stream_size) > max_size) {
+        out_error = {.code = IoErrorCode::stream_too_long};
+        return {};
     }
 
-    // Read the data from the stream.
-    char buf[4096];
-    size_t pass_size;
-    size_t pass_result;
+    data.resize(stream_size >= 0 ? size_t(stream_size) : math::min(max_size, min_read_size));
 
-    while (data.size() < max_size) {
-        pass_size = math::min(max_size - data.size(), sizeof(buf));
-        pass_result = stream->read_partial(buf, pass_size, local_error);
-        ASSERT(pass_result <= pass_size);
+    // Read the data directly into the output buffer, growing it if the stream turns out to be
+    // longer than expected.
+    while (size < max_size) {
+        if (size == data.size()) {
+            // Probe for more data before growing the buffer so that streams of the expected size
+            // don't cause a reallocation.
+            u8 next_byte;
 
-        if (pass_result)
-            data.insert(data.end(), buf, buf + pass_result);
+            pass_result = stream->read_partial(&next_byte, 1, local_error);
 
-        if (local_error) {
-            out_error = std::move(local_error);
-            return data;
-        } else if (!pass_result) {
-            return data;
+            if (local_error || !pass_result)
+                break;
+
+            data.resize(math::min(max_size, math::max(size * 2, min_read_size)));
+            data[size++] = next_byte;
+            continue;
         }
+
+        pass_result = stream->read_partial(&data[size], data.size() - size, local_error);
+        ASSERT(pass_result <= data.size() - size);
+        size += pass_result;
+
+        if (local_error || !pass_result)
+            break;
     }
 
-    // Make sure the stream does not continue beyond max_size.
-    u8 excess_byte;
+    data.resize(size);
 
-    if (data.size() == max_size && stream->read_partial(&excess_byte, 1, local_error))
-        out_error = {.code = IoErrorCode::stream_too_long};
+    if (local_error)
+        out_error = std::move(local_error);
+    else if (size == max_size)
+        check_end_of_stream(*stream, out_error);
 
     return data;
 }
+
+ByteBuffer StreamProvider::read_stream_buffer(const char* name, size_t max_size, Error& out_error)
+{
+    return ByteBuffer::adopt(read_stream_bytes(name, max_size, out_error));
+}
+
+size_t StreamProvider::read_stream_into(const char* name, std::span<u8> dst, Error& out_error)
+{
+    Error local_error;
+
+    // Open the stream for reading.
+    auto stream = open_input_stream(*this, name, out_error);
+
+    if (!stream)
+        return 0;
+
+    // Fail early if the stream is known to be too long.
+    i64 stream_size = stream->get_size(local_error);
+
+    local_error.clear();
+
+    if (stream_size >= 0 && u64(stream_size) > dst.size()) {
+        out_error = {.code = IoErrorCode::stream_too_long};
+        return 0;
+    }
+
+    // Read the data directly into the destination.
+    size_t result = stream->read(dst.data(), dst.size(), local_error);
+
+    if (local_error)
+        out_error = std::move(local_error);
+    else if (result == dst.size())
+        check_end_of_stream(*stream, out_error);
+
+    return result;
+}
+
+bool StreamProvider::read_streams_async(std::span<const std::string>, size_t, ReadStreamsCallback)
+{
+    return false;
+}
@@ -9,9 +9,16 @@
 #ifndef IO_STREAM_H_INCLUDED
 #define IO_STREAM_H_INCLUDED
 
+#include <bit>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <span>
+#include <string>
 #include <vector>
 
+#include <core/endian.h>
+
 #include "error.h"
 
 namespace geo {
@@ -23,6 +30,60 @@ namespace geo {
         end, ///< Offset is relative to the end of the stream.
     };
 
+    /// Immutable block of bytes that is either owned by the buffer or borrowed from another object,
+    /// e.g., a memory mapping. If a release callback is set, it is invoked when the buffer is
+    /// destroyed or reset.
+    class ByteBuffer {
+    public:
+        using ReleaseProc = void (*)(void* context);
+
+        ByteBuffer() = default;
+        ByteBuffer(const ByteBuffer&) = delete;
+        ByteBuffer(ByteBuffer&& other);
+        ~ByteBuffer();
+
+        ByteBuffer& operator=(ByteBuffer&& other);
+
+        /// Creates a buffer that borrows `data` without taking ownership. The memory must outlive
+        /// the buffer.
+        static ByteBuffer borrow(std::span<const u8> data);
+
+        /// Creates a buffer that views `data` and calls `release(context)` when it is no longer
+        /// needed. `owns_memory` should be false if the data belongs to an object that is cheap to
+        /// read again, e.g., a memory mapping; see @ref owns_memory.
+        static ByteBuffer adopt(std::span<const u8> data, ReleaseProc release, void* context,
+                                bool owns_memory = true);
+
+        /// Creates a buffer that views `data` and holds a reference to `owner`, e.g., the memory
+        /// mapping that contains the data, until it is no longer needed.
+        static ByteBuffer share(std::span<const u8> data, std::shared_ptr<const void> owner);
+
+        /// Creates a buffer that owns a heap-allocated array of `size` bytes.
+        static ByteBuffer adopt(std::unique_ptr<u8[]>&& data, size_t size);
+
+        /// Creates a buffer that takes ownership of a vector's contents.
+        static ByteBuffer adopt(std::vector<u8>&& data);
+
+        std::span<const u8> bytes() const { return data_; }
+        const u8* data() const { return data_.data(); }
+        bool empty() const { return data_.empty(); }
+        size_t size() const { return data_.size(); }
+
+        /// Indicates whether the buffer holds its own copy of the data, e.g., decoded data on the
+        /// heap, as opposed to a view that is cheap to create again, e.g., from @ref borrow or
+        /// @ref share. Caches use this to skip buffers that aren't worth keeping.
+        bool owns_memory() const { return owns_memory_; }
+
+        /// Releases the buffer's memory and makes the buffer empty.
+        void reset();
+
+    private:
+        std::span<const u8> data_{};
+        ReleaseProc release_ = nullptr;
+        void* context_ = nullptr;
+        bool owns_memory_ = false;
+    };
+
     /// Base class for I/O streams.
     class Stream {
     public:
@@ -68,6 +129,10 @@ namespace geo {
         /// buffer in one call is desired, use @ref read instead.
         virtual size_t read_partial(void* dst, size_t size, Error& out_error);
 
+        /// Moves the stream position to `offset` bytes relative to `origin`. Returns the new stream
+        /// position, or -1 if an error occurs.
+        virtual i64 seek(i64 offset, SeekOrigin origin, Error& out_error);
+
         /// Attempts to write exactly `size` bytes from `src` into the stream. Repeatedly calls
         /// @ref write_partial until the full buffer is written or an error occurs.
         size_t write(const void* src, size_t size, Error& out_error);
@@ -78,9 +143,144 @@ namespace geo {
         virtual size_t write_partial(const void* src, size_t size, Error& out_error);
     };
 
+    /// Input stream adapter that buffers reads from another stream. This reduces the number of
+    /// calls into the underlying stream when parsing small fields. Reads that are at least as large
+    /// as the buffer bypass it and go directly to the underlying stream.
+    class BufferedStream : public Stream {
+    public:
+        using Stream::close;
+
+        static constexpr size_t default_buffer_size = 4096;
+
+        BufferedStream() = default;
+        BufferedStream(const BufferedStream&) = delete;
+        BufferedStream(BufferedStream&& other);
+        explicit BufferedStream(std::unique_ptr<Stream>&& inner, size_t buffer_size = default_buffer_size);
+        ~BufferedStream();
+
+        BufferedStream& operator=(BufferedStream&& other);
+
+        /// Returns a view of the next `size` bytes without consuming them. The view may be shorter
+        /// if the end of the stream is reached or `size` exceeds the buffer size. The view is
+        /// invalidated by the next operation on the stream.
+        std::span<const u8> peek(size_t size, Error& out_error);
+
+        /// Reads bytes up to and including the next `delim` and appends them to `out_str`. Returns
+        /// the number of bytes appended, which is zero at the end of the stream. Sets `out_error`
+        /// to @ref IoErrorCode::stream_too_long if `out_str` would exceed `max_size` bytes.
+        size_t read_until(u8 delim, std::string& out_str, size_t max_size, Error& out_error);
+
+        /// Reads a line of text into `out_line`, stripping the trailing `\n` or `\r\n`. Returns
+        /// false if the end of the stream is reached before anything is read or an error occurs.
+        bool read_line(std::string& out_line, size_t max_size, Error& out_error);
+
+        // Little-endian typed reads. These set `out_error` to @ref IoErrorCode::end_of_stream and
+        // return zero if the value can't be read completely.
+        u8 read_u8(Error& out_error) { return read_le<u8>(out_error); }
+        u16 read_u16(Error& out_error) { return read_le<u16>(out_error); }
+        u32 read_u32(Error& out_error) { return read_le<u32>(out_error); }
+        u64 read_u64(Error& out_error) { return read_le<u64>(out_error); }
+        i8 read_i8(Error& out_error) { return i8(read_le<u8>(out_error)); }
+        i16 read_i16(Error& out_error) { return i16(read_le<u16>(out_error)); }
+        i32 read_i32(Error& out_error) { return i32(read_le<u32>(out_error)); }
+        i64 read_i64(Error& out_error) { return i64(read_le<u64>(out_error)); }
+        f32 read_f32(Error& out_error) { return std::bit_cast<f32>(read_le<u32>(out_error)); }
+        f64 read_f64(Error& out_error) { return std::bit_cast<f64>(read_le<u64>(out_error)); }
+
+        void close(Error& out_error) override;
+        i64 get_position(Error& out_error) const override;
+        i64 get_size(Error& out_error) const override;
+        bool is_open() const override { return inner_ && inner_->is_open(); }
+        bool is_readable() const override { return true; }
+        bool is_seekable() const override { return inner_ && inner_->is_seekable(); }
+        size_t read_partial(void* dst, size_t size, Error& out_error) override;
+        i64 seek(i64 offset, SeekOrigin origin, Error& out_error) override;
+
+    private:
+        std::unique_ptr<Stream> inner_{};
+        std::unique_ptr<u8[]> buffer_{};
+        size_t buffer_size_ = 0;
+        size_t pos_ = 0; // Read position within the buffer
+        size_t end_ = 0; // End of valid data within the buffer
+
+        size_t available() const { return end_ - pos_; }
+
+        // Reads from the underlying stream until at least `size` bytes are buffered, the end of
+        // the stream is reached, or an error occurs. Returns the number of bytes available.
+        size_t fill(size_t size, Error& out_error);
+
+        template<typename T>
+        T read_le(Error& out_error)
+        {
+            u8 bytes[sizeof(T)];
+
+            if (available() >= sizeof(T)) {
+                std::memcpy(bytes, &buffer_[pos_], sizeof(T));
+                pos_ += sizeof(T);
+            } else if (read_exact(bytes, sizeof(T), out_error) < sizeof(T)) {
+                return 0;
+            }
+
+            if constexpr (sizeof(T) == 1)
+                return bytes[0];
+            else if constexpr (sizeof(T) == 2)
+                return endian::load_le16(bytes);
+            else if constexpr (sizeof(T) == 4)
+                return endian::load_le32(bytes);
+            else
+                return endian::load_le64(bytes);
+        }
+    };
+
+    /// Read-only stream over a block of memory. The memory is not copied and must outlive the
+    /// stream.
+    class MemoryStream : public Stream {
+    public:
+        using Stream::close;
+
+        MemoryStream() = default;
+        MemoryStream(const MemoryStream&) = delete;
+        MemoryStream(MemoryStream&& other);
+        explicit MemoryStream(std::span<const u8> data);
+        ~MemoryStream();
+
+        MemoryStream& operator=(MemoryStream&& other);
+
+        /// Returns the unread portion of the stream's memory.
+        std::span<const u8> remaining() const { return data_.subspan(position_); }
+
+        void close(Error& out_error) override;
+        i64 get_position(Error& out_error) const override;
+        i64 get_size(Error& out_error) const override;
+        bool is_open() const override { return is_open_; }
+        bool is_readable() const override { return true; }
+        bool is_seekable() const override { return true; }
+        size_t read_partial(void* dst, size_t size, Error& out_error) override;
+        i64 seek(i64 offset, SeekOrigin origin, Error& out_error) override;
+
+    private:
+        std::span<const u8> data_{};
+        size_t position_ = 0;
+        bool is_open_ = false;
+    };
+
+    /// Memory stream that owns or holds a reference to its memory through a @ref ByteBuffer.
+    class ByteBufferStream : public MemoryStream {
+    public:
+        ByteBufferStream(const ByteBufferStream&) = delete;
+        explicit ByteBufferStream(ByteBuffer&& buffer);
+
+    private:
+        ByteBuffer buffer_;
+    };
+
     /// Interface for opening named input streams.
     class StreamProvider {
     public:
+        /// Called when a stream requested by @ref read_streams_async has been read. `index` is the
+        /// stream's index in the list of names.
+        using ReadStreamsCallback = std::function<void(size_t index, ByteBuffer&& data, Error& error)>;
+
         virtual ~StreamProvider() = 0;
 
         StreamProvider& operator=(const StreamProvider&) = delete;
@@ -88,8 +288,45 @@ namespace geo {
         /// Opens a named input stream.
         virtual std::unique_ptr<Stream> open_stream(const char* name, Error& out_error) = 0;
 
+        /// Appends the names of all streams that can be opened to `out_names`. Sets `out_error`
+        /// to `std::errc::operation_not_supported` if the provider can't enumerate its streams.
+        virtual bool get_stream_names(std::vector<std::string>& out_names, Error& out_error);
+
+        /// Gets the size of a named input stream in bytes, or -1 if it cannot be determined. This
+        /// can be used to allocate a destination for @ref read_stream_into.
+        virtual i64 get_stream_size(const char* name, Error& out_error);
+
+        /// Gets a nonzero ID shared by streams that are known to have identical contents, such as
+        /// names of the same deduplicated PAK entry, or 0 if unknown. IDs of different streams
+        /// differ, and fit in 48 bits so that layered providers can tell their layers apart.
+        virtual u64 get_stream_content_id(const char* name);
+
+        /// Indicates whether caches of decoded streams, e.g., @ref AssetCache, should keep copies of
+        /// a stream. Providers that keep a stream resident in a more compact form return false.
+        virtual bool is_stream_cacheable(const char* name);
+
+        /// Hints that the named streams will be read soon, so the provider can start loading them in
+        /// the background, e.g., by asking the OS to read ahead the PAK's byte ranges. This
+        /// doesn't wait for I/O and is cheap enough to call every frame. Unknown names are ignored.
+        virtual void prefetch(std::span<const std::string> names);
+
         /// Opens and reads a named input stream.
         std::vector<u8> read_stream_bytes(const char* name, size_t max_size, Error& out_error);
+
+        /// Opens and reads a named input stream into an immutable buffer. Providers that already
+        /// hold the data in memory may return a view of it instead of a copy.
+        virtual ByteBuffer read_stream_buffer(const char* name, size_t max_size, Error& out_error);
+
+        /// Opens a named input stream and reads it directly into `dst`, e.g., an arena or a mapped
+        /// GPU buffer. Returns the number of bytes read. Sets `out_error` to
+        /// @ref IoErrorCode::stream_too_long if the stream does not fit in `dst`.
+        size_t read_stream_into(const char* name, std::span<u8> dst, Error& out_error);
+
+        /// Starts reading a batch of named streams asynchronously. The callback is called once per
+        /// stream, possibly on another thread or before this function returns. Returns false if the
+        /// provider doesn't support asynchronous reads, in which case the callback is never called.
+        virtual bool read_streams_async(std::span<const std::string> names, size_t max_size,
+                                        ReadStreamsCallback callback);
     };
 
 } // namespace geo
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+
+#include <string_view>
+#include <unordered_set>
+
+#include <system/debug.h>
+#include <system/mapping.h>
+
+#include "tracing_provider.h"
+
+using namespace geo;
+
+TracingProvider::TracingProvider(StreamProvider& source, const oschar_t* path, Error& out_error)
+    : source_{source}
+    , start_time_{std::chrono::steady_clock::now()}
+{
+#ifdef _WIN32
+    fp_ = _wfopen(path, L"wb");
+#else
+    fp_ = fopen(path, "wb");
+#endif
+
+    if (!fp_)
+        out_error = {.description = "fopen failed", .code = {errno, std::generic_category()}};
+}
+
+TracingProvider::~TracingProvider()
+{
+    if (fp_ && fclose(fp_))
+        LOG_ERROR("Failed to write asset trace: {}", Error{.code = {errno, std::generic_category()}});
+}
+
+bool TracingProvider::get_stream_names(std::vector<std::string>& out_names, Error& out_error)
+{
+    return source_.get_stream_names(out_names, out_error);
+}
+
+i64 TracingProvider::get_stream_size(const char* name, Error& out_error)
+{
+    return source_.get_stream_size(name, out_error);
+}
+
+u64 TracingProvider::get_stream_content_id(const char* name)
+{
+    return source_.get_stream_content_id(name);
+}
+
+bool TracingProvider::is_stream_cacheable(const char* name)
+{
+    return source_.is_stream_cacheable(name);
+}
+
+std::unique_ptr<Stream> TracingProvider::open_stream(const char* name, Error& out_error)
+{
+    record(name);
+    return source_.open_stream(name, out_error);
+}
+
+void TracingProvider::prefetch(std::span<const std::string> names)
+{
+    source_.prefetch(names);
+}
+
+ByteBuffer TracingProvider::read_stream_buffer(const char* name, size_t max_size, Error& out_error)
+{
+    record(name);
+    return source_.read_stream_buffer(name, max_size, out_error);
+}
+
+bool TracingProvider::read_streams_async(std::span<const std::string> names, size_t max_size,
+                                         ReadStreamsCallback callback)
+{
+    // The reads are recorded when they're requested, which is the order the PAK should have.
+    for (const std::string& name : names)
+        record(name);
+
+    return source_.read_streams_async(names, max_size, std::move(callback));
+}
+
+bool TracingProvider::load_trace(const oschar_t* path, std::vector<std::string>& out_names, Error& out_error)
+{
+    FileMapping mapping;
+
+    if (!mapping.open(path, out_error))
+        return false;
+
+    std::string_view trace{reinterpret_cast<const char*>(mapping.bytes().data()), mapping.bytes().size()};
+    std::unordered_set<std::string> seen{out_names.begin(), out_names.end()};
+
+    while (!trace.empty()) {
+        size_t end_pos = trace.find('\n');
+        std::string_view line = trace.substr(0, end_pos);
+
+        trace = end_pos == std::string_view::npos ? std::string_view{} : trace.substr(end_pos + 1);
+
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+
+        if (line.empty())
+            continue;
+
+        size_t tab_pos = line.find('\t');
+
+        if (tab_pos == std::string_view::npos || tab_pos == line.size() - 1) {
+            out_error = {.description = "Invalid asset trace"};
+            return false;
+        }
+
+        std::string name{line.substr(tab_pos + 1)};
+
+        if (seen.insert(name).second)
+            out_names.push_back(std::move(name));
+    }
+
+    return true;
+}
+
+void TracingProvider::record(std::string_view name)
+{
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time_);
+    std::lock_guard lock{mutex_};
+
+    if (fp_)
+        fmt::print(fp_, "{}\t{}\n", time.count(), name);
+}
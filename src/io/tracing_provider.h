@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_TRACING_PROVIDER_H_INCLUDED
+#define IO_TRACING_PROVIDER_H_INCLUDED
+
+#include <stdio.h>
+
+#include <chrono>
+#include <mutex>
+
+#include "stream.h"
+
+namespace geo {
+
+    /// Stream provider that records which streams are read from another provider, in order, to an
+    /// asset trace file. The PAK builder uses traces to lay out entries in the order they're first
+    /// read, so that loading reads the PAK sequentially.
+    ///
+    /// Each line of a trace is the time of the read in microseconds since the provider was
+    /// created, a tab, and the stream's name.
+    class TracingProvider : public StreamProvider {
+    public:
+        TracingProvider(const TracingProvider&) = delete;
+        explicit TracingProvider(StreamProvider& source, const oschar_t* path, Error& out_error);
+        ~TracingProvider();
+
+        bool is_open() const { return fp_ != nullptr; }
+
+        bool get_stream_names(std::vector<std::string>& out_names, Error& out_error) override;
+        i64 get_stream_size(const char* name, Error& out_error) override;
+        u64 get_stream_content_id(const char* name) override;
+        bool is_stream_cacheable(const char* name) override;
+        std::unique_ptr<Stream> open_stream(const char* name, Error& out_error) override;
+
+        /// Forwards the hint without recording it, since prefetched streams may not be read. Note
+        /// that an @ref AssetCache with prefetch decoding enabled turns the hint into a call to
+        /// @ref read_streams_async, which is recorded like any other read. That's intended, since
+        /// the streams' later uses are served from the cache and never reach this provider.
+        void prefetch(std::span<const std::string> names) override;
+
+        ByteBuffer read_stream_buffer(const char* name, size_t max_size, Error& out_error) override;
+        bool read_streams_async(std::span<const std::string> names, size_t max_size,
+                                ReadStreamsCallback callback) override;
+
+        /// Reads a trace and appends the names of the streams it contains to `out_names` in the
+        /// order they were first read. Names that are already in `out_names` are skipped, so
+        /// several traces can be merged.
+        static bool load_trace(const oschar_t* path, std::vector<std::string>& out_names, Error& out_error);
+
+    private:
+        StreamProvider& source_;
+        std::mutex mutex_;
+        FILE* fp_ = nullptr;
+        std::chrono::steady_clock::time_point start_time_;
+
+        void record(std::string_view name);
+    };
+
+} // namespace geo
+
+#endif // IO_TRACING_PROVIDER_H_INCLUDED
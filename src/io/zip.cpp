@@ -10,13 +10,19 @@
 #include <stdio.h>
 
 #include <limits>
+#include <mutex>
 
 #include <zip.h>
 
 #include <core/finally.h>
+#include <system/async_file.h>
 #include <system/debug.h>
 
+#include "crc32.h"
+#include "lz4.h"
 #include "zip.h"
+#include "zip_directory.h"
+#include "zstd.h"
 
 using namespace geo;
 
@@ -41,14 +47,14 @@ namespace {
         const char* name() const noexcept override { return "libzip"; }
     } constinit const libzip_error_category_instance;
 
-    Error make_libzip_error(const char* description, int zerr, int cerr)
+    Error make_libzip_error(ErrorDescription description, int zerr, int cerr)
     {
-        Error error{.description = description};
+        Error error{.description = std::move(description)};
 
         if (zerr) {
             error.code = {zerr, libzip_error_category};
             if (cerr)
-                error.cause.reset(new Error{.code = {cerr, std::generic_category()}});
+                error.cause = Error{.code = {cerr, std::generic_category()}};
         } else if (cerr) {
             error.code = {cerr, std::generic_category()};
         }
@@ -56,23 +62,265 @@ namespace {
         return error;
     }
 
-    Error make_libzip_error(const char* description, const zip_error_t* zerror)
+    Error make_libzip_error(ErrorDescription description, const zip_error_t* zerror)
     {
-        return make_libzip_error(description, zip_error_code_zip(zerror), zip_error_code_system(zerror));
+        return make_libzip_error(std::move(description), zip_error_code_zip(zerror), zip_error_code_system(zerror));
+    }
+
+    // Returns whether we decode entries with the given method ourselves rather than through
+    // libzip, i.e., whether `make_decoder` would succeed.
+    bool can_decode(u16 method, const std::shared_ptr<const ZstdDictionary>& dictionary)
+    {
+        switch (method) {
+            case zip_method::zstd:
+            case zip_method::lz4:
+                return true;
+            case zip_method::zstd_dict:
+                return dictionary != nullptr;
+            default:
+                return false;
+        }
+    }
+
+    // Creates a decoder for an entry that we decode ourselves rather than through libzip. Returns
+    // null if libzip should decode the entry, or if it needs a dictionary that isn't loaded.
+    std::unique_ptr<Decoder> make_decoder(u16 method, const std::shared_ptr<const ZstdDictionary>& dictionary)
+    {
+        switch (method) {
+            case zip_method::zstd:
+                return std::make_unique<ZstdDecoder>();
+            case zip_method::zstd_dict:
+                return dictionary ? std::make_unique<ZstdDecoder>(dictionary) : nullptr;
+            case zip_method::lz4:
+                return std::make_unique<Lz4Decoder>();
+            default:
+                return {};
+        }
+    }
+
+    // Decodes an entry's raw data read by ZipArchive::read_streams_async. Takes ownership of `raw`.
+    ByteBuffer decode_raw_entry(const ZipIndexEntry& entry, u8* raw, size_t raw_size,
+                                const std::shared_ptr<const ZstdDictionary>& dictionary, Error& out_error)
+    {
+        std::unique_ptr<u8[]> owned_raw{raw};
+
+        if (raw_size != entry.compressed_size) {
+            out_error = {.code = IoErrorCode::end_of_stream};
+            return {};
+        }
+
+        std::span<const u8> data{raw, raw_size};
+        ByteBuffer result;
+
+        if (entry.method == zip_method::store) {
+            // Return a view of the raw buffer rather than copying it.
+            result = ByteBuffer::adopt(data, [](void* context) { delete[] static_cast<u8*>(context); },
+                                       owned_raw.release());
+        } else {
+            std::unique_ptr<u8[]> decoded{new u8[entry.size]};
+
+            if (!make_decoder(entry.method, dictionary)->decode_buffer(data, {decoded.get(), size_t(entry.size)}, out_error))
+                return {};
+
+            result = ByteBuffer::adopt(std::move(decoded), size_t(entry.size));
+        }
+
+        if (crc32::update(0, result.bytes()) != entry.crc) {
+            out_error = {.code = IoErrorCode::checksum_mismatch};
+            return {};
+        }
+
+        return result;
+    }
+
+    // Converts an entry size to a stream size, which is -1 if it is not representable.
+    i64 get_stream_size_from_entry(u64 size)
+    {
+        if (size <= u64(std::numeric_limits<i64>::max()))
+            return i64(size);
+        else
+            return -1;
     }
 
 } // namespace
 
 constinit const std::error_category& geo::libzip_error_category = libzip_error_category_instance;
 
+//==================================================================================================
+// ZipArchive::HandlePool
+//==================================================================================================
+
+class ZipArchive::HandlePool {
+public:
+    HandlePool(const HandlePool&) = delete;
+    explicit HandlePool(const oschar_t* path) : path_{path}, async_path_{path} {}
+    explicit HandlePool(std::span<const u8> data, std::shared_ptr<const void> owner, const oschar_t* path)
+        : data_{data}, owner_{std::move(owner)}, async_path_{path ? path : OSSTR ""} {}
+    ~HandlePool();
+
+    HandlePool& operator=(const HandlePool&) = delete;
+
+    /// Takes an idle handle, or opens a new one if there are none.
+    zip_t* acquire(Error& out_error);
+
+    /// Gets the file for asynchronous reads, opening it on first use. Returns null if the archive
+    /// is held in memory without a path or the file can't be opened.
+    AsyncFile* get_async_file();
+
+    /// Closes all idle handles. Handles that are released afterward are discarded.
+    void close(Error& out_error);
+
+    /// Returns a handle to the pool.
+    void release(zip_t* zip);
+
+private:
+    const OsString path_{};
+    const std::span<const u8> data_{};
+    const std::shared_ptr<const void> owner_{}; // Keeps `data_` valid while handles read from it
+    const OsString async_path_{}; // File read by `async_file_`, which may also be mapped as `data_`
+    std::mutex mutex_;
+    std::vector<zip_t*> idle_;
+    bool closed_ = false;
+    std::once_flag async_file_once_;
+    std::unique_ptr<AsyncFile> async_file_;
+
+    zip_t* open_handle(Error& out_error) const;
+};
+
+ZipArchive::HandlePool::~HandlePool()
+{
+    for (zip_t* zip : idle_)
+        zip_discard(zip);
+}
+
+zip_t* ZipArchive::HandlePool::acquire(Error& out_error)
+{
+    {
+        std::lock_guard lock{mutex_};
+
+        if (!idle_.empty()) {
+            zip_t* zip = idle_.back();
+            idle_.pop_back();
+            return zip;
+        }
+    }
+
+    return open_handle(out_error);
+}
+
+AsyncFile* ZipArchive::HandlePool::get_async_file()
+{
+    std::call_once(async_file_once_, [this] {
+        Error error;
+
+        if (async_path_.empty())
+            return;
+
+        async_file_ = std::make_unique<AsyncFile>(async_path_.c_str(), error);
+
+        if (error) {
+            LOG_WARNING("Failed to open archive for asynchronous reads: {}", error);
+            async_file_.reset();
+        } else {
+            LOG_DEBUG("Asynchronous archive reads use {}", async_file_->get_backend_name());
+        }
+    });
+
+    return async_file_.get();
+}
+
+void ZipArchive::HandlePool::close(Error& out_error)
+{
+    std::lock_guard lock{mutex_};
+
+    for (zip_t* zip : idle_) {
+        if (zip_close(zip)) {
+            if (!out_error)
+                out_error = make_libzip_error("zip_close failed", zip_get_error(zip));
+            zip_discard(zip);
+        }
+    }
+
+    idle_.clear();
+    closed_ = true;
+}
+
+zip_t* ZipArchive::HandlePool::open_handle(Error& out_error) const
+{
+    // Capture libzip errors.
+    zip_error_t zerror;
+    zip_error_init(&zerror);
+    Finally free_zerror = [&] { zip_error_fini(&zerror); };
+
+    std::unique_ptr<zip_source_t, decltype(&zip_source_free)> source{nullptr, &zip_source_free};
+
+    if (!path_.empty()) {
+        // Open the underlying stream for reading.
+        std::unique_ptr<FILE, decltype(&fclose)> fp{nullptr, &fclose};
+
+#ifdef _WIN32
+        fp.reset(_wfopen(path_.c_str(), L"rb"));
+#else
+        fp.reset(fopen(path_.c_str(), "rb"));
+#endif
+
+        if (!fp) {
+            out_error = {.description = "fopen failed", .code = {errno, std::generic_category()}};
+            return nullptr;
+        }
+
+        // Create a zip source from the underlying stream.
+        source.reset(zip_source_filep_create(fp.get(), 0, ZIP_LENGTH_TO_END, &zerror));
+
+        if (!source) {
+            out_error = make_libzip_error("zip_source_filep_create failed", &zerror);
+            return nullptr;
+        }
+
+        fp.release(); // fp is now owned by source
+    } else {
+        // Create a zip source that reads directly from the buffer.
+        source.reset(zip_source_buffer_create(data_.data(), data_.size(), 0, &zerror));
+
+        if (!source) {
+            out_error = make_libzip_error("zip_source_buffer_create failed", &zerror);
+            return nullptr;
+        }
+    }
+
+    // Open the zip archive from the source.
+    zip_t* zip = zip_open_from_source(source.get(), ZIP_RDONLY, &zerror);
+
+    if (!zip) {
+        out_error = make_libzip_error("zip_open_from_source failed", &zerror);
+        return nullptr;
+    }
+
+    source.release(); // source is now owned by zip
+    return zip;
+}
+
+void ZipArchive::HandlePool::release(zip_t* zip)
+{
+    std::unique_lock lock{mutex_};
+
+    if (closed_) {
+        lock.unlock();
+        zip_discard(zip);
+    } else {
+        idle_.push_back(zip);
+    }
+}
+
 //==================================================================================================
 // ZipArchive
 //==================================================================================================
 
 ZipArchive::ZipArchive(ZipArchive&& other)
-    : zip_{other.zip_}
+    : pool_{std::move(other.pool_)}
+    , index_{std::move(other.index_)}
+    , dictionary_{std::move(other.dictionary_)}
 {
-    other.zip_ = nullptr;
 }
 
 ZipArchive::ZipArchive(const oschar_t* path, Error& out_error)
@@ -80,6 +328,11 @@ ZipArchive::ZipArchive(const oschar_t* path, Error& out_error)
     open(path, out_error);
 }
 
+ZipArchive::ZipArchive(std::span<const u8> data, Error& out_error)
+{
+    open(data, out_error);
+}
+
 ZipArchive::~ZipArchive()
 {
     close();
@@ -89,8 +342,9 @@ ZipArchive& ZipArchive::operator=(ZipArchive&& other)
 {
     if (&other != this) {
         close();
-        zip_ = other.zip_;
-        other.zip_ = nullptr;
+        pool_ = std::move(other.pool_);
+        index_ = std::move(other.index_);
+        dictionary_ = std::move(other.dictionary_);
     }
     return *this;
 }
@@ -107,61 +361,212 @@ void ZipArchive::close()
 
 void ZipArchive::close(Error& out_error)
 {
-    if (!zip_)
-        return;
+    index_.clear();
+    dictionary_.reset();
 
-    if (zip_close(zip_))
-        out_error = make_libzip_error("zip_close failed", zip_get_error(zip_));
+    if (!pool_)
+        return;
 
-    zip_ = nullptr;
+    // Handles leased by open streams are discarded when the streams are closed.
+    pool_->close(out_error);
+    pool_.reset();
 }
 
 bool ZipArchive::open(const oschar_t* path, Error& out_error)
 {
     close();
+    return open_pool(std::make_shared<HandlePool>(path), out_error);
+}
 
-    // Open the underlying stream for reading.
-    std::unique_ptr<FILE, decltype(&fclose)> fp{nullptr, &fclose};
+bool ZipArchive::open(std::span<const u8> data, Error& out_error)
+{
+    return open(data, nullptr, nullptr, out_error);
+}
 
-#ifdef _WIN32
-    fp.reset(_wfopen(path, L"rb"));
-#else
-    fp.reset(fopen(path, "rb"));
-#endif
+bool ZipArchive::open(std::span<const u8> data, std::shared_ptr<const void> owner, const oschar_t* path,
+                      Error& out_error)
+{
+    close();
+    return open_pool(std::make_shared<HandlePool>(data, std::move(owner), path), out_error);
+}
+
+bool ZipArchive::open_pool(std::shared_ptr<HandlePool>&& pool, Error& out_error)
+{
+    // Open the first handle now so that errors are reported by open().
+    zip_t* zip = pool->acquire(out_error);
 
-    if (!fp) {
-        out_error = {.description = "fopen failed", .code = {errno, std::generic_category()}};
+    if (!zip)
+        return false;
+
+    pool->release(zip);
+    pool_ = std::move(pool);
+    load_index();
+    load_dictionary();
+    return true;
+}
+
+std::unique_ptr<Decoder> ZipArchive::create_decoder(u16 method) const
+{
+    return make_decoder(method, dictionary_);
+}
+
+bool ZipArchive::find_entry(const char* name, ZipIndexEntry& out_entry, Error& out_error)
+{
+    if (!pool_) {
+        out_error = {.code = IoErrorCode::archive_closed};
         return false;
     }
 
-    // Capture libzip errors.
-    zip_error_t zerror;
-    zip_error_init(&zerror);
-    Finally free_zerror = [&] { zip_error_fini(&zerror); };
+    // The index is immutable once loaded, so it can be searched from any thread.
+    if (!index_.empty()) {
+        const ZipIndexEntry* entry = index_.find(name);
 
-    // Create a zip source from the underlying stream.
-    std::unique_ptr<zip_source_t, decltype(&zip_source_free)> source{nullptr, &zip_source_free};
-    source.reset(zip_source_filep_create(fp.get(), 0, ZIP_LENGTH_TO_END, &zerror));
+        if (!entry) {
+            out_error = {.code = IoErrorCode::not_found};
+            return false;
+        }
+
+        out_entry = *entry;
+        return true;
+    }
+
+    // Otherwise, look up the entry using a leased handle.
+    zip_t* zip = pool_->acquire(out_error);
 
-    if (!source) {
-        out_error = make_libzip_error("zip_source_filep_create failed", &zerror);
+    if (!zip)
+        return false;
+
+    Finally release_zip = [&] { pool_->release(zip); };
+
+    // Get the entry index.
+    i64 index = zip_name_locate(zip, name, 0);
+
+    if (index < 0) {
+        out_error = {.code = IoErrorCode::not_found};
         return false;
     }
 
-    fp.release(); // fp is now owned by source
+    // Get the entry's sizes and compression method.
+    constexpr u64 required_fields = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC;
+    zip_stat_t stat;
 
-    // Open the zip archive from the source.
-    zip_ = zip_open_from_source(source.get(), ZIP_RDONLY, &zerror);
+    if (zip_stat_index(zip, u64(index), 0, &stat)) {
+        out_error = make_libzip_error("zip_stat_index failed", zip_get_error(zip));
+        return false;
+    } else if ((stat.valid & required_fields) != required_fields) {
+        out_error = {.description = "Incomplete archive entry information", .code = IoErrorCode::invalid_archive};
+        return false;
+    }
 
-    if (!zip_) {
-        out_error = make_libzip_error("zip_open_from_source failed", &zerror);
+    out_entry = {
+        .name = name,
+        .index = u32(index),
+        .method = stat.comp_method,
+        .crc = stat.crc,
+        .compressed_size = stat.comp_size,
+        .size = stat.size,
+    };
+    return true;
+}
+
+bool ZipArchive::get_stream_names(std::vector<std::string>& out_names, Error& out_error)
+{
+    if (!pool_) {
+        out_error = {.code = IoErrorCode::archive_closed};
         return false;
     }
 
-    source.release(); // source is now owned by zip_
+    zip_t* zip = pool_->acquire(out_error);
+
+    if (!zip)
+        return false;
+
+    Finally release_zip = [&] { pool_->release(zip); };
+    i64 num_entries = zip_get_num_entries(zip, 0);
+
+    for (i64 i = 0; i < num_entries; ++i) {
+        const char* name = zip_get_name(zip, u64(i), 0);
+
+        if (!name) {
+            out_error = make_libzip_error("zip_get_name failed", zip_get_error(zip));
+            return false;
+        } else if (ZipDirectory::is_stream_name(name)) {
+            out_names.emplace_back(name);
+        }
+    }
+
     return true;
 }
 
+i64 ZipArchive::get_stream_size(const char* name, Error& out_error)
+{
+    ZipIndexEntry entry;
+
+    if (!find_entry(name, entry, out_error))
+        return -1;
+
+    i64 size = get_stream_size_from_entry(entry.size);
+
+    if (size < 0)
+        out_error = {.code = IoErrorCode::stream_size_undefined};
+
+    return size;
+}
+
+u64 ZipArchive::get_stream_content_id(const char* name)
+{
+    // Header offsets are only known through the index. Names of a deduplicated entry share its
+    // local header.
+    const ZipIndexEntry* entry = index_.empty() ? nullptr : index_.find(name);
+    return entry ? entry->header_offset + 1 : 0;
+}
+
+void ZipArchive::load_dictionary()
+{
+    Error error;
+
+    // Entries compressed with the dictionary fail to open if it can't be loaded, but other entries
+    // remain readable.
+    if (get_stream_size(zstd_dictionary_name, error) < 0) {
+        if (!error.matches(IoErrorCode::not_found))
+            LOG_WARNING("Failed to load Zstandard dictionary: {}", error);
+        return;
+    }
+
+    std::vector<u8> data = read_stream_bytes(zstd_dictionary_name, std::numeric_limits<u32>::max(), error);
+
+    if (!error)
+        dictionary_ = ZstdDictionary::load(data, error);
+
+    if (error)
+        LOG_WARNING("Failed to load Zstandard dictionary: {}", error);
+}
+
+void ZipArchive::load_index()
+{
+    Error error;
+    zip_t* zip = pool_->acquire(error);
+
+    if (!zip) {
+        LOG_WARNING("Failed to load archive index: {}", error);
+        return;
+    }
+
+    i64 index = zip_name_locate(zip, ZipIndex::entry_name, 0);
+    i64 num_entries = zip_get_num_entries(zip, 0);
+
+    pool_->release(zip);
+
+    if (index < 0 || num_entries < 0)
+        return;
+
+    // The index is read through libzip since it can't be used to look up itself.
+    std::vector<u8> data = read_stream_bytes(ZipIndex::entry_name, std::numeric_limits<u32>::max(), error);
+
+    if (error || !index_.load(std::move(data), u64(num_entries), error))
+        LOG_WARNING("Ignoring invalid archive index: {}", error);
+}
+
 std::unique_ptr<Stream> ZipArchive::open_stream(const char* name, Error& out_error)
 {
     ZipStream stream{*this, name, out_error};
@@ -172,14 +577,135 @@ std::unique_ptr<Stream> ZipArchive::open_stream(const char* name, Error& out_err
         return {};
 }
 
+void ZipArchive::prefetch(std::span<const std::string> names)
+{
+    AsyncFile* file = pool_ && !index_.empty() ? pool_->get_async_file() : nullptr;
+
+    if (!file) {
+        LOG_ONCE(debug, "Ignoring prefetch hint for archive without an index or file");
+        return;
+    }
+
+    for (const std::string& name : names) {
+        if (const ZipIndexEntry* entry = index_.find(name))
+            file->prefetch(entry->data_offset, entry->compressed_size);
+    }
+}
+
+bool ZipArchive::read_raw_entry(const char* name, ZipRawEntry& out_entry, Error& out_error)
+{
+    ZipIndexEntry entry;
+
+    if (!find_entry(name, entry, out_error))
+        return false;
+
+    if (entry.method != zip_method::store && !can_decode(entry.method, dictionary_)) {
+        out_error = {.description = "Entry can't be decoded from raw data",
+                     .code = std::make_error_code(std::errc::not_supported)};
+        return false;
+    } else if (entry.compressed_size > std::numeric_limits<size_t>::max()) {
+        out_error = {.code = IoErrorCode::stream_too_long};
+        return false;
+    }
+
+    zip_t* zip = pool_->acquire(out_error);
+
+    if (!zip)
+        return false;
+
+    Finally release_zip = [&] { pool_->release(zip); };
+    zip_file_t* zfp = zip_fopen_index(zip, entry.index, ZIP_FL_COMPRESSED);
+
+    if (!zfp) {
+        out_error = make_libzip_error("zip_fopen_index failed", zip_get_error(zip));
+        return false;
+    }
+
+    std::vector<u8> data(size_t(entry.compressed_size));
+    i64 result = zip_fread(zfp, data.data(), data.size());
+
+    if (result < 0)
+        out_error = make_libzip_error("zip_fread failed", zip_file_get_error(zfp));
+    else if (u64(result) != data.size())
+        out_error = {.code = IoErrorCode::end_of_stream};
+
+    zip_fclose(zfp);
+
+    if (out_error)
+        return false;
+
+    out_entry = {.data = std::move(data), .method = entry.method, .crc = entry.crc, .size = entry.size};
+    return true;
+}
+
+bool ZipArchive::read_streams_async(std::span<const std::string> names, size_t max_size,
+                                    ReadStreamsCallback callback)
+{
+    AsyncFile* file = pool_ && !index_.empty() ? pool_->get_async_file() : nullptr;
+
+    if (!file)
+        return false;
+
+    std::vector<const ZipIndexEntry*> entries(names.size());
+
+    // Entries that aren't indexed or can't be decoded here would have to be read through libzip on
+    // this thread, so the caller reads the batch on its own threads instead.
+    for (size_t i = 0; i < names.size(); ++i) {
+        entries[i] = index_.find(names[i]);
+
+        if (!entries[i] || (entries[i]->method != zip_method::store && !can_decode(entries[i]->method, dictionary_)))
+            return false;
+    }
+
+    auto shared_callback = std::make_shared<ReadStreamsCallback>(std::move(callback));
+    std::vector<AsyncReadRequest> requests;
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        const ZipIndexEntry* entry = entries[i];
+        Error error;
+        u64 read_size = entry->compressed_size;
+
+        if (entry->size > max_size || read_size > std::numeric_limits<size_t>::max()) {
+            error = {.code = IoErrorCode::stream_too_long};
+            (*shared_callback)(i, {}, error);
+            continue;
+        }
+
+        u8* buffer = new u8[read_size];
+
+        requests.push_back({
+            .offset = entry->data_offset,
+            .buffer = {buffer, size_t(read_size)},
+            .callback = [shared_callback, i, entry = *entry, buffer, dictionary = dictionary_](size_t size, Error& error) {
+                ByteBuffer data;
+
+                // The entry's name is not used since the index may be closed by now.
+                if (error)
+                    delete[] buffer;
+                else
+                    data = decode_raw_entry(entry, buffer, size, dictionary, error);
+
+                (*shared_callback)(i, std::move(data), error);
+            },
+        });
+    }
+
+    file->submit(std::move(requests));
+    return true;
+}
+
 //==================================================================================================
 // ZipStream
 //==================================================================================================
 
 ZipStream::ZipStream(ZipStream&& other)
-    : zfp_{other.zfp_}
+    : pool_{std::move(other.pool_)}
+    , zip_{other.zip_}
+    , zfp_{other.zfp_}
+    , decoder_{std::move(other.decoder_)}
     , size_{other.size_}
 {
+    other.zip_ = nullptr;
     other.zfp_ = nullptr;
     other.size_ = -1;
 }
@@ -198,7 +724,10 @@ ZipStream& ZipStream::operator=(ZipStream&& other)
 {
     if (&other != this) {
         close();
+        std::swap(pool_, other.pool_);
+        std::swap(zip_, other.zip_);
         std::swap(zfp_, other.zfp_);
+        std::swap(decoder_, other.decoder_);
         std::swap(size_, other.size_);
     }
     return *this;
@@ -208,36 +737,59 @@ bool ZipStream::open(ZipArchive& archive, const char* name, Error& out_error)
 {
     close();
 
-    if (!archive.is_open()) {
-        out_error = {.code = IoErrorCode::archive_closed};
+    ZipIndexEntry entry;
+
+    if (!archive.find_entry(name, entry, out_error))
         return false;
-    }
 
-    // Get the entry index.
-    i64 index = zip_name_locate(archive.zip_, name, 0);
+    i64 size = get_stream_size_from_entry(entry.size);
 
-    if (index < 0) {
-        out_error = {.code = IoErrorCode::not_found};
+    // Decode Zstandard entries ourselves so seeking can use frame checkpoints. libzip doesn't know
+    // about our private methods, so it couldn't decode them anyway.
+    std::unique_ptr<Decoder> decoder = make_decoder(entry.method, archive.dictionary_);
+
+    if (!decoder && entry.method == zip_method::zstd_dict) {
+        out_error = {.description = "Missing Zstandard dictionary", .code = IoErrorCode::invalid_archive};
         return false;
     }
 
-    // Open the underlying stream.
-    zfp_ = zip_fopen_index(archive.zip_, u64(index), 0);
+    if (decoder) {
+        auto raw = std::make_unique<ZipStream>();
 
-    if (!zfp_) {
-        out_error = make_libzip_error("zip_fopen_index failed", zip_get_error(archive.zip_));
-        return false;
+        if (!raw->open_index(archive, entry.index, ZIP_FL_COMPRESSED,
+                             get_stream_size_from_entry(entry.compressed_size), out_error))
+        {
+            return false;
+        }
+
+        decoder_ = std::make_unique<DecoderStream>(std::move(raw), std::move(decoder), size);
+        decoder_->set_expected_crc(entry.crc);
+        size_ = size;
+        return true;
     }
 
-    // Try to get the stream size.
-    zip_stat_t stat;
+    return open_index(archive, entry.index, 0, size, out_error);
+}
 
-    if (zip_stat_index(archive.zip_, u64(index), ZIP_STAT_SIZE, &stat) == 0
-        && stat.size <= u64(std::numeric_limits<i64>::max()))
-    {
-        size_ = i64(stat.size);
+bool ZipStream::open_index(ZipArchive& archive, u64 index, u32 flags, i64 size, Error& out_error)
+{
+    // Lease a handle for the lifetime of the stream.
+    zip_t* zip = archive.pool_->acquire(out_error);
+
+    if (!zip)
+        return false;
+
+    zfp_ = zip_fopen_index(zip, index, flags);
+
+    if (!zfp_) {
+        out_error = make_libzip_error("zip_fopen_index failed", zip_get_error(zip));
+        archive.pool_->release(zip);
+        return false;
     }
 
+    pool_ = archive.pool_;
+    zip_ = zip;
+    size_ = size;
     return true;
 }
 
@@ -245,6 +797,12 @@ void ZipStream::close(Error& out_error)
 {
     int zerr;
 
+    if (decoder_) {
+        decoder_->close(out_error);
+        decoder_.reset();
+        size_ = -1;
+    }
+
     if (!zfp_)
         return;
 
@@ -256,6 +814,28 @@ void ZipStream::close(Error& out_error)
 
     if (zerr)
         out_error = make_libzip_error("zip_fclose failed", zerr, errno);
+
+    pool_->release(zip_);
+    pool_.reset();
+    zip_ = nullptr;
+}
+
+i64 ZipStream::get_position(Error& out_error) const
+{
+    if (decoder_)
+        return decoder_->get_position(out_error);
+
+    if (!zfp_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    }
+
+    i64 result = zip_ftell(zfp_);
+
+    if (result < 0)
+        out_error = make_libzip_error("zip_ftell failed", zip_file_get_error(zfp_));
+
+    return result;
 }
 
 i64 ZipStream::get_size(Error& out_error) const
@@ -268,8 +848,19 @@ i64 ZipStream::get_size(Error& out_error) const
     }
 }
 
+bool ZipStream::is_seekable() const
+{
+    if (decoder_)
+        return decoder_->is_seekable();
+    else
+        return zfp_ && zip_file_is_seekable(zfp_) > 0;
+}
+
 size_t ZipStream::read_partial(void* dst, size_t size, Error& out_error)
 {
+    if (decoder_)
+        return decoder_->read_partial(dst, size, out_error);
+
     if (!zfp_) {
         out_error = {.code = IoErrorCode::stream_closed};
         return 0;
@@ -284,3 +875,32 @@ size_t ZipStream::read_partial(void* dst, size_t size, Error& out_error)
 
     return size_t(result);
 }
+
+i64 ZipStream::seek(i64 offset, SeekOrigin origin, Error& out_error)
+{
+    int whence;
+
+    if (decoder_)
+        return decoder_->seek(offset, origin, out_error);
+
+    if (!zfp_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return -1;
+    }
+
+    switch (origin) {
+        case SeekOrigin::set: whence = SEEK_SET; break;
+        case SeekOrigin::current: whence = SEEK_CUR; break;
+        case SeekOrigin::end: whence = SEEK_END; break;
+        default:
+            out_error = {.code = std::make_error_code(std::errc::invalid_argument)};
+            return -1;
+    }
+
+    if (zip_fseek(zfp_, offset, whence)) {
+        out_error = make_libzip_error("zip_fseek failed", zip_file_get_error(zfp_));
+        return -1;
+    }
+
+    return get_position(out_error);
+}
@@ -9,14 +9,33 @@
 #ifndef IO_ZIP_H_INCLUDED
 #define IO_ZIP_H_INCLUDED
 
-#include "stream.h"
+#include "decoder.h"
+#include "zip_directory.h"
+#include "zip_index.h"
 
 struct zip;
 struct zip_file;
 
 namespace geo {
 
-    /// Reads entries from a ZIP archive.
+    class ZstdDictionary;
+
+    /// Raw (possibly compressed) data of a ZIP archive entry, read without decoding it.
+    struct ZipRawEntry {
+        std::vector<u8> data{};
+        u16 method = zip_method::store;
+        u32 crc = 0; ///< CRC-32 of the decoded data
+        u64 size = 0; ///< Size of the decoded data
+    };
+
+    /// Reads entries from a ZIP archive. If the archive contains a @ref ZipIndex, it is loaded when
+    /// the archive is opened and used to look up entries instead of libzip. Likewise, the
+    /// dictionary used by @ref zip_method::zstd_dict entries is loaded when the archive is opened.
+    ///
+    /// `open_stream` may be called concurrently from multiple threads. Since a libzip handle can't
+    /// be shared between threads, each open stream leases its own handle from a pool, which opens
+    /// additional handles to the same file or memory as needed. Handles are returned to the pool
+    /// when streams are closed, and streams may outlive the archive object.
     class ZipArchive : public StreamProvider {
         friend class ZipStream;
 
@@ -25,22 +44,73 @@ namespace geo {
         ZipArchive(const ZipArchive&) = delete;
         ZipArchive(ZipArchive&& other);
         explicit ZipArchive(const oschar_t* path, Error& out_error);
+        explicit ZipArchive(std::span<const u8> data, Error& out_error);
         ~ZipArchive();
 
         ZipArchive& operator=(ZipArchive&& other);
 
         void close();
         void close(Error& out_error);
-        bool is_open() const { return zip_ != nullptr; }
+        bool is_open() const { return pool_ != nullptr; }
         bool open(const oschar_t* path, Error& out_error);
 
+        /// Opens an archive that is held in memory. The memory is not copied and must outlive the
+        /// archive and its streams.
+        bool open(std::span<const u8> data, Error& out_error);
+
+        /// Opens an archive that is held in memory owned by `owner`, e.g., a memory mapping. The
+        /// archive's handle pool holds a reference to `owner`, so the memory stays valid for as long
+        /// as any stream opened from the archive. If `path` isn't null, it names the file that
+        /// `data` was mapped from, which @ref read_streams_async reads with @ref AsyncFile.
+        bool open(std::span<const u8> data, std::shared_ptr<const void> owner, const oschar_t* path,
+                  Error& out_error);
+
+        /// Creates a decoder for entries compressed with `method`, using the archive's dictionary
+        /// if needed. Returns null for stored entries, for methods that only libzip can decode, and
+        /// for dictionary entries if the archive has no dictionary.
+        std::unique_ptr<Decoder> create_decoder(u16 method) const;
+
+        /// Reads an entry's raw data without decoding it. Sets `out_error` to
+        /// `std::errc::not_supported` if the entry is neither stored nor decodable by
+        /// @ref create_decoder.
+        bool read_raw_entry(const char* name, ZipRawEntry& out_entry, Error& out_error);
+
+        bool get_stream_names(std::vector<std::string>& out_names, Error& out_error) override;
+        i64 get_stream_size(const char* name, Error& out_error) override;
+        u64 get_stream_content_id(const char* name) override;
         std::unique_ptr<Stream> open_stream(const char* name, Error& out_error) override;
 
+        /// Asks the OS to read the entries' byte ranges of the file ahead. Only supported for
+        /// archives opened from a file with an index, since libzip doesn't expose the entries'
+        /// offsets. Otherwise, this does nothing.
+        void prefetch(std::span<const std::string> names) override;
+
+        /// Reads the raw data of stored, Zstandard, and LZ4 entries with @ref AsyncFile, and decodes
+        /// them on its worker threads. Only supported for archives with an index that were opened
+        /// from a file, or from a mapping of one whose path was given, and for batches whose entries
+        /// are all indexed and use one of those methods.
+        bool read_streams_async(std::span<const std::string> names, size_t max_size,
+                                ReadStreamsCallback callback) override;
+
     private:
-        struct ::zip* zip_ = nullptr;
+        class HandlePool;
+
+        std::shared_ptr<HandlePool> pool_;
+        ZipIndex index_;
+        std::shared_ptr<const ZstdDictionary> dictionary_;
+
+        // Looks up an entry in the index, or through libzip if the archive has no index.
+        bool find_entry(const char* name, ZipIndexEntry& out_entry, Error& out_error);
+
+        void load_dictionary();
+        void load_index();
+        bool open_pool(std::shared_ptr<HandlePool>&& pool, Error& out_error);
     };
 
-    /// Reads data from a ZIP archive entry.
+    /// Reads data from a ZIP archive entry. Stored entries can be seeked in constant time.
+    /// Zstandard and LZ4 entries are decoded by @ref DecoderStream rather than libzip so that
+    /// seeking can restart at the nearest frame boundary. Other compressed entries rely on libzip
+    /// for seeking, which may decode the entry from the start.
     class ZipStream : public Stream {
     public:
         using Stream::close;
@@ -56,14 +126,23 @@ namespace geo {
         bool open(ZipArchive& archive, const char* name, Error& out_error);
 
         void close(Error& out_error) override;
+        i64 get_position(Error& out_error) const override;
         i64 get_size(Error& out_error) const override;
-        bool is_open() const override { return zfp_ != nullptr; }
+        bool is_open() const override { return zfp_ != nullptr || decoder_ != nullptr; }
         bool is_readable() const override { return true; }
+        bool is_seekable() const override;
         size_t read_partial(void* dst, size_t size, Error& out_error) override;
+        i64 seek(i64 offset, SeekOrigin origin, Error& out_error) override;
 
     private:
+        std::shared_ptr<ZipArchive::HandlePool> pool_{};
+        struct ::zip* zip_ = nullptr; // Leased from `pool_`
         struct ::zip_file* zfp_ = nullptr;
+        std::unique_ptr<DecoderStream> decoder_{};
         i64 size_ = -1;
+
+        // Opens an entry by index. If `flags` contains `ZIP_FL_COMPRESSED`, the raw data is read.
+        bool open_index(ZipArchive& archive, u64 index, u32 flags, i64 size, Error& out_error);
     };
 
     /// Error category corresponding to libzip error codes.
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+
+#include <core/endian.h>
+
+#include "crc32.h"
+#include "zip_directory.h"
+
+using namespace geo;
+
+namespace {
+
+    // Record signatures
+    constexpr u32 local_header_signature = 0x04034b50;
+    constexpr u32 central_header_signature = 0x02014b50;
+    constexpr u32 eocd_signature = 0x06054b50;
+    constexpr u32 eocd64_signature = 0x06064b50;
+    constexpr u32 eocd64_locator_signature = 0x07064b50;
+
+    // Fixed record sizes
+    constexpr size_t local_header_size = 30;
+    constexpr size_t central_header_size = 46;
+    constexpr size_t eocd_size = 22;
+    constexpr size_t eocd64_size = 56;
+    constexpr size_t eocd64_locator_size = 20;
+
+    constexpr u16 zip64_extra_id = 0x0001;
+
+    Error make_invalid_archive_error(ErrorDescription description)
+    {
+        return {.description = std::move(description), .code = IoErrorCode::invalid_archive};
+    }
+
+    // Finds the end of central directory record. Returns its offset, or -1 if it isn't found.
+    i64 find_eocd(std::span<const u8> archive)
+    {
+        if (archive.size() < eocd_size)
+            return -1;
+
+        // The record is followed by a variable-length comment of up to 65535 bytes.
+        size_t pos = archive.size() - eocd_size;
+        size_t min_pos = pos > 0xffff ? pos - 0xffff : 0;
+
+        for (;;) {
+            if (endian::load_le32(&archive[pos]) == eocd_signature
+                && pos + eocd_size + endian::load_le16(&archive[pos + 20]) == archive.size())
+            {
+                return i64(pos);
+            } else if (pos == min_pos) {
+                return -1;
+            }
+
+            --pos;
+        }
+    }
+
+    // Replaces saturated 32-bit fields with the values from a ZIP64 extended information field.
+    bool read_zip64_extra(std::span<const u8> extra, ZipDirectoryEntry& entry)
+    {
+        while (extra.size() >= 4) {
+            u16 id = endian::load_le16(&extra[0]);
+            u16 len = endian::load_le16(&extra[2]);
+
+            if (size_t(len) + 4 > extra.size())
+                return false;
+
+            if (id == zip64_extra_id) {
+                std::span<const u8> field = extra.subspan(4, len);
+                u64* values[] = {&entry.size, &entry.compressed_size, &entry.header_offset};
+
+                for (u64* value : values) {
+                    if (*value != 0xffffffff)
+                        continue;
+                    else if (field.size() < 8)
+                        return false;
+
+                    *value = endian::load_le64(field.data());
+                    field = field.subspan(8);
+                }
+
+                return true;
+            }
+
+            extra = extra.subspan(size_t(len) + 4);
+        }
+
+        return true;
+    }
+
+} // namespace
+
+void ZipDirectory::clear()
+{
+    names_.clear();
+    entries_.clear();
+    crc_ = 0;
+}
+
+const ZipDirectoryEntry* ZipDirectory::find(std::string_view name) const
+{
+    auto it = names_.find(name);
+
+    if (it == names_.end())
+        return nullptr;
+    else
+        return &entries_[it->second];
+}
+
+bool ZipDirectory::parse(std::span<const u8> archive, Error& out_error)
+{
+    clear();
+
+    // Find the end of central directory record.
+    i64 eocd_pos = find_eocd(archive);
+
+    if (eocd_pos < 0) {
+        out_error = make_invalid_archive_error("Missing end of central directory record");
+        return false;
+    }
+
+    const u8* eocd = &archive[size_t(eocd_pos)];
+    u64 num_entries = endian::load_le16(eocd + 10);
+    u64 cd_size = endian::load_le32(eocd + 12);
+    u64 cd_offset = endian::load_le32(eocd + 16);
+
+    // Use the ZIP64 end of central directory record if any of the fields are saturated.
+    if (num_entries == 0xffff || cd_size == 0xffffffff || cd_offset == 0xffffffff) {
+        if (u64(eocd_pos) < eocd64_locator_size
+            || endian::load_le32(eocd - eocd64_locator_size) != eocd64_locator_signature)
+        {
+            out_error = make_invalid_archive_error("Missing ZIP64 end of central directory locator");
+            return false;
+        }
+
+        u64 eocd64_pos = endian::load_le64(eocd - eocd64_locator_size + 8);
+
+        if (archive.size() < eocd64_size || eocd64_pos > archive.size() - eocd64_size
+            || endian::load_le32(&archive[eocd64_pos]) != eocd64_signature)
+        {
+            out_error = make_invalid_archive_error("Invalid ZIP64 end of central directory record");
+            return false;
+        }
+
+        num_entries = endian::load_le64(&archive[eocd64_pos + 32]);
+        cd_size = endian::load_le64(&archive[eocd64_pos + 40]);
+        cd_offset = endian::load_le64(&archive[eocd64_pos + 48]);
+    }
+
+    if (cd_offset > archive.size() || cd_size > archive.size() - cd_offset) {
+        out_error = make_invalid_archive_error("Central directory is out of bounds");
+        return false;
+    }
+
+    // Read the central directory file headers.
+    std::span<const u8> cd = archive.subspan(cd_offset, cd_size);
+    u32 crc = crc32::update(0, cd);
+
+    entries_.reserve(num_entries < cd_size / central_header_size ? num_entries : cd_size / central_header_size);
+
+    for (u64 i = 0; i < num_entries; ++i) {
+        if (cd.size() < central_header_size || endian::load_le32(cd.data()) != central_header_signature) {
+            clear();
+            out_error = make_invalid_archive_error("Invalid central directory file header");
+            return false;
+        }
+
+        size_t name_len = endian::load_le16(&cd[28]);
+        size_t extra_len = endian::load_le16(&cd[30]);
+        size_t comment_len = endian::load_le16(&cd[32]);
+        size_t record_size = central_header_size + name_len + extra_len + comment_len;
+
+        if (record_size > cd.size()) {
+            clear();
+            out_error = make_invalid_archive_error("Central directory file header is truncated");
+            return false;
+        }
+
+        ZipDirectoryEntry& entry = entries_.emplace_back();
+        entry.name.assign(reinterpret_cast<const char*>(&cd[central_header_size]), name_len);
+        entry.method = endian::load_le16(&cd[10]);
+        entry.crc = endian::load_le32(&cd[16]);
+        entry.compressed_size = endian::load_le32(&cd[20]);
+        entry.size = endian::load_le32(&cd[24]);
+        entry.header_offset = endian::load_le32(&cd[42]);
+
+        if (!read_zip64_extra(cd.subspan(central_header_size + name_len, extra_len), entry)) {
+            clear();
+            out_error = make_invalid_archive_error("Invalid ZIP64 extended information field");
+            return false;
+        }
+
+        cd = cd.subspan(record_size);
+    }
+
+    // Index the entries by name. This is done after all entries are added so the views remain
+    // valid. If a name is duplicated, the first entry wins, which matches libzip.
+    names_.reserve(entries_.size());
+
+    for (size_t i = 0; i < entries_.size(); ++i)
+        names_.emplace(entries_[i].name, i);
+
+    crc_ = crc;
+    return true;
+}
+
+std::span<const u8> ZipDirectory::get_data(std::span<const u8> archive, const ZipDirectoryEntry& entry,
+                                           Error& out_error)
+{
+    if (entry.header_offset > archive.size()
+        || archive.size() - entry.header_offset < local_header_size
+        || endian::load_le32(&archive[entry.header_offset]) != local_header_signature)
+    {
+        out_error = make_invalid_archive_error("Invalid local file header");
+        return {};
+    }
+
+    const u8* header = &archive[entry.header_offset];
+    u64 data_offset = entry.header_offset + local_header_size + endian::load_le16(header + 26)
+                      + endian::load_le16(header + 28);
+
+    if (data_offset > archive.size() || entry.compressed_size > archive.size() - data_offset) {
+        out_error = make_invalid_archive_error("Entry data is out of bounds");
+        return {};
+    }
+
+    return archive.subspan(data_offset, entry.compressed_size);
+}
+
+std::span<const u8> ZipDirectory::get_raw_range(std::span<const u8> archive, const ZipDirectoryEntry& entry)
+{
+    if (entry.header_offset >= archive.size())
+        return {};
+
+    u64 size = local_header_size + entry.name.size() + entry.compressed_size;
+    return archive.subspan(size_t(entry.header_offset), size_t(std::min<u64>(size, archive.size() - entry.header_offset)));
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_ZIP_DIRECTORY_H_INCLUDED
+#define IO_ZIP_DIRECTORY_H_INCLUDED
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "error.h"
+
+namespace geo {
+
+    /// ZIP compression method IDs.
+    namespace zip_method {
+
+        inline constexpr u16 store = 0;
+        inline constexpr u16 deflate = 8;
+        inline constexpr u16 zstd = 93;
+
+        /// Private method for Zstandard frames compressed with the archive's shared dictionary,
+        /// which is stored in the entry named @ref zstd_dictionary_name. Only our own readers can
+        /// decode these entries.
+        inline constexpr u16 zstd_dict = 0xfd01;
+
+        /// Private method for a sequence of LZ4 frames.
+        inline constexpr u16 lz4 = 0xfd02;
+
+    } // namespace zip_method
+
+    /// Name of the archive entry containing the dictionary for @ref zip_method::zstd_dict entries.
+    inline constexpr const char* zstd_dictionary_name = ".geo/zstd-dictionary";
+
+    /// Central directory record of a ZIP archive entry.
+    struct ZipDirectoryEntry {
+        std::string name{};
+        u16 method = 0;
+        u32 crc = 0;
+        u64 compressed_size = 0;
+        u64 size = 0;
+        u64 header_offset = 0;
+        u64 data_offset = 0; // Only known for entries added by ZipWriter
+    };
+
+    /// Central directory of a ZIP archive that is held in memory. This is used where libzip's
+    /// accessors are insufficient, e.g., to locate an entry's raw data within a memory mapping.
+    class ZipDirectory {
+    public:
+        ZipDirectory() = default;
+        ZipDirectory(const ZipDirectory&) = delete;
+        ZipDirectory(ZipDirectory&& other) = default;
+
+        ZipDirectory& operator=(ZipDirectory&& other) = default;
+
+        void clear();
+        const std::vector<ZipDirectoryEntry>& entries() const { return entries_; }
+        const ZipDirectoryEntry* find(std::string_view name) const;
+
+        /// Gets the CRC-32 of the raw central directory, which identifies the archive's contents.
+        u32 get_crc() const { return crc_; }
+
+        /// Parses the central directory of the archive contained in `archive`.
+        bool parse(std::span<const u8> archive, Error& out_error);
+
+        /// Indicates whether an entry name refers to a stream, rather than a directory or archive
+        /// metadata stored under `.geo/`.
+        static bool is_stream_name(std::string_view name)
+        {
+            return !name.empty() && !name.ends_with('/') && !name.starts_with(".geo/");
+        }
+
+        /// Gets the entry's raw (possibly compressed) data within `archive` by reading its local
+        /// file header.
+        static std::span<const u8> get_data(std::span<const u8> archive, const ZipDirectoryEntry& entry,
+                                            Error& out_error);
+
+        /// Estimates the range of `archive` containing the entry's local file header and data
+        /// without reading the header, e.g., to prefetch it. The range assumes the header has no
+        /// extra field and is clamped to the archive.
+        static std::span<const u8> get_raw_range(std::span<const u8> archive, const ZipDirectoryEntry& entry);
+
+    private:
+        std::vector<ZipDirectoryEntry> entries_;
+        std::unordered_map<std::string_view, size_t> names_;
+        u32 crc_ = 0;
+    };
+
+} // namespace geo
+
+#endif // IO_ZIP_DIRECTORY_H_INCLUDED
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <numeric>
+
+#include <core/endian.h>
+
+#include "zip_index.h"
+
+using namespace geo;
+
+namespace {
+
+    constexpr u32 index_magic = 0x58444947; // "GIDX"
+    constexpr u16 index_version = 2;
+    constexpr size_t header_size = 16;
+    constexpr size_t record_size = 48;
+    constexpr size_t bucket_size = 4; // Average number of entries per bucket when building
+    constexpr u32 max_displacement = 1 << 24;
+
+    Error make_invalid_index_error(ErrorDescription description)
+    {
+        return {.description = std::move(description), .code = IoErrorCode::invalid_archive};
+    }
+
+    // Finalizer from SplitMix64. Spreads the FNV-1a hash over all bits.
+    constexpr u64 mix(u64 x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccd;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53;
+        x ^= x >> 33;
+        return x;
+    }
+
+    constexpr u64 get_bucket(u64 hash, u64 num_buckets)
+    {
+        return mix(hash) % num_buckets;
+    }
+
+    constexpr u64 get_slot(u64 hash, u32 displacement, u64 num_slots)
+    {
+        return mix(hash + (u64(displacement) + 1) * 0x9e3779b97f4a7c15) % num_slots;
+    }
+
+} // namespace
+
+bool ZipIndex::build(std::span<const ZipIndexEntry> entries, std::vector<u8>& out_data, Error& out_error)
+{
+    size_t num_entries = entries.size();
+    size_t num_buckets = std::max<size_t>(1, (num_entries + bucket_size - 1) / bucket_size);
+    std::vector<u64> hashes(num_entries);
+    std::vector<std::vector<u32>> buckets(num_buckets);
+
+    for (size_t i = 0; i < num_entries; ++i) {
+        hashes[i] = hash(entries[i].name);
+        buckets[get_bucket(hashes[i], num_buckets)].push_back(u32(i));
+    }
+
+    // Place the largest buckets first, while there are still many free slots.
+    std::vector<u32> order(num_buckets);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) { return buckets[a].size() > buckets[b].size(); });
+
+    constexpr u32 free_slot = 0xFFFFFFFF;
+    std::vector<u32> displacements(num_buckets);
+    std::vector<u32> slots(num_entries, free_slot);
+    std::vector<u64> candidates;
+
+    for (u32 bucket : order) {
+        if (buckets[bucket].empty())
+            break;
+
+        u32 displacement = 0;
+
+        for (;; ++displacement) {
+            if (displacement == max_displacement) {
+                out_error = make_invalid_index_error("Failed to build archive index (duplicate names?)");
+                return false;
+            }
+
+            candidates.clear();
+
+            for (u32 i : buckets[bucket]) {
+                u64 slot = get_slot(hashes[i], displacement, num_entries);
+
+                if (slots[slot] != free_slot || std::find(candidates.begin(), candidates.end(), slot) != candidates.end())
+                    break;
+
+                candidates.push_back(slot);
+            }
+
+            if (candidates.size() == buckets[bucket].size())
+                break;
+        }
+
+        displacements[bucket] = displacement;
+
+        for (size_t i = 0; i < candidates.size(); ++i)
+            slots[candidates[i]] = buckets[bucket][i];
+    }
+
+    // Header, bucket displacements, entry records in slot order, then names
+    out_data.assign(header_size + num_buckets * 4 + num_entries * record_size, 0);
+    endian::store_le32(&out_data[0], index_magic);
+    endian::store_le16(&out_data[4], index_version);
+    endian::store_le32(&out_data[8], u32(num_entries));
+    endian::store_le32(&out_data[12], u32(num_buckets));
+
+    for (size_t i = 0; i < num_buckets; ++i)
+        endian::store_le32(&out_data[header_size + i * 4], displacements[i]);
+
+    size_t records_pos = header_size + num_buckets * 4;
+    size_t name_offset = 0;
+
+    for (size_t slot = 0; slot < num_entries; ++slot) {
+        const ZipIndexEntry& entry = entries[slots[slot]];
+        u8* record = &out_data[records_pos + slot * record_size];
+
+        endian::store_le64(record, entry.header_offset);
+        endian::store_le64(record + 8, entry.data_offset);
+        endian::store_le64(record + 16, entry.compressed_size);
+        endian::store_le64(record + 24, entry.size);
+        endian::store_le32(record + 32, entry.index);
+        endian::store_le32(record + 36, entry.crc);
+        endian::store_le32(record + 40, u32(name_offset));
+        endian::store_le16(record + 44, u16(entry.name.size()));
+        endian::store_le16(record + 46, entry.method);
+        name_offset += entry.name.size();
+    }
+
+    for (size_t slot = 0; slot < num_entries; ++slot) {
+        std::string_view name = entries[slots[slot]].name;
+        out_data.insert(out_data.end(), name.begin(), name.end());
+    }
+
+    return true;
+}
+
+void ZipIndex::clear()
+{
+    entries_.clear();
+    displacements_.clear();
+    data_.clear();
+}
+
+const ZipIndexEntry* ZipIndex::find(std::string_view name) const
+{
+    if (entries_.empty())
+        return nullptr;
+
+    u64 h = hash(name);
+    u32 displacement = displacements_[get_bucket(h, displacements_.size())];
+    const ZipIndexEntry& entry = entries_[get_slot(h, displacement, entries_.size())];
+
+    if (entry.name == name)
+        return &entry;
+    else
+        return nullptr;
+}
+
+bool ZipIndex::load(std::vector<u8>&& data, u64 num_archive_entries, Error& out_error)
+{
+    clear();
+
+    if (data.size() < header_size
+        || endian::load_le32(&data[0]) != index_magic
+        || endian::load_le16(&data[4]) != index_version)
+    {
+        out_error = make_invalid_index_error("Invalid archive index header");
+        return false;
+    }
+
+    size_t num_entries = endian::load_le32(&data[8]);
+    size_t num_buckets = endian::load_le32(&data[12]);
+    size_t records_pos = header_size + num_buckets * 4;
+    size_t names_pos = records_pos + num_entries * record_size;
+
+    if (!num_buckets || names_pos > data.size()) {
+        out_error = make_invalid_index_error("Archive index is truncated");
+        return false;
+    }
+
+    data_ = std::move(data);
+    displacements_.resize(num_buckets);
+    entries_.resize(num_entries);
+
+    for (size_t i = 0; i < num_buckets; ++i)
+        displacements_[i] = endian::load_le32(&data_[header_size + i * 4]);
+
+    std::string_view names{reinterpret_cast<const char*>(&data_[names_pos]), data_.size() - names_pos};
+
+    for (size_t i = 0; i < num_entries; ++i) {
+        const u8* record = &data_[records_pos + i * record_size];
+        ZipIndexEntry& entry = entries_[i];
+        size_t name_offset = endian::load_le32(record + 40);
+        size_t name_length = endian::load_le16(record + 44);
+
+        entry.header_offset = endian::load_le64(record);
+        entry.data_offset = endian::load_le64(record + 8);
+        entry.compressed_size = endian::load_le64(record + 16);
+        entry.size = endian::load_le64(record + 24);
+        entry.index = endian::load_le32(record + 32);
+        entry.crc = endian::load_le32(record + 36);
+        entry.method = endian::load_le16(record + 46);
+
+        if (entry.index >= num_archive_entries || entry.data_offset < entry.header_offset
+            || name_offset > names.size() || name_length > names.size() - name_offset)
+        {
+            clear();
+            out_error = make_invalid_index_error("Invalid archive index entry");
+            return false;
+        }
+
+        entry.name = names.substr(name_offset, name_length);
+    }
+
+    return true;
+}
+
+u64 ZipIndex::hash(std::string_view name)
+{
+    // 64-bit FNV-1a
+    u64 h = 0xcbf29ce484222325;
+
+    for (char c : name) {
+        h ^= u8(c);
+        h *= 0x100000001b3;
+    }
+
+    return h;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_ZIP_INDEX_H_INCLUDED
+#define IO_ZIP_INDEX_H_INCLUDED
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "error.h"
+
+namespace geo {
+
+    /// Entry record of a @ref ZipIndex.
+    struct ZipIndexEntry {
+        std::string_view name{};
+        u32 index = 0;
+        u16 method = 0;
+        u32 crc = 0;
+        u64 header_offset = 0;
+        u64 data_offset = 0;
+        u64 compressed_size = 0;
+        u64 size = 0;
+    };
+
+    /// Minimal perfect hash index of a ZIP archive's entries, as written by `geo_pakbuild` into the
+    /// stored entry named @ref ZipIndex::entry_name. Looking up a name hashes it once and
+    /// compares it against a single candidate entry.
+    ///
+    /// All integers are little-endian. The index consists of a 16-byte header (magic, version,
+    /// entry count, bucket count), a 32-bit displacement per bucket, a 48-byte record per entry in
+    /// slot order, and finally the entry names. Each record holds the offset of the entry's data as
+    /// well as its local header, so the data can be read without parsing the local header.
+    class ZipIndex {
+    public:
+        /// Name of the archive entry containing the index.
+        static constexpr const char* entry_name = ".geo/index";
+
+        ZipIndex() = default;
+        ZipIndex(const ZipIndex&) = delete;
+        ZipIndex(ZipIndex&& other) = default;
+
+        ZipIndex& operator=(ZipIndex&& other) = default;
+
+        void clear();
+        bool empty() const { return entries_.empty(); }
+        const ZipIndexEntry* find(std::string_view name) const;
+
+        /// Loads the index. `num_archive_entries` is used to validate the entries' indices.
+        bool load(std::vector<u8>&& data, u64 num_archive_entries, Error& out_error);
+
+        /// Builds an index of `entries` using hash-and-displace. The entries' names must be unique.
+        static bool build(std::span<const ZipIndexEntry> entries, std::vector<u8>& out_data, Error& out_error);
+
+        /// Hashes a name.
+        static u64 hash(std::string_view name);
+
+    private:
+        std::vector<u8> data_;
+        std::vector<u32> displacements_;
+        std::vector<ZipIndexEntry> entries_;
+    };
+
+} // namespace geo
+
+#endif // IO_ZIP_INDEX_H_INCLUDED
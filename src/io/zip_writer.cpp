@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+
+#include <algorithm>
+
+#include <core/endian.h>
+
+#include "zip_writer.h"
+
+using namespace geo;
+
+namespace {
+
+    // Record signatures
+    constexpr u32 local_header_signature = 0x04034b50;
+    constexpr u32 central_header_signature = 0x02014b50;
+    constexpr u32 eocd_signature = 0x06054b50;
+    constexpr u32 eocd64_signature = 0x06064b50;
+    constexpr u32 eocd64_locator_signature = 0x07064b50;
+
+    // Fixed record sizes
+    constexpr size_t local_header_size = 30;
+    constexpr size_t central_header_size = 46;
+    constexpr size_t eocd_size = 22;
+    constexpr size_t eocd64_size = 56;
+    constexpr size_t eocd64_locator_size = 20;
+
+    constexpr u16 zip64_extra_id = 0x0001;
+    constexpr u32 max_u32 = 0xffffffff;
+    constexpr u16 max_u16 = 0xffff;
+
+    constexpr u16 flag_utf8 = 1 << 11;
+    constexpr u16 dos_date_1980 = (1 << 5) | 1; // 1980-01-01
+    constexpr size_t write_buffer_size = 1 << 20;
+
+    // Gets the minimum ZIP version needed to extract an entry.
+    u16 get_version_needed(u16 method, bool zip64)
+    {
+        if (method != zip_method::store && method != zip_method::deflate)
+            return 63;
+        else if (zip64)
+            return 45;
+        else
+            return 20;
+    }
+
+    u16 get_flags(std::string_view name)
+    {
+        bool is_ascii = std::all_of(name.begin(), name.end(), [](char c) { return u8(c) < 0x80; });
+        return is_ascii ? 0 : flag_utf8;
+    }
+
+    // Appends a ZIP64 extended information field containing the values that don't fit in 32 bits.
+    void append_zip64_extra(std::vector<u8>& out, std::span<const u64> values)
+    {
+        size_t num_values = size_t(std::count_if(values.begin(), values.end(), [](u64 v) { return v >= max_u32; }));
+
+        if (!num_values)
+            return;
+
+        size_t pos = out.size();
+        out.resize(pos + 4 + num_values * 8);
+        endian::store_le16(&out[pos], zip64_extra_id);
+        endian::store_le16(&out[pos + 2], u16(num_values * 8));
+        pos += 4;
+
+        for (u64 value : values) {
+            if (value >= max_u32) {
+                endian::store_le64(&out[pos], value);
+                pos += 8;
+            }
+        }
+    }
+
+    u32 saturate(u64 value)
+    {
+        return value >= max_u32 ? max_u32 : u32(value);
+    }
+
+} // namespace
+
+ZipWriter::ZipWriter(const oschar_t* path, Error& out_error)
+{
+    open(path, out_error);
+}
+
+ZipWriter::~ZipWriter()
+{
+    close();
+}
+
+bool ZipWriter::add(ZipDirectoryEntry entry, std::span<const u8> data, Error& out_error)
+{
+    if (!fp_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return false;
+    } else if (entry.name.size() > max_u16) {
+        out_error = {.description = "Entry name is too long", .code = IoErrorCode::stream_too_long};
+        return false;
+    }
+
+    entry.header_offset = offset_;
+    entry.compressed_size = data.size();
+
+    // Sizes are known in advance, so a ZIP64 field is only needed if they don't fit. Unlike in
+    // the central directory, both sizes are required in local headers.
+    std::vector<u8> extra;
+
+    if (entry.size >= max_u32 || entry.compressed_size >= max_u32) {
+        extra.resize(20);
+        endian::store_le16(&extra[0], zip64_extra_id);
+        endian::store_le16(&extra[2], 16);
+        endian::store_le64(&extra[4], entry.size);
+        endian::store_le64(&extra[12], entry.compressed_size);
+    }
+
+    entry.data_offset = offset_ + local_header_size + entry.name.size() + extra.size();
+
+    u8 header[local_header_size];
+
+    endian::store_le32(&header[0], local_header_signature);
+    endian::store_le16(&header[4], get_version_needed(entry.method, !extra.empty()));
+    endian::store_le16(&header[6], get_flags(entry.name));
+    endian::store_le16(&header[8], entry.method);
+    endian::store_le16(&header[10], 0);
+    endian::store_le16(&header[12], dos_date_1980);
+    endian::store_le32(&header[14], entry.crc);
+    endian::store_le32(&header[18], saturate(entry.compressed_size));
+    endian::store_le32(&header[22], saturate(entry.size));
+    endian::store_le16(&header[26], u16(entry.name.size()));
+    endian::store_le16(&header[28], u16(extra.size()));
+
+    if (!write(header, out_error)
+        || !write({reinterpret_cast<const u8*>(entry.name.data()), entry.name.size()}, out_error)
+        || !write(extra, out_error)
+        || !write(data, out_error))
+    {
+        return false;
+    }
+
+    entries_.push_back(std::move(entry));
+    return true;
+}
+
+bool ZipWriter::add_alias(std::string name, size_t target_index, Error& out_error)
+{
+    if (!fp_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return false;
+    } else if (name.size() > max_u16) {
+        out_error = {.description = "Entry name is too long", .code = IoErrorCode::stream_too_long};
+        return false;
+    } else if (target_index >= entries_.size()) {
+        out_error = {.description = "Invalid alias target", .code = std::make_error_code(std::errc::invalid_argument)};
+        return false;
+    }
+
+    ZipDirectoryEntry entry = entries_[target_index];
+
+    entry.name = std::move(name);
+    entries_.push_back(std::move(entry));
+    return true;
+}
+
+void ZipWriter::close()
+{
+    if (fp_) {
+        fclose(fp_);
+        fp_ = nullptr;
+    }
+}
+
+bool ZipWriter::finish(Error& out_error)
+{
+    if (!fp_) {
+        out_error = {.code = IoErrorCode::stream_closed};
+        return false;
+    }
+
+    // Central directory
+    u64 cd_offset = offset_;
+    std::vector<u8> record;
+
+    for (const ZipDirectoryEntry& entry : entries_) {
+        const u64 values[] = {entry.size, entry.compressed_size, entry.header_offset};
+
+        record.assign(central_header_size, 0);
+        record.insert(record.end(), entry.name.begin(), entry.name.end());
+        append_zip64_extra(record, values);
+
+        size_t extra_size = record.size() - central_header_size - entry.name.size();
+        u16 version = get_version_needed(entry.method, extra_size > 0);
+
+        endian::store_le32(&record[0], central_header_signature);
+        endian::store_le16(&record[4], version);
+        endian::store_le16(&record[6], version);
+        endian::store_le16(&record[8], get_flags(entry.name));
+        endian::store_le16(&record[10], entry.method);
+        endian::store_le16(&record[14], dos_date_1980);
+        endian::store_le32(&record[16], entry.crc);
+        endian::store_le32(&record[20], saturate(entry.compressed_size));
+        endian::store_le32(&record[24], saturate(entry.size));
+        endian::store_le16(&record[28], u16(entry.name.size()));
+        endian::store_le16(&record[30], u16(extra_size));
+        endian::store_le32(&record[42], saturate(entry.header_offset));
+
+        if (!write(record, out_error))
+            return false;
+    }
+
+    u64 cd_size = offset_ - cd_offset;
+    u64 num_entries = entries_.size();
+
+    // ZIP64 end of central directory record and locator
+    if (num_entries >= max_u16 || cd_size >= max_u32 || cd_offset >= max_u32) {
+        u64 eocd64_offset = offset_;
+        u8 eocd64[eocd64_size + eocd64_locator_size] = {};
+        u8* locator = &eocd64[eocd64_size];
+
+        endian::store_le32(&eocd64[0], eocd64_signature);
+        endian::store_le64(&eocd64[4], eocd64_size - 12);
+        endian::store_le16(&eocd64[12], 45);
+        endian::store_le16(&eocd64[14], 45);
+        endian::store_le64(&eocd64[24], num_entries);
+        endian::store_le64(&eocd64[32], num_entries);
+        endian::store_le64(&eocd64[40], cd_size);
+        endian::store_le64(&eocd64[48], cd_offset);
+        endian::store_le32(&locator[0], eocd64_locator_signature);
+        endian::store_le64(&locator[8], eocd64_offset);
+        endian::store_le32(&locator[16], 1);
+
+        if (!write(eocd64, out_error))
+            return false;
+    }
+
+    // End of central directory record
+    u8 eocd[eocd_size] = {};
+    u16 num_entries16 = num_entries >= max_u16 ? max_u16 : u16(num_entries);
+
+    endian::store_le32(&eocd[0], eocd_signature);
+    endian::store_le16(&eocd[8], num_entries16);
+    endian::store_le16(&eocd[10], num_entries16);
+    endian::store_le32(&eocd[12], saturate(cd_size));
+    endian::store_le32(&eocd[16], saturate(cd_offset));
+
+    if (!write(eocd, out_error))
+        return false;
+
+    FILE* fp = fp_;
+    fp_ = nullptr;
+
+    if (fclose(fp) != 0) {
+        out_error = {.description = "fclose failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    return true;
+}
+
+bool ZipWriter::open(const oschar_t* path, Error& out_error)
+{
+    close();
+    offset_ = 0;
+    entries_.clear();
+
+#ifdef _WIN32
+    fp_ = _wfopen(path, L"wb");
+#else
+    fp_ = fopen(path, "wb");
+#endif
+
+    if (!fp_) {
+        out_error = {.description = "fopen failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    setvbuf(fp_, nullptr, _IOFBF, write_buffer_size);
+    return true;
+}
+
+bool ZipWriter::write(std::span<const u8> data, Error& out_error)
+{
+    if (!data.empty() && fwrite(data.data(), 1, data.size(), fp_) != data.size()) {
+        out_error = {.description = "fwrite failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    offset_ += data.size();
+    return true;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_ZIP_WRITER_H_INCLUDED
+#define IO_ZIP_WRITER_H_INCLUDED
+
+#include <stdio.h>
+
+#include "zip_directory.h"
+
+namespace geo {
+
+    /// Writes a ZIP archive sequentially in a single pass. Entry data must already be encoded,
+    /// so each entry's sizes and CRC-32 are known when its local header is written. ZIP64
+    /// records are written only when needed. Timestamps are fixed so that identical inputs
+    /// produce identical archives.
+    class ZipWriter {
+    public:
+        ZipWriter() = default;
+        ZipWriter(const ZipWriter&) = delete;
+        explicit ZipWriter(const oschar_t* path, Error& out_error);
+        ~ZipWriter();
+
+        /// Closes the file without finishing the archive.
+        void close();
+
+        bool is_open() const { return fp_ != nullptr; }
+        bool open(const oschar_t* path, Error& out_error);
+
+        /// Writes an entry's local header followed by its encoded data. The entry's header and data
+        /// offsets are set by the writer.
+        bool add(ZipDirectoryEntry entry, std::span<const u8> data, Error& out_error);
+
+        /// Adds a central directory entry that shares the local header and data of a previously
+        /// added entry.
+        bool add_alias(std::string name, size_t target_index, Error& out_error);
+
+        /// Writes the central directory and closes the file.
+        bool finish(Error& out_error);
+
+        /// Entries that have been added, including their header offsets.
+        const std::vector<ZipDirectoryEntry>& entries() const { return entries_; }
+
+        /// Gets the number of bytes written so far.
+        u64 get_offset() const { return offset_; }
+
+    private:
+        FILE* fp_ = nullptr;
+        u64 offset_ = 0;
+        std::vector<ZipDirectoryEntry> entries_;
+
+        bool write(std::span<const u8> data, Error& out_error);
+    };
+
+} // namespace geo
+
+#endif // IO_ZIP_WRITER_H_INCLUDED
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <zstd.h>
+
+#include <system/debug.h>
+
+#include "zstd.h"
+
+using namespace geo;
+
+//==================================================================================================
+// zstd_error_category
+//==================================================================================================
+
+namespace {
+
+    class ZstdErrorCategory : public std::error_category {
+        std::string message(int value) const override
+        {
+            return ZSTD_getErrorString(ZSTD_ErrorCode(value));
+        }
+
+        const char* name() const noexcept override { return "zstd"; }
+    } constinit const zstd_error_category_instance;
+
+    Error make_zstd_error(ErrorDescription description, size_t result)
+    {
+        return {.description = std::move(description), .code = {int(ZSTD_getErrorCode(result)), zstd_error_category_instance}};
+    }
+
+} // namespace
+
+constinit const std::error_category& geo::zstd_error_category = zstd_error_category_instance;
+
+//==================================================================================================
+// ZstdDictionary
+//==================================================================================================
+
+ZstdDictionary::~ZstdDictionary()
+{
+    ZSTD_freeDDict(ddict_);
+}
+
+std::shared_ptr<const ZstdDictionary> ZstdDictionary::load(std::span<const u8> data, Error& out_error)
+{
+    std::shared_ptr<ZstdDictionary> dictionary{new ZstdDictionary};
+
+    dictionary->ddict_ = ZSTD_createDDict(data.data(), data.size());
+
+    if (!dictionary->ddict_) {
+        out_error = {.description = "ZSTD_createDDict failed", .code = IoErrorCode::invalid_archive};
+        return {};
+    }
+
+    return dictionary;
+}
+
+//==================================================================================================
+// ZstdDecoder
+//==================================================================================================
+
+ZstdDecoder::ZstdDecoder()
+    : dctx_{ZSTD_createDCtx()}
+{
+    if (!dctx_)
+        FATAL("ZSTD_createDCtx failed");
+}
+
+ZstdDecoder::ZstdDecoder(std::shared_ptr<const ZstdDictionary> dictionary)
+    : ZstdDecoder{}
+{
+    if (!dictionary)
+        return;
+
+    // The dictionary is referenced rather than copied, and stays referenced across resets of the
+    // session.
+    size_t result = ZSTD_DCtx_refDDict(dctx_, dictionary->ddict_);
+
+    if (ZSTD_isError(result))
+        FATAL("ZSTD_DCtx_refDDict failed: {}", make_zstd_error("ZSTD_DCtx_refDDict failed", result));
+
+    dictionary_ = std::move(dictionary);
+}
+
+ZstdDecoder::~ZstdDecoder()
+{
+    ZSTD_freeDCtx(dctx_);
+}
+
+bool ZstdDecoder::decode(std::span<const u8>& in, std::span<u8>& out, bool& out_frame_end, Error& out_error)
+{
+    ZSTD_inBuffer in_buf = {in.data(), in.size(), 0};
+    ZSTD_outBuffer out_buf = {out.data(), out.size(), 0};
+    size_t result = ZSTD_decompressStream(dctx_, &out_buf, &in_buf);
+
+    if (ZSTD_isError(result)) {
+        out_error = make_zstd_error("ZSTD_decompressStream failed", result);
+        return false;
+    }
+
+    in = in.subspan(in_buf.pos);
+    out = out.subspan(out_buf.pos);
+    out_frame_end = result == 0;
+    return true;
+}
+
+void ZstdDecoder::reset()
+{
+    ZSTD_DCtx_reset(dctx_, ZSTD_reset_session_only);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IO_ZSTD_H_INCLUDED
+#define IO_ZSTD_H_INCLUDED
+
+#include "decoder.h"
+
+struct ZSTD_DCtx_s;
+struct ZSTD_DDict_s;
+
+namespace geo {
+
+    /// Digested Zstandard dictionary that can be shared by decoders on multiple threads.
+    class ZstdDictionary {
+    public:
+        ZstdDictionary(const ZstdDictionary&) = delete;
+        ~ZstdDictionary();
+
+        /// Loads a dictionary. The data is copied.
+        static std::shared_ptr<const ZstdDictionary> load(std::span<const u8> data, Error& out_error);
+
+    private:
+        friend class ZstdDecoder;
+
+        struct ::ZSTD_DDict_s* ddict_ = nullptr;
+
+        ZstdDictionary() = default;
+    };
+
+    /// Streaming Zstandard decoder.
+    class ZstdDecoder : public Decoder {
+    public:
+        ZstdDecoder();
+        ZstdDecoder(const ZstdDecoder&) = delete;
+
+        /// Creates a decoder for frames that were compressed with `dictionary`, if not null.
+        explicit ZstdDecoder(std::shared_ptr<const ZstdDictionary> dictionary);
+
+        ~ZstdDecoder();
+
+        bool decode(std::span<const u8>& in, std::span<u8>& out, bool& out_frame_end, Error& out_error) override;
+        void reset() override;
+
+    private:
+        struct ::ZSTD_DCtx_s* dctx_ = nullptr;
+        std::shared_ptr<const ZstdDictionary> dictionary_{};
+    };
+
+    /// Error category corresponding to Zstandard error codes.
+    extern constinit const std::error_category& zstd_error_category;
+
+} // namespace geo
+
+#endif // IO_ZSTD_H_INCLUDED
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <cstring>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <core/endian.h>
+#include <system/binary_log.h>
+#include <system/debug.h>
+#include <system/error.h>
+
+using namespace geo;
+
+namespace {
+
+    using Text = std::basic_string<oschar_t>;
+
+    // Call site definition read from a `site` record.
+    struct Site {
+        LogLevel level = LogLevel::none;
+        u32 line = 0;
+        std::string file;
+        Text fmt;
+    };
+
+    const char* get_level_name(LogLevel level)
+    {
+        switch (level) {
+            case LogLevel::fatal: return "FATAL ERROR";
+            case LogLevel::error: return "ERROR";
+            case LogLevel::warning: return "WARNING";
+            case LogLevel::info: return "INFO";
+            case LogLevel::debug: return "DEBUG";
+            case LogLevel::trace: return "TRACE";
+            default: return "UNKNOWN";
+        }
+    }
+
+    // Reads fields from the contents of a binary log file. Each read returns false if the file is
+    // truncated.
+    class Reader {
+    public:
+        explicit Reader(std::span<const u8> data) : data_{data} {}
+
+        bool empty() const { return data_.empty(); }
+
+        bool read_u8(u8& out_value) { return read_fixed<1>(out_value, [](const u8* p) { return *p; }); }
+        bool read_u16(u16& out_value) { return read_fixed<2>(out_value, endian::load_le16); }
+        bool read_u32(u32& out_value) { return read_fixed<4>(out_value, endian::load_le32); }
+
+        bool read_bytes(size_t size, std::span<const u8>& out_bytes)
+        {
+            if (data_.size() < size)
+                return false;
+
+            out_bytes = data_.first(size);
+            data_ = data_.subspan(size);
+            return true;
+        }
+
+        bool read_file(std::string& out_file)
+        {
+            u16 length;
+            std::span<const u8> bytes;
+
+            if (!read_u16(length) || !read_bytes(length, bytes))
+                return false;
+
+            out_file.assign(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            return true;
+        }
+
+        bool read_text(Text& out_text)
+        {
+            u32 length;
+            std::span<const u8> bytes;
+
+            if (!read_u32(length) || !read_bytes(size_t(length) * sizeof(oschar_t), bytes))
+                return false;
+
+            out_text.resize(length);
+            std::memcpy(out_text.data(), bytes.data(), bytes.size());
+            return true;
+        }
+
+    private:
+        std::span<const u8> data_;
+
+        template<size_t Size, typename T, typename Load>
+        bool read_fixed(T& out_value, Load load)
+        {
+            if (data_.size() < Size)
+                return false;
+
+            out_value = T(load(data_.data()));
+            data_ = data_.subspan(Size);
+            return true;
+        }
+    };
+
+    bool read_file_contents(const oschar_t* path, std::vector<u8>& out_data, Error& out_error)
+    {
+#ifdef _WIN32
+        FILE* fp = _wfopen(path, L"rb");
+#else
+        FILE* fp = fopen(path, "rb");
+#endif
+
+        if (!fp) {
+            out_error = {.description = "fopen failed", .code = {errno, std::generic_category()}};
+            return false;
+        }
+
+        u8 chunk[65536];
+        size_t size;
+
+        while ((size = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+            out_data.insert(out_data.end(), chunk, chunk + size);
+
+        bool failed = ferror(fp);
+        fclose(fp);
+
+        if (failed) {
+            out_error = {.description = "fread failed", .code = {EIO, std::generic_category()}};
+            return false;
+        }
+
+        return true;
+    }
+
+    void print_message(fmt::basic_memory_buffer<oschar_t>& output, LogLevel level, const std::string& file,
+                       u32 line, std::basic_string_view<oschar_t> text)
+    {
+        fmt::format_to(std::back_inserter(output), OSSTR "{}: {}", debug::detail::forward(get_level_name(level)), text);
+
+        if (!file.empty())
+            fmt::format_to(std::back_inserter(output), OSSTR " ({}:{})", debug::detail::forward(file), line);
+
+        output.push_back('\n');
+    }
+
+    // Decodes every record of a binary log file and writes the messages to stdout.
+    void decode_log(const oschar_t* path)
+    {
+        std::vector<u8> data;
+        Error error;
+
+        if (!read_file_contents(path, data, error))
+            FATAL("{}: {}", path, error);
+        else if (data.size() < debug::log_file_header_size
+                 || std::memcmp(data.data(), debug::log_file_magic, sizeof(debug::log_file_magic)) != 0)
+            FATAL("{}: Not a binary log file", path);
+        else if (data[6] != debug::log_file_version)
+            FATAL("{}: Unsupported log file version: {}", path, data[6]);
+        else if (data[7] != sizeof(oschar_t))
+            FATAL("{}: Log file was written with {}-byte characters", path, data[7]);
+
+        Reader reader{std::span<const u8>{data}.subspan(debug::log_file_header_size)};
+        std::unordered_map<u32, Site> sites;
+        fmt::basic_memory_buffer<oschar_t> output;
+        fmt::basic_memory_buffer<oschar_t> formatted;
+        Text text;
+
+        while (!reader.empty()) {
+            u8 type, level;
+            u32 id, line, size;
+            std::span<const u8> args;
+            bool ok;
+
+            if (!reader.read_u8(type))
+                break;
+
+            switch (debug::LogFileRecord(type)) {
+                case debug::LogFileRecord::site: {
+                    Site site;
+                    ok = reader.read_u32(id) && reader.read_u8(level) && reader.read_u32(site.line)
+                         && reader.read_file(site.file) && reader.read_text(site.fmt);
+                    site.level = LogLevel(level);
+
+                    if (ok)
+                        sites[id] = std::move(site);
+                    break;
+                }
+
+                case debug::LogFileRecord::message: {
+                    ok = reader.read_u32(id) && reader.read_u32(size) && reader.read_bytes(size, args);
+
+                    if (!ok)
+                        break;
+
+                    auto it = sites.find(id);
+
+                    if (it == sites.end())
+                        FATAL("{}: Message refers to undefined site {}", path, id);
+
+                    const Site& site = it->second;
+                    formatted.clear();
+
+                    if (!debug::format_log_args(formatted, site.fmt, args))
+                        FATAL("{}: Malformed arguments for site {} ({}:{})", path, id, site.file, site.line);
+
+                    print_message(output, site.level, site.file, site.line, {formatted.data(), formatted.size()});
+                    break;
+                }
+
+                case debug::LogFileRecord::text: {
+                    std::string file;
+                    ok = reader.read_u8(level) && reader.read_u32(line) && reader.read_file(file)
+                         && reader.read_text(text);
+
+                    if (ok)
+                        print_message(output, LogLevel(level), file, line, text);
+                    break;
+                }
+
+                default:
+                    FATAL("{}: Invalid record type: {}", path, type);
+            }
+
+            // A truncated final record is expected if the process crashed while writing it.
+            if (!ok) {
+                LOG_WARNING("{}: Log file is truncated", path);
+                break;
+            }
+
+            if (output.size() >= 65536) {
+                fmt::print(stdout, OSSTR "{}", std::basic_string_view<oschar_t>{output.data(), output.size()});
+                output.clear();
+            }
+        }
+
+        fmt::print(stdout, OSSTR "{}", std::basic_string_view<oschar_t>{output.data(), output.size()});
+    }
+
+    int logdecode_main(int argc, const oschar_t* const argv[])
+    {
+        debug::init_logger();
+        debug::set_max_log_level(LogLevel::warning);
+
+        if (argc < 2 || !argv[1])
+            FATAL("Missing binary log path");
+
+        for (int i = 1; i < argc && argv[i]; ++i)
+            decode_log(argv[i]);
+
+        debug::shut_down_logger();
+        return 0;
+    }
+
+} // namespace
+
+#ifdef _WIN32
+
+int wmain(int argc, wchar_t* argv[])
+{
+    return logdecode_main(argc, argv);
+}
+
+#else // !defined(_WIN32)
+
+int main(int argc, char* argv[])
+{
+    return logdecode_main(argc, argv);
+}
+
+#endif // !defined(_WIN32)
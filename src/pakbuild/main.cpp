@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <chrono>
+#include <filesystem>
+
+#include <core/str.h>
+#include <io/pak_verify.h>
+#include <system/command_line.h>
+#include <system/debug.h>
+
+#include "pak_builder.h"
+
+using namespace geo;
+
+//==================================================================================================
+// Command line
+//==================================================================================================
+
+namespace {
+
+    using command_line::parse_size;
+
+    // Parses an input with the format `path,name[,method[,level]]`, where `method` is `none`,
+    // `zstd`, `lz4`, or `auto`.
+    PakInput parse_input(OsStringView str)
+    {
+        OsStringView fields[4];
+        size_t num_fields = 0;
+        OsStringView remaining = str;
+
+        for (;;) {
+            size_t comma_pos = remaining.find(',');
+
+            if (num_fields == 4)
+                FATAL("Too many parameters in input: {}", str);
+
+            fields[num_fields++] = remaining.substr(0, comma_pos);
+
+            if (comma_pos == OsStringView::npos)
+                break;
+
+            remaining = remaining.substr(comma_pos + 1);
+        }
+
+        if (fields[0].empty())
+            FATAL("Missing path in input: {}", str);
+        else if (num_fields < 2 || fields[1].empty())
+            FATAL("Missing entry name in input: {}", str);
+
+        std::u8string name = std::filesystem::path{fields[1]}.generic_u8string();
+        PakInput input = {
+            .path = OsString{fields[0]},
+            .name = {reinterpret_cast<const char*>(name.data()), name.size()},
+        };
+
+        if (num_fields >= 3) {
+            if (fields[2] == OSSTR "zstd")
+                input.method = zip_method::zstd;
+            else if (fields[2] == OSSTR "lz4")
+                input.method = zip_method::lz4;
+            else if (fields[2] == OSSTR "auto")
+                input.method = PakInput::auto_method;
+            else if (!fields[2].empty() && fields[2] != OSSTR "none")
+                FATAL("Invalid compression method in input: {}", str);
+        }
+
+        if (num_fields >= 4 && !fields[3].empty()) {
+            if (fields[3][0] == '-')
+                input.level = -int(parse_size(fields[3].substr(1)));
+            else
+                input.level = int(parse_size(fields[3]));
+        }
+
+        return input;
+    }
+
+    PakBuildOptions build_options = {};
+    std::vector<PakInput> inputs;
+    const oschar_t* output_path = nullptr;
+    const oschar_t* verify_path = nullptr;
+
+    const CommandLineOption command_line_options[] = {
+        {OSSTR "index", false, [](const oschar_t*) { build_options.index = true; }},
+        {OSSTR "jobs", true, [](const oschar_t* param) { build_options.num_threads = parse_size(param); }},
+        {OSSTR "min-comp-size", true,
+         [](const oschar_t* param) { build_options.min_compress_size = parse_size(param); }},
+        {OSSTR "min-decode-speed", true,
+         [](const oschar_t* param) { build_options.min_decode_speed = parse_size(param); }},
+        {OSSTR "order-trace", true, [](const oschar_t* param) { build_options.trace_paths.emplace_back(param); }},
+        {OSSTR "output", true, [](const oschar_t* param) { output_path = param; }},
+        {OSSTR "previous", true, [](const oschar_t* param) { build_options.previous_path = param; }},
+        {OSSTR "verify", true, [](const oschar_t* param) { verify_path = param; }},
+        {OSSTR "zstd-dict-max-input-size", true,
+         [](const oschar_t* param) { build_options.zstd_dict_max_input_size = parse_size(param); }},
+        {OSSTR "zstd-dict-size", true, [](const oschar_t* param) { build_options.zstd_dict_size = parse_size(param); }},
+        {OSSTR "zstd-frame-size", true,
+         [](const oschar_t* param) { build_options.zstd_frame_size = parse_size(param); }},
+    };
+
+    void handle_command_line(int argc, const oschar_t* const argv[])
+    {
+        // Arguments that aren't options are inputs.
+        command_line::parse(argc, argv, command_line_options,
+                            [](const oschar_t* arg) { inputs.push_back(parse_input(arg)); });
+
+        // Verifying an existing PAK doesn't require building one.
+        if (!output_path && !verify_path)
+            FATAL("Missing output path (--output=PATH)");
+    }
+
+} // namespace
+
+//==================================================================================================
+// Entry point
+//==================================================================================================
+
+namespace {
+
+    // Checks the CRC-32 of every entry of a PAK in parallel. Returns the process exit code.
+    int run_pak_verification(const oschar_t* path)
+    {
+        PakVerifyStats stats;
+        Error error;
+
+        if (!verify_pak(path, build_options.num_threads, stats, error))
+            FATAL("{}: {}", path, error);
+
+        auto elapsed = std::chrono::duration<double>(stats.elapsed_time).count();
+
+        LOG_INFO("Verified {} entries, {} -> {} bytes on {} threads in {:.2f} s ({:.1f} MiB/s)",
+                 stats.num_entries, stats.raw_size, stats.decoded_size, stats.num_threads, elapsed,
+                 elapsed > 0.0 ? double(stats.decoded_size) / (1024.0 * 1024.0) / elapsed : 0.0);
+
+        if (stats.num_failed) {
+            LOG_ERROR("{}: {} of {} entries are corrupt", path, stats.num_failed, stats.num_entries);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    int pakbuild_main(int argc, const oschar_t* const argv[])
+    {
+        debug::init_logger();
+        debug::set_max_log_level(LogLevel::info);
+        handle_command_line(argc, argv);
+
+        // With --verify alone, only the existing PAK is checked.
+        if (!output_path) {
+            int result = run_pak_verification(verify_path);
+            debug::shut_down_logger();
+            return result;
+        }
+
+        // Unchanged entries are reused from the PAK being replaced unless another PAK is given.
+        if (build_options.previous_path.empty())
+            build_options.previous_path = output_path;
+
+        auto start_time = std::chrono::steady_clock::now();
+        PakBuilder builder{build_options};
+        Error error;
+
+        for (PakInput& input : inputs)
+            builder.add(std::move(input));
+
+        if (!builder.build(output_path, error))
+            FATAL("{}: {}", output_path, error);
+
+        const PakBuildStats& stats = builder.get_stats();
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time);
+
+        LOG_INFO("Wrote {} entries ({} compressed, {} reused), {} -> {} bytes in {:.2f} s",
+                 stats.num_entries, stats.num_compressed, stats.num_reused, stats.input_size,
+                 stats.output_size, elapsed.count());
+
+        if (stats.num_aliases)
+            LOG_INFO("{} entries share the data of identical entries", stats.num_aliases);
+
+        if (stats.num_lz4_compressed)
+            LOG_INFO("{} entries compressed with LZ4", stats.num_lz4_compressed);
+
+        if (stats.dictionary_size)
+            LOG_INFO("{} entries compressed with a {} byte dictionary", stats.num_dict_compressed, stats.dictionary_size);
+
+        // With --verify as well, the PAK is checked after it's built.
+        int result = verify_path ? run_pak_verification(verify_path) : 0;
+
+        debug::shut_down_logger();
+        return result;
+    }
+
+} // namespace
+
+#ifdef _WIN32
+
+int wmain(int argc, wchar_t* argv[])
+{
+    return pakbuild_main(argc, argv);
+}
+
+#else // !defined(_WIN32)
+
+int main(int argc, char* argv[])
+{
+    return pakbuild_main(argc, argv);
+}
+
+#endif // !defined(_WIN32)
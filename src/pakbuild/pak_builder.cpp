@@ -0,0 +1,956 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <lz4frame.h>
+#include <lz4hc.h>
+#include <zdict.h>
+#include <zstd.h>
+
+#include <core/endian.h>
+#include <core/finally.h>
+#include <io/crc32.h>
+#include <io/lz4.h>
+#include <io/tracing_provider.h>
+#include <io/zip_index.h>
+#include <io/zip_writer.h>
+#include <io/zstd.h>
+#include <system/debug.h>
+#include <system/mapping.h>
+
+#include "pak_builder.h"
+
+using namespace geo;
+
+namespace {
+
+    // Build manifest layout (all integers are little-endian):
+    //
+    //   Header: u32 magic, u16 version, u16 reserved, u32 num_records, u32 reserved,
+    //           u64 dictionary_samples_hash
+    //   Records: u64 content_hash, u32 entry_index, u32 frame_size, i32 level, u16 method,
+    //            u16 reserved, u32 dictionary_id, u32 min_decode_speed
+    constexpr u32 manifest_magic = 0x444c4247; // "GBLD"
+    constexpr u16 manifest_version = 2;
+    constexpr size_t manifest_header_size = 24;
+    constexpr size_t manifest_record_size = 32;
+
+    // Fewer samples than this aren't worth training a dictionary on.
+    constexpr size_t min_dictionary_samples = 8;
+
+    // LZ4 decodes equally fast at any level, so automatically selected LZ4 uses the best ratio.
+    constexpr int lz4_auto_level = LZ4HC_CLEVEL_MAX;
+
+    // Inputs are decoded repeatedly for at least this long to measure their decode speed.
+    constexpr std::chrono::milliseconds min_measure_time{2};
+    constexpr size_t max_measure_runs = 1000;
+
+    // Finalizer from SplitMix64.
+    constexpr u64 mix(u64 x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccd;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53;
+        x ^= x >> 33;
+        return x;
+    }
+
+    // Hashes an input's contents 8 bytes at a time. Reused entries must also match the input's
+    // size and CRC-32, so this isn't relied on alone.
+    u64 hash_content(std::span<const u8> data)
+    {
+        u64 h = mix(data.size() + 0x9e3779b97f4a7c15);
+        size_t pos = 0;
+
+        for (; pos + 8 <= data.size(); pos += 8)
+            h = mix(h ^ endian::load_le64(&data[pos]));
+
+        if (pos < data.size()) {
+            u8 tail[8] = {};
+            std::memcpy(tail, &data[pos], data.size() - pos);
+            h = mix(h ^ endian::load_le64(tail));
+        }
+
+        return h;
+    }
+
+    Error make_zstd_error(ErrorDescription description, size_t result)
+    {
+        return {.description = std::move(description), .code = {int(ZSTD_getErrorCode(result)), zstd_error_category}};
+    }
+
+    Error make_lz4_error(ErrorDescription description, size_t result)
+    {
+        return {.description = std::move(description), .code = {int(0 - result), lz4_error_category}};
+    }
+
+    // Identifies an entry's contents and how they were compressed. `method` is the requested
+    // method, which may be PakInput::auto_method.
+    struct ContentKey {
+        u64 hash = 0;
+        u64 size = 0;
+        u32 crc = 0;
+        u32 frame_size = 0;
+        i32 level = 0;
+        u16 method = zip_method::store;
+        u32 dictionary_id = 0;
+        u32 min_decode_speed = 0; // Only used by PakInput::auto_method
+
+        bool operator==(const ContentKey&) const = default;
+    };
+
+    // Zstandard dictionary shared by the small inputs.
+    struct Dictionary {
+        std::vector<u8> data{};
+        u32 id = 0;
+        u64 samples_hash = 0; // Identifies the inputs the dictionary was trained on
+        std::unordered_map<int, ZSTD_CDict*> cdicts{}; // Digested for each compression level
+
+        Dictionary() = default;
+        Dictionary(const Dictionary&) = delete;
+
+        ~Dictionary()
+        {
+            for (auto& [level, cdict] : cdicts)
+                ZSTD_freeCDict(cdict);
+        }
+    };
+
+    // Compressed entries of a previously built PAK that can be copied into the new PAK.
+    class PreviousPak {
+    public:
+        // Loads the PAK's build manifest. If the PAK doesn't exist or has no valid manifest,
+        // nothing is reused.
+        void open(const oschar_t* path)
+        {
+            Error error;
+
+            if (!mapping_.open(path, error)) {
+                if (!error.matches(std::make_error_condition(std::errc::no_such_file_or_directory)))
+                    LOG_WARNING("Can't reuse entries from {}: {}", path, error);
+
+                return;
+            }
+
+            if (!directory_.parse(mapping_.bytes(), error) || !load_manifest(error)) {
+                LOG_WARNING("Can't reuse entries from {}: {}", path, error);
+                close();
+            }
+        }
+
+        void close()
+        {
+            entries_.clear();
+            dictionary_ = {};
+            dictionary_samples_hash_ = 0;
+            directory_.clear();
+            mapping_.close();
+        }
+
+        // Finds the dictionary if it was trained on samples matching `samples_hash`.
+        std::span<const u8> find_dictionary(u64 samples_hash) const
+        {
+            if (dictionary_.empty() || samples_hash != dictionary_samples_hash_)
+                return {};
+
+            return dictionary_;
+        }
+
+        // Finds the compressed data of an entry that matches `key`.
+        std::span<const u8> find(const ContentKey& key, u16& out_method) const
+        {
+            auto [begin, end] = entries_.equal_range(key.hash);
+
+            for (auto it = begin; it != end; ++it) {
+                if (it->second.key == key) {
+                    out_method = it->second.method;
+                    return it->second.data;
+                }
+            }
+
+            return {};
+        }
+
+    private:
+        struct Entry {
+            ContentKey key;
+            u16 method; // Method the entry was written with
+            std::span<const u8> data;
+        };
+
+        FileMapping mapping_;
+        ZipDirectory directory_;
+        std::unordered_multimap<u64, Entry> entries_;
+        std::span<const u8> dictionary_;
+        u64 dictionary_samples_hash_ = 0;
+
+        bool load_manifest(Error& out_error)
+        {
+            const ZipDirectoryEntry* manifest_entry = directory_.find(PakBuilder::manifest_name);
+
+            if (!manifest_entry)
+                return true;
+            else if (manifest_entry->method != zip_method::store) {
+                out_error = {.description = "Build manifest is compressed", .code = IoErrorCode::invalid_archive};
+                return false;
+            }
+
+            std::span<const u8> manifest = ZipDirectory::get_data(mapping_.bytes(), *manifest_entry, out_error);
+
+            if (out_error)
+                return false;
+
+            if (manifest.size() < manifest_header_size || endian::load_le32(&manifest[0]) != manifest_magic
+                || endian::load_le16(&manifest[4]) != manifest_version
+                || (manifest.size() - manifest_header_size) / manifest_record_size < endian::load_le32(&manifest[8]))
+            {
+                out_error = {.description = "Invalid build manifest", .code = IoErrorCode::invalid_archive};
+                return false;
+            }
+
+            size_t num_records = endian::load_le32(&manifest[8]);
+            const ZipDirectoryEntry* dictionary_entry = directory_.find(zstd_dictionary_name);
+
+            if (dictionary_entry && dictionary_entry->method == zip_method::store) {
+                Error error;
+                dictionary_ = ZipDirectory::get_data(mapping_.bytes(), *dictionary_entry, error);
+                dictionary_samples_hash_ = endian::load_le64(&manifest[16]);
+            }
+
+            for (size_t i = 0; i < num_records; ++i) {
+                const u8* record = &manifest[manifest_header_size + i * manifest_record_size];
+                u32 entry_index = endian::load_le32(record + 8);
+
+                if (entry_index >= directory_.entries().size())
+                    continue;
+
+                const ZipDirectoryEntry& entry = directory_.entries()[entry_index];
+                Error error;
+                std::span<const u8> data = ZipDirectory::get_data(mapping_.bytes(), entry, error);
+
+                if (error)
+                    continue;
+
+                ContentKey key = {
+                    .hash = endian::load_le64(record),
+                    .size = entry.size,
+                    .crc = entry.crc,
+                    .frame_size = endian::load_le32(record + 12),
+                    .level = i32(endian::load_le32(record + 16)),
+                    .method = endian::load_le16(record + 20),
+                    .dictionary_id = endian::load_le32(record + 24),
+                    .min_decode_speed = endian::load_le32(record + 28),
+                };
+
+                if (key.method == entry.method || key.method == PakInput::auto_method)
+                    entries_.emplace(key.hash, Entry{key, entry.method, data});
+            }
+
+            return true;
+        }
+    };
+
+    // State of an input that is being prepared for writing.
+    struct Job {
+        const PakInput* input = nullptr;
+        FileMapping mapping{};
+        std::vector<u8> compressed{};
+        std::span<const u8> data{}; // Data to write, which may be in the mapping or the previous PAK
+        ContentKey key{};
+        u16 method = zip_method::store; // Method the entry is written with
+        ZSTD_CDict* cdict = nullptr; // Set if the input is compressed with the dictionary
+        u32 entry_index = 0;
+        bool reused = false;
+        bool alias = false; // Set if the entry shares an earlier entry's data
+        bool done = false;
+        Error error{};
+    };
+
+    // Tracks the first job that prepared each distinct content, so that later jobs with the same
+    // contents can skip compression. Shared by the compression threads.
+    class ContentOwners {
+    public:
+        // Returns true if a job with a lower index has claimed the same contents. Otherwise, the
+        // contents are claimed for `job_index`.
+        bool is_duplicate(const ContentKey& key, size_t job_index)
+        {
+            std::lock_guard lock{mutex_};
+            auto [begin, end] = owners_.equal_range(key.hash);
+
+            for (auto it = begin; it != end; ++it) {
+                Owner& owner = it->second;
+
+                if (owner.size != key.size || owner.crc != key.crc)
+                    continue;
+                else if (owner.job_index < job_index)
+                    return true;
+
+                // Jobs may finish out of order, but the earliest job is written first.
+                if (job_index < owner.job_index)
+                    owner.job_index = job_index;
+
+                return false;
+            }
+
+            owners_.emplace(key.hash, Owner{key.size, key.crc, job_index});
+            return false;
+        }
+
+    private:
+        struct Owner {
+            u64 size;
+            u32 crc;
+            size_t job_index;
+        };
+
+        std::mutex mutex_;
+        std::unordered_multimap<u64, Owner> owners_;
+    };
+
+    // Compression state that is reused by a thread.
+    struct Workspace {
+        ZSTD_CCtx* cctx = ZSTD_createCCtx();
+        ZstdDecoder zstd_decoder{};
+        Lz4Decoder lz4_decoder{};
+        std::vector<u8> alternate{}; // Output of a codec that may not be chosen
+        std::vector<u8> decoded{};
+
+        Workspace()
+        {
+            if (!cctx)
+                FATAL("ZSTD_createCCtx failed");
+        }
+
+        Workspace(const Workspace&) = delete;
+
+        ~Workspace()
+        {
+            ZSTD_freeCCtx(cctx);
+        }
+    };
+
+    // Compresses `in` as a sequence of independent Zstandard frames of at most `frame_size`
+    // uncompressed bytes, so readers can seek by restarting at a frame boundary.
+    // If `cdict` is not null, it determines the compression level instead of `level`.
+    bool compress_zstd(ZSTD_CCtx* cctx, std::span<const u8> in, int level, ZSTD_CDict* cdict,
+                       size_t frame_size, std::vector<u8>& out, Error& out_error)
+    {
+        size_t result = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+
+        if (!ZSTD_isError(result))
+            result = ZSTD_CCtx_refCDict(cctx, cdict);
+
+        if (ZSTD_isError(result)) {
+            out_error = make_zstd_error("ZSTD_CCtx_setParameter failed", result);
+            return false;
+        }
+
+        if (!frame_size)
+            frame_size = in.size();
+
+        out.clear();
+
+        // Always write at least one frame so empty entries are still valid Zstandard streams.
+        do {
+            std::span<const u8> frame = in.subspan(0, std::min(in.size(), frame_size));
+            size_t pos = out.size();
+
+            out.resize(pos + ZSTD_compressBound(frame.size()));
+            result = ZSTD_compress2(cctx, &out[pos], out.size() - pos, frame.data(), frame.size());
+
+            if (ZSTD_isError(result)) {
+                out_error = make_zstd_error("ZSTD_compress2 failed", result);
+                return false;
+            }
+
+            out.resize(pos + result);
+            in = in.subspan(frame.size());
+        } while (!in.empty());
+
+        return true;
+    }
+
+    // Compresses `in` as a sequence of independent LZ4 frames, like compress_zstd. Levels of 3 and
+    // above use LZ4-HC.
+    bool compress_lz4(std::span<const u8> in, int level, size_t frame_size, std::vector<u8>& out, Error& out_error)
+    {
+        LZ4F_preferences_t preferences = {};
+
+        preferences.compressionLevel = level;
+
+        if (!frame_size)
+            frame_size = in.size();
+
+        out.clear();
+
+        do {
+            std::span<const u8> frame = in.subspan(0, std::min(in.size(), frame_size));
+            size_t pos = out.size();
+
+            out.resize(pos + LZ4F_compressFrameBound(frame.size(), &preferences));
+            size_t result = LZ4F_compressFrame(&out[pos], out.size() - pos, frame.data(), frame.size(), &preferences);
+
+            if (LZ4F_isError(result)) {
+                out_error = make_lz4_error("LZ4F_compressFrame failed", result);
+                return false;
+            }
+
+            out.resize(pos + result);
+            in = in.subspan(frame.size());
+        } while (!in.empty());
+
+        return true;
+    }
+
+    // Measures how fast `decoder` decodes `in` into `out` in MB/s. Small inputs are decoded
+    // repeatedly so the clock's resolution doesn't dominate. Other compression threads compete for
+    // the CPU, so this is only an estimate.
+    double measure_decode_speed(Decoder& decoder, std::span<const u8> in, std::span<u8> out)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        auto start_time = Clock::now();
+        std::chrono::duration<double> elapsed{};
+        size_t num_runs = 0;
+        Error error;
+
+        do {
+            if (!decoder.decode_buffer(in, out, error))
+                return 0;
+
+            ++num_runs;
+            elapsed = Clock::now() - start_time;
+        } while (elapsed < min_measure_time && num_runs < max_measure_runs);
+
+        if (elapsed.count() <= 0)
+            return std::numeric_limits<double>::infinity();
+
+        return double(out.size()) * double(num_runs) / elapsed.count() / 1e6;
+    }
+
+    // Compresses an input with each codec, and chooses the smallest result that decodes at least as
+    // fast as `options.min_decode_speed`. Stored data always qualifies.
+    bool compress_auto(Job& job, std::span<const u8> contents, const PakBuildOptions& options, Workspace& workspace)
+    {
+        std::vector<u8>& zstd_data = job.compressed;
+        std::vector<u8>& lz4_data = workspace.alternate;
+
+        if (!compress_zstd(workspace.cctx, contents, job.input->level, nullptr, options.zstd_frame_size, zstd_data,
+                           job.error)
+            || !compress_lz4(contents, lz4_auto_level, options.zstd_frame_size, lz4_data, job.error))
+        {
+            return false;
+        }
+
+        struct Candidate {
+            u16 method;
+            const std::vector<u8>& data;
+            Decoder& decoder;
+        };
+
+        const Candidate candidates[] = {
+            {zip_method::zstd, zstd_data, workspace.zstd_decoder},
+            {zip_method::lz4, lz4_data, workspace.lz4_decoder},
+        };
+
+        workspace.decoded.resize(contents.size());
+        job.method = zip_method::store;
+        job.data = contents;
+
+        for (const Candidate& candidate : candidates) {
+            if (candidate.data.size() >= job.data.size()
+                || measure_decode_speed(candidate.decoder, candidate.data, workspace.decoded) < double(options.min_decode_speed))
+            {
+                continue;
+            }
+
+            job.method = candidate.method;
+            job.data = candidate.data;
+        }
+
+        // The chosen data must belong to the job, since the workspace is reused.
+        if (job.method == zip_method::lz4)
+            std::swap(job.compressed, workspace.alternate);
+        else if (job.method == zip_method::store)
+            job.compressed = {};
+
+        return true;
+    }
+
+    // Reads an input and compresses it, or finds its compressed data in the previous PAK. If an
+    // earlier job has the same contents, nothing is prepared, since the entry will share the
+    // earlier job's data.
+    void prepare_job(Job& job, size_t job_index, const PakBuildOptions& options, const PreviousPak& previous,
+                     ContentOwners& owners, Workspace& workspace)
+    {
+        const PakInput& input = *job.input;
+
+        if (!job.mapping.open(input.path.c_str(), job.error))
+            return;
+
+        std::span<const u8> contents = job.mapping.bytes();
+        ContentKey& key = job.key;
+
+        key.hash = hash_content(contents);
+        key.size = contents.size();
+        key.crc = crc32::update(0, contents);
+        key.method = input.method;
+
+        if (owners.is_duplicate(key, job_index))
+            return;
+
+        if (contents.size() < options.min_compress_size)
+            key.method = zip_method::store;
+
+        if (key.method == zip_method::store) {
+            job.data = contents;
+            return;
+        } else if (key.method != zip_method::zstd && key.method != zip_method::lz4
+                   && key.method != PakInput::auto_method)
+        {
+            job.error = {.description = "Unsupported compression method",
+                         .code = std::make_error_code(std::errc::not_supported)};
+            return;
+        }
+
+        key.level = input.level;
+        key.frame_size = u32(options.zstd_frame_size);
+
+        if (job.cdict) {
+            key.method = zip_method::zstd_dict;
+            key.dictionary_id = ZSTD_getDictID_fromCDict(job.cdict);
+        } else if (key.method == PakInput::auto_method) {
+            key.min_decode_speed = u32(std::min<size_t>(options.min_decode_speed, std::numeric_limits<u32>::max()));
+        }
+
+        job.data = previous.find(key, job.method);
+
+        if (job.data.data()) {
+            job.reused = true;
+            return;
+        }
+
+        if (key.method == PakInput::auto_method) {
+            compress_auto(job, contents, options, workspace);
+            return;
+        }
+
+        bool compressed;
+
+        if (key.method == zip_method::lz4)
+            compressed = compress_lz4(contents, input.level, options.zstd_frame_size, job.compressed, job.error);
+        else
+            compressed = compress_zstd(workspace.cctx, contents, input.level, job.cdict, options.zstd_frame_size,
+                                       job.compressed, job.error);
+
+        if (!compressed)
+            return;
+
+        // Frame overhead may outweigh the savings for tiny inputs.
+        if (job.cdict && job.compressed.size() >= contents.size()) {
+            key = {.hash = key.hash, .size = key.size, .crc = key.crc};
+            job.compressed = {};
+            job.data = contents;
+            return;
+        }
+
+        job.method = key.method;
+        job.data = job.compressed;
+    }
+
+    // Trains a dictionary on the small Zstandard inputs, or reuses the previous PAK's dictionary if
+    // it was trained on the same inputs. Jobs that should use the dictionary are assigned a CDict.
+    // Returns false if no dictionary is used.
+    bool prepare_dictionary(std::vector<Job>& jobs, const PakBuildOptions& options, const PreviousPak& previous,
+                            Dictionary& out_dictionary)
+    {
+        std::vector<size_t> sample_jobs;
+        std::vector<u8> samples;
+        std::vector<size_t> sample_sizes;
+        u64 samples_hash = mix(options.zstd_dict_size);
+
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            const PakInput& input = *jobs[i].input;
+            FileMapping mapping;
+            Error error;
+
+            if (input.method != zip_method::zstd)
+                continue;
+
+            // Errors are reported when the input is read again by its job.
+            if (!mapping.open(input.path.c_str(), error) || mapping.bytes().size() < options.min_compress_size
+                || mapping.bytes().size() > options.zstd_dict_max_input_size)
+            {
+                continue;
+            }
+
+            samples.insert(samples.end(), mapping.bytes().begin(), mapping.bytes().end());
+            sample_sizes.push_back(mapping.bytes().size());
+            sample_jobs.push_back(i);
+            samples_hash = mix(samples_hash ^ hash_content(mapping.bytes()));
+        }
+
+        if (sample_jobs.size() < min_dictionary_samples)
+            return false;
+
+        std::span<const u8> previous_dictionary = previous.find_dictionary(samples_hash);
+
+        if (!previous_dictionary.empty()) {
+            out_dictionary.data.assign(previous_dictionary.begin(), previous_dictionary.end());
+        } else {
+            out_dictionary.data.resize(options.zstd_dict_size);
+            size_t result = ZDICT_trainFromBuffer(out_dictionary.data.data(), out_dictionary.data.size(),
+                                                  samples.data(), sample_sizes.data(), unsigned(sample_sizes.size()));
+
+            if (ZDICT_isError(result)) {
+                LOG_WARNING("Can't train Zstandard dictionary: {}", ZDICT_getErrorName(result));
+                return false;
+            }
+
+            out_dictionary.data.resize(result);
+        }
+
+        out_dictionary.id = ZDICT_getDictID(out_dictionary.data.data(), out_dictionary.data.size());
+        out_dictionary.samples_hash = samples_hash;
+
+        for (size_t i : sample_jobs) {
+            int level = jobs[i].input->level;
+            ZSTD_CDict*& cdict = out_dictionary.cdicts[level];
+
+            if (!cdict) {
+                cdict = ZSTD_createCDict(out_dictionary.data.data(), out_dictionary.data.size(), level);
+
+                if (!cdict)
+                    FATAL("ZSTD_createCDict failed");
+            }
+
+            jobs[i].cdict = cdict;
+        }
+
+        return true;
+    }
+
+    // Sorts inputs by the order in which they were first read in the asset traces.
+    bool order_inputs(std::vector<PakInput>& inputs, std::span<const OsString> trace_paths, Error& out_error)
+    {
+        std::vector<std::string> trace_names;
+
+        for (const OsString& trace_path : trace_paths) {
+            Error error;
+
+            if (!TracingProvider::load_trace(trace_path.c_str(), trace_names, error)) {
+                out_error = {.description = fmt::format("Can't read asset trace: {}", trace_path),
+                             .cause = std::move(error)};
+                return false;
+            }
+        }
+
+        std::unordered_map<std::string_view, size_t> ranks;
+
+        for (size_t i = 0; i < trace_names.size(); ++i)
+            ranks.emplace(trace_names[i], i);
+
+        auto get_rank = [&](const PakInput& input) {
+            auto it = ranks.find(input.name);
+            return it != ranks.end() ? it->second : trace_names.size();
+        };
+
+        std::stable_sort(inputs.begin(), inputs.end(), [&](const PakInput& a, const PakInput& b) {
+            return get_rank(a) < get_rank(b);
+        });
+
+        return true;
+    }
+
+    std::vector<u8> build_manifest(const std::vector<Job>& jobs, const Dictionary& dictionary)
+    {
+        std::vector<u8> manifest(manifest_header_size, 0);
+        u32 num_records = 0;
+
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            const ContentKey& key = jobs[i].key;
+
+            if (key.method == zip_method::store || jobs[i].alias)
+                continue;
+
+            size_t pos = manifest.size();
+            manifest.resize(pos + manifest_record_size, 0);
+            endian::store_le64(&manifest[pos], key.hash);
+            endian::store_le32(&manifest[pos + 8], jobs[i].entry_index);
+            endian::store_le32(&manifest[pos + 12], key.frame_size);
+            endian::store_le32(&manifest[pos + 16], u32(key.level));
+            endian::store_le16(&manifest[pos + 20], key.method);
+            endian::store_le32(&manifest[pos + 24], key.dictionary_id);
+            endian::store_le32(&manifest[pos + 28], key.min_decode_speed);
+            ++num_records;
+        }
+
+        endian::store_le32(&manifest[0], manifest_magic);
+        endian::store_le16(&manifest[4], manifest_version);
+        endian::store_le32(&manifest[8], num_records);
+        endian::store_le64(&manifest[16], dictionary.samples_hash);
+        return manifest;
+    }
+
+} // namespace
+
+PakBuilder::PakBuilder(const PakBuildOptions& options)
+    : options_{options}
+{
+}
+
+void PakBuilder::add(PakInput&& input)
+{
+    inputs_.push_back(std::move(input));
+}
+
+bool PakBuilder::build(const oschar_t* path, Error& out_error)
+{
+    stats_ = {};
+
+    if (!options_.trace_paths.empty() && !order_inputs(inputs_, options_.trace_paths, out_error))
+        return false;
+
+    // Duplicate names would make the archive ambiguous.
+    std::unordered_set<std::string_view> names;
+
+    for (const PakInput& input : inputs_) {
+        if (!ZipDirectory::is_stream_name(input.name)) {
+            out_error = {.description = fmt::format("Invalid entry name: {}", input.name)};
+            return false;
+        } else if (!names.insert(input.name).second) {
+            out_error = {.description = fmt::format("Duplicate entry name: {}", input.name)};
+            return false;
+        }
+    }
+
+    PreviousPak previous;
+
+    if (!options_.previous_path.empty())
+        previous.open(options_.previous_path.c_str());
+
+    std::filesystem::path final_path{path};
+    std::filesystem::path temp_path{OsString{path} + OSSTR ".tmp"};
+    ZipWriter writer;
+
+    bool succeeded = false;
+
+    if (!writer.open(temp_path.c_str(), out_error))
+        return false;
+
+    Finally remove_temp_file = [&] {
+        if (!succeeded) {
+            std::error_code ec;
+            writer.close();
+            std::filesystem::remove(temp_path, ec);
+        }
+    };
+
+    std::vector<Job> jobs(inputs_.size());
+
+    for (size_t i = 0; i < jobs.size(); ++i)
+        jobs[i].input = &inputs_[i];
+
+    // The dictionary is written first so it's near the small entries that use it.
+    Dictionary dictionary;
+
+    if (options_.zstd_dict_size && prepare_dictionary(jobs, options_, previous, dictionary)) {
+        ZipDirectoryEntry dictionary_entry = {.name = zstd_dictionary_name,
+                                              .crc = crc32::update(0, dictionary.data),
+                                              .size = dictionary.data.size()};
+
+        if (!writer.add(std::move(dictionary_entry), dictionary.data, out_error))
+            return false;
+
+        stats_.dictionary_size = dictionary.data.size();
+    }
+
+    // Start the compression threads. They may prepare a limited number of inputs ahead of the
+    // writer, which bounds the amount of memory held by compressed entries.
+    size_t num_threads = options_.num_threads ? options_.num_threads : std::max(1u, std::thread::hardware_concurrency());
+    size_t window = num_threads * 2;
+    size_t next_job = 0;
+    size_t num_written = 0;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<std::thread> threads;
+    ContentOwners owners;
+
+    for (size_t i = 0; i < std::min(num_threads, jobs.size()); ++i) {
+        threads.emplace_back([&] {
+            Workspace workspace;
+
+            for (;;) {
+                size_t index;
+
+                {
+                    std::unique_lock lock{mutex};
+                    cond.wait(lock, [&] { return next_job >= jobs.size() || next_job < num_written + window; });
+
+                    if (next_job >= jobs.size())
+                        return;
+
+                    index = next_job++;
+                }
+
+                prepare_job(jobs[index], index, options_, previous, owners, workspace);
+
+                {
+                    std::lock_guard lock{mutex};
+                    jobs[index].done = true;
+                }
+
+                cond.notify_all();
+            }
+        });
+    }
+
+    Finally join_threads = [&] {
+        {
+            std::lock_guard lock{mutex};
+            next_job = jobs.size(); // Cancel any remaining jobs
+        }
+
+        cond.notify_all();
+
+        for (std::thread& thread : threads)
+            thread.join();
+    };
+
+    // Write the entries in input order as they become ready. Entries with the same contents as an
+    // earlier entry share its data.
+    std::unordered_multimap<u64, size_t> written_contents; // Content hash -> index of the job that wrote it
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        Job& job = jobs[i];
+
+        {
+            std::unique_lock lock{mutex};
+            cond.wait(lock, [&] { return job.done; });
+        }
+
+        if (job.error) {
+            out_error = {.description = fmt::format("Can't add '{}'", job.input->name),
+                         .cause = std::move(job.error)};
+            return false;
+        }
+
+        auto [begin, end] = written_contents.equal_range(job.key.hash);
+        auto owner_it = std::find_if(begin, end, [&](const auto& pair) {
+            const Job& owner = jobs[pair.second];
+            return owner.key.size == job.key.size && owner.key.crc == job.key.crc;
+        });
+
+        job.entry_index = u32(writer.entries().size());
+
+        if (owner_it != end) {
+            if (!writer.add_alias(job.input->name, jobs[owner_it->second].entry_index, out_error))
+                return false;
+
+            job.alias = true;
+            ++stats_.num_aliases;
+        } else {
+            ZipDirectoryEntry entry = {.name = job.input->name, .method = job.method, .crc = job.key.crc,
+                                       .size = job.key.size};
+
+            if (!writer.add(std::move(entry), job.data, out_error))
+                return false;
+
+            written_contents.emplace(job.key.hash, i);
+        }
+
+        stats_.input_size += job.key.size;
+
+        if (!job.alias) {
+            stats_.num_compressed += job.method != zip_method::store && !job.reused;
+            stats_.num_reused += job.reused;
+            stats_.num_dict_compressed += job.method == zip_method::zstd_dict;
+            stats_.num_lz4_compressed += job.method == zip_method::lz4;
+        }
+
+        // Release the job's memory before more jobs are started.
+        job.compressed = {};
+        job.data = {};
+        job.mapping.close();
+
+        {
+            std::lock_guard lock{mutex};
+            num_written = i + 1;
+        }
+
+        cond.notify_all();
+    }
+
+    // Metadata entries follow the inputs, and the index is written last so it can describe all of
+    // the other entries.
+    std::vector<u8> manifest = build_manifest(jobs, dictionary);
+    ZipDirectoryEntry manifest_entry = {.name = manifest_name, .crc = crc32::update(0, manifest),
+                                        .size = manifest.size()};
+
+    if (!writer.add(std::move(manifest_entry), manifest, out_error))
+        return false;
+
+    if (options_.index) {
+        std::vector<ZipIndexEntry> index_entries;
+        std::vector<u8> index_data;
+
+        for (const ZipDirectoryEntry& entry : writer.entries()) {
+            index_entries.push_back({
+                .name = entry.name,
+                .index = u32(index_entries.size()),
+                .method = entry.method,
+                .crc = entry.crc,
+                .header_offset = entry.header_offset,
+                .data_offset = entry.data_offset,
+                .compressed_size = entry.compressed_size,
+                .size = entry.size,
+            });
+        }
+
+        if (!ZipIndex::build(index_entries, index_data, out_error))
+            return false;
+
+        ZipDirectoryEntry index_entry = {.name = ZipIndex::entry_name, .crc = crc32::update(0, index_data),
+                                         .size = index_data.size()};
+
+        if (!writer.add(std::move(index_entry), index_data, out_error))
+            return false;
+    }
+
+    stats_.num_entries = writer.entries().size();
+
+    if (!writer.finish(out_error))
+        return false;
+
+    stats_.output_size = writer.get_offset();
+
+    // The previous PAK may be the file being replaced, which can't be replaced while it's mapped on
+    // some platforms.
+    previous.close();
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, final_path, ec);
+
+    if (ec) {
+        out_error = {.description = "Can't replace PAK", .code = ec};
+        return false;
+    }
+
+    succeeded = true;
+    return true;
+}
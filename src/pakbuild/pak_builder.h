@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef PAKBUILD_PAK_BUILDER_H_INCLUDED
+#define PAKBUILD_PAK_BUILDER_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include <io/zip_directory.h>
+
+namespace geo {
+
+    /// File to be added to a PAK.
+    struct PakInput {
+        /// Method that compresses the input with the codec that best fits
+        /// @ref PakBuildOptions::min_decode_speed.
+        static constexpr u16 auto_method = 0xffff;
+
+        OsString path{};
+        std::string name{}; ///< UTF-8 entry name
+        u16 method = zip_method::store; ///< Zstandard, LZ4, or @ref auto_method if compressed
+        int level = 0; ///< Compression level, or 0 for the codec's default
+    };
+
+    /// Options that control how a PAK is built.
+    struct PakBuildOptions {
+        size_t min_compress_size = 0; ///< Smaller inputs are stored uncompressed
+        size_t zstd_frame_size = 0; ///< Uncompressed bytes per Zstandard or LZ4 frame, or 0 for one frame
+        size_t zstd_dict_size = 0; ///< Maximum size of the shared Zstandard dictionary, or 0 for none
+        size_t zstd_dict_max_input_size = 16*1024; ///< Larger inputs don't use the dictionary
+        size_t min_decode_speed = 1000; ///< Decode speed required by @ref PakInput::auto_method, in MB/s
+        size_t num_threads = 0; ///< Number of compression threads, or 0 for one per core
+        bool index = false; ///< Write a @ref ZipIndex
+        OsString previous_path{}; ///< PAK whose compressed entries may be reused, if any
+        std::vector<OsString> trace_paths{}; ///< Asset traces that determine the order of entries
+    };
+
+    /// Counters reported after a PAK is built.
+    struct PakBuildStats {
+        size_t num_entries = 0;
+        size_t num_compressed = 0;
+        size_t num_reused = 0;
+        size_t num_dict_compressed = 0; ///< Entries compressed with the shared dictionary
+        size_t num_lz4_compressed = 0;
+        size_t num_aliases = 0; ///< Entries that share the data of an identical entry
+        size_t dictionary_size = 0;
+        u64 input_size = 0;
+        u64 output_size = 0;
+    };
+
+    /// Builds PAK files. Inputs are read and compressed on a pool of threads while the archive is
+    /// written sequentially in input order, so the archive is written in a single pass without
+    /// holding every compressed entry in memory.
+    ///
+    /// A manifest of the compressed entries' content hashes and compression parameters is stored in
+    /// the entry named @ref PakBuilder::manifest_name. When rebuilding, entries of the previous PAK
+    /// whose content and parameters match an input are copied instead of compressed again, even if
+    /// the input was renamed.
+    ///
+    /// Small inputs compress poorly on their own, so if @ref PakBuildOptions::zstd_dict_size is
+    /// nonzero, a Zstandard dictionary is trained on the small Zstandard inputs and stored in the
+    /// entry named @ref zstd_dictionary_name, and those inputs are compressed with it using
+    /// @ref zip_method::zstd_dict. The dictionary is reused from the previous PAK if it was trained
+    /// on the same inputs.
+    ///
+    /// Inputs with identical contents are written once. Later entries are added to the central
+    /// directory with the first entry's local header offset, so they share its data and
+    /// compression.
+    ///
+    /// Inputs using @ref PakInput::auto_method are compressed with both Zstandard and LZ4, and each
+    /// result is decoded to measure its decode speed on this machine. The smallest result that
+    /// decodes at least as fast as @ref PakBuildOptions::min_decode_speed is written. If neither
+    /// does, the input is stored.
+    ///
+    /// If asset traces recorded by @ref TracingProvider are given, inputs are written in the order
+    /// they were first read in the first trace, followed by inputs first read in each later trace,
+    /// so assets that are loaded together are adjacent and loading reads the PAK sequentially.
+    /// Inputs that weren't traced follow in the order they were added.
+    class PakBuilder {
+    public:
+        /// Name of the archive entry containing the build manifest.
+        static constexpr const char* manifest_name = ".geo/build";
+
+        PakBuilder(const PakBuilder&) = delete;
+        explicit PakBuilder(const PakBuildOptions& options);
+
+        void add(PakInput&& input);
+
+        /// Builds the PAK. It's written to a temporary file that replaces `path` when complete.
+        bool build(const oschar_t* path, Error& out_error);
+
+        const PakBuildStats& get_stats() const { return stats_; }
+
+    private:
+        PakBuildOptions options_;
+        std::vector<PakInput> inputs_;
+        PakBuildStats stats_;
+    };
+
+} // namespace geo
+
+#endif // PAKBUILD_PAK_BUILDER_H_INCLUDED
@@ -6,19 +6,54 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
+#include <algorithm>
+#include <iterator>
+
 #include <system/debug.h>
 
 #include "gl.h"
 
 using namespace geo;
 
+namespace {
+
+    // Error codes that are rate-limited separately. Other codes share one more site.
+    constexpr GLenum known_errors[] = {
+        GL_INVALID_ENUM,
+        GL_INVALID_FRAMEBUFFER_OPERATION,
+        GL_INVALID_OPERATION,
+        GL_INVALID_VALUE,
+        GL_OUT_OF_MEMORY,
+        GL_STACK_OVERFLOW,
+        GL_STACK_UNDERFLOW,
+    };
+
+    // The same errors tend to repeat every frame, so they're rate-limited. Each error code has its
+    // own site so that a frequent error doesn't hide the others.
+    void log_error(GLenum errnum)
+    {
+        struct ErrorLogSite : debug::detail::LimitedLogSite {
+            constexpr ErrorLogSite()
+                : LimitedLogSite{{LOG_SITE_FILE, __LINE__, LogLevel::error}, debug::detail::LogLimit::interval(1000)}
+            {
+            }
+        };
+
+        static ErrorLogSite sites[std::size(known_errors) + 1];
+        size_t index = size_t(std::find(std::begin(known_errors), std::end(known_errors), errnum) - known_errors);
+
+        LOG_LIMITED_AT(LogLevel::error, sites[index], "OpenGL: {}", gl::strerror(errnum));
+    }
+
+} // namespace
+
 void gl::flush_errors()
 {
     GLenum errnum;
     int num_errors = 0;
 
     while ((errnum = glGetError()) != GL_NO_ERROR) {
-        LOG_ERROR("OpenGL: {}", gl::strerror(errnum));
+        log_error(errnum);
 
         if (++num_errors == 50)
             FATAL("Too many OpenGL errors");
@@ -83,6 +83,7 @@ void render::shut_down()
 
 void render::begin_draw()
 {
+    PROFILE_SCOPE("begin_draw");
     Vec2i window_size = display::size();
 
     glViewport(0, 0, window_size.x, window_size.y);
@@ -90,11 +91,13 @@ void render::begin_draw()
 
 void render::end_draw()
 {
+    PROFILE_SCOPE("end_draw");
     gl::flush_errors();
 }
 
 void render::present()
 {
+    PROFILE_SCOPE("present");
     display::gl_swap_buffers();
 }
 
@@ -6,7 +6,7 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
-#include <io/stream.h>
+#include <io/preloader.h>
 #include <system/debug.h>
 
 #include "gl.h"
@@ -32,6 +32,18 @@ GlShader::~GlShader()
 }
 
 void GlShader::compile(StreamProvider& data_source, const char* name, GLenum type)
+{
+    // Load the shader source.
+    Error error;
+    ByteBuffer source = data_source.read_stream_buffer(name, max_shader_source_size, error);
+
+    if (error)
+        FATAL("{}: {}", name, error);
+
+    compile(name, source.bytes(), type);
+}
+
+void GlShader::compile(const char* name, std::span<const u8> source, GLenum type)
 {
     gl::flush_errors();
 
@@ -43,13 +55,6 @@ void GlShader::compile(StreamProvider& data_source, const char* name, GLenum typ
     if (!shader_id_)
         FATAL("glCreateShader: {}", gl::strerror(glGetError()));
 
-    // Load the shader source.
-    Error error;
-    auto source = data_source.read_stream_bytes(name, max_shader_source_size, error);
-
-    if (error)
-        FATAL("{}: {}", name, error);
-
     // Compile the shader source.
     const GLchar* source_ptr = reinterpret_cast<const GLchar*>(source.data());
     GLsizei source_len = GLsizei(source.size());
@@ -130,9 +135,22 @@ void render::init_shaders(StreamProvider& data_source)
     GlShader vert_color;
     GlShader frag_color;
 
-    vert_color.compile(data_source, "shaders/gl/color.vert", GL_VERTEX_SHADER);
+    // Load all shader sources in parallel before compiling them on this thread.
+    Preloader preloader{data_source};
+    auto batch = preloader.load({"shaders/gl/color.vert", "shaders/gl/color.frag"}, max_shader_source_size);
+
+    batch->wait();
+
+    std::span<PreloadResult> sources = batch->results();
+
+    for (const PreloadResult& source : sources) {
+        if (source.error)
+            FATAL("{}: {}", source.name, source.error);
+    }
+
+    vert_color.compile(sources[0].name.c_str(), sources[0].data.bytes(), GL_VERTEX_SHADER);
 
-    frag_color.compile(data_source, "shaders/gl/color.frag", GL_FRAGMENT_SHADER);
+    frag_color.compile(sources[1].name.c_str(), sources[1].data.bytes(), GL_FRAGMENT_SHADER);
 
     prog_color.link("prog_color", vert_color, frag_color);
 }
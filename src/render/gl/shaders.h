@@ -9,6 +9,8 @@
 #ifndef RENDER_GL_SHADERS_H_INCLUDED
 #define RENDER_GL_SHADERS_H_INCLUDED
 
+#include <span>
+
 #include "types.h"
 
 namespace geo {
@@ -35,6 +37,7 @@ namespace geo {
             GlShader& operator=(const GlShader&) = delete;
 
             void compile(StreamProvider& data_source, const char* name, GLenum type);
+            void compile(const char* name, std::span<const u8> source, GLenum type);
             GLuint shader_id() const { return shader_id_; }
 
         private:
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SYSTEM_ASYNC_FILE_H_INCLUDED
+#define SYSTEM_ASYNC_FILE_H_INCLUDED
+
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "error.h"
+
+namespace geo {
+
+    /// Called when an asynchronous read completes, with the number of bytes read. This is less than
+    /// the requested size only if the end of the file was reached or an error occurred.
+    using AsyncReadCallback = std::function<void(size_t size, Error& error)>;
+
+    /// Asynchronous positional read from an @ref AsyncFile.
+    struct AsyncReadRequest {
+        u64 offset = 0;
+        std::span<u8> buffer{};
+        AsyncReadCallback callback{};
+    };
+
+    /// Read-only file that performs positional reads asynchronously. On Linux, reads are submitted
+    /// through io_uring where available. Otherwise, they are performed by a pool of threads.
+    /// Callbacks are invoked on a pool of worker threads, so they may do CPU-bound work, e.g.,
+    /// decompression, while other reads are still in flight.
+    class AsyncFile {
+    public:
+        AsyncFile();
+        AsyncFile(const AsyncFile&) = delete;
+        explicit AsyncFile(const oschar_t* path, Error& out_error, size_t num_threads = 0);
+        ~AsyncFile();
+
+        AsyncFile& operator=(const AsyncFile&) = delete;
+
+        /// Waits for all pending reads to complete, then closes the file.
+        void close();
+
+        bool is_open() const { return impl_ != nullptr; }
+
+        /// Opens the file. If `num_threads` is zero, one worker thread is used per hardware thread.
+        bool open(const oschar_t* path, Error& out_error, size_t num_threads = 0);
+
+        /// Gets the name of the mechanism used to perform reads, e.g., "io_uring".
+        const char* get_backend_name() const;
+
+        /// Hints that a byte range of the file will be read soon, so the OS can start reading it
+        /// into the page cache in the background. This doesn't wait for I/O.
+        void prefetch(u64 offset, u64 size);
+
+        /// Submits a batch of reads. The buffers must remain valid until the callbacks are called.
+        /// This may be called from any thread, including from callbacks.
+        void submit(std::vector<AsyncReadRequest>&& requests);
+
+    private:
+        struct Impl;
+
+        std::unique_ptr<Impl> impl_;
+    };
+
+} // namespace geo
+
+#endif // SYSTEM_ASYNC_FILE_H_INCLUDED
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <bit>
+#include <cstring>
+#include <iterator>
+
+#include <fmt/args.h>
+
+#include "binary_log.h"
+#include "encoding.h"
+
+using namespace geo;
+using namespace geo::debug;
+
+// Arguments are stored in native byte order, but log files are documented as little-endian.
+static_assert(std::endian::native == std::endian::little);
+
+namespace {
+
+    template<typename T>
+    bool read_arg_value(std::span<const u8>& args, T& out_value)
+    {
+        if (args.size() < sizeof(T))
+            return false;
+
+        std::memcpy(&out_value, args.data(), sizeof(T));
+        args = args.subspan(sizeof(T));
+        return true;
+    }
+
+    template<typename Char>
+    bool format_log_args_impl(fmt::basic_memory_buffer<Char>& out, std::basic_string_view<Char> fmt,
+                              std::span<const u8> args)
+    {
+        fmt::dynamic_format_arg_store<fmt::buffered_context<Char>> store;
+
+        while (!args.empty()) {
+            LogArgType type = LogArgType(args[0]);
+            args = args.subspan(1);
+
+            switch (type) {
+                case LogArgType::boolean: {
+                    u8 value;
+                    if (!read_arg_value(args, value))
+                        return false;
+                    store.push_back(value != 0);
+                    break;
+                }
+
+                case LogArgType::character: {
+                    u32 value;
+                    if (!read_arg_value(args, value))
+                        return false;
+                    store.push_back(Char(value));
+                    break;
+                }
+
+                case LogArgType::int64: {
+                    i64 value;
+                    if (!read_arg_value(args, value))
+                        return false;
+                    store.push_back(value);
+                    break;
+                }
+
+                case LogArgType::uint64: {
+                    u64 value;
+                    if (!read_arg_value(args, value))
+                        return false;
+                    store.push_back(value);
+                    break;
+                }
+
+                case LogArgType::float32: {
+                    f32 value;
+                    if (!read_arg_value(args, value))
+                        return false;
+                    store.push_back(value);
+                    break;
+                }
+
+                case LogArgType::float64: {
+                    f64 value;
+                    if (!read_arg_value(args, value))
+                        return false;
+                    store.push_back(value);
+                    break;
+                }
+
+                case LogArgType::string: {
+                    u32 length;
+                    if (!read_arg_value(args, length) || args.size() < length)
+                        return false;
+
+                    // The store refers to the string without copying it.
+                    std::string_view str{reinterpret_cast<const char*>(args.data()), length};
+                    args = args.subspan(length);
+
+                    if constexpr (std::is_same_v<Char, char>)
+                        store.push_back(str);
+                    else
+                        store.push_back(Widen{str});
+                    break;
+                }
+
+                case LogArgType::pointer: {
+                    u64 value;
+                    if (!read_arg_value(args, value))
+                        return false;
+                    store.push_back(reinterpret_cast<const void*>(uptr(value)));
+                    break;
+                }
+
+                default:
+                    return false;
+            }
+        }
+
+        fmt::vformat_to(std::back_inserter(out), fmt, store);
+        return true;
+    }
+
+} // namespace
+
+bool debug::format_log_args(fmt::basic_memory_buffer<char>& out, std::string_view fmt, std::span<const u8> args)
+{
+    return format_log_args_impl(out, fmt, args);
+}
+
+#ifdef _WIN32
+bool debug::format_log_args(fmt::basic_memory_buffer<wchar_t>& out, std::wstring_view fmt, std::span<const u8> args)
+{
+    return format_log_args_impl(out, fmt, args);
+}
+#endif
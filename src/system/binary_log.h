@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SYSTEM_BINARY_LOG_H_INCLUDED
+#define SYSTEM_BINARY_LOG_H_INCLUDED
+
+#include <concepts>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+#include <fmt/format.h>
+#include <fmt/xchar.h>
+
+#include <core/types.h>
+
+// Binary log records, which store a log message's arguments instead of formatting it. Records are
+// formatted later by the logger thread, or offline by `geo_logdecode` if they're written to a
+// binary log file.
+//
+// A binary log file starts with the 6-byte magic `GEOLOG`, a version byte, and the size of the
+// writer's `oschar_t` in bytes. It's followed by records that start with a @ref LogFileRecord byte.
+// All integers are little-endian, and text is stored as `oschar_t` code units.
+//
+//  - `site`: u32 site ID, u8 level, u32 line, u16 file name length, file name (narrow), u32 format
+//    string length, format string. Written before the first message from the call site.
+//  - `message`: u32 site ID, u32 argument data size, argument data.
+//  - `text`: u8 level, u32 line, u16 file name length, file name (narrow), u32 text length, text.
+//    Written for messages that were formatted when they were logged.
+
+namespace geo::debug {
+
+    inline constexpr u8 log_file_magic[6] = {'G', 'E', 'O', 'L', 'O', 'G'};
+    inline constexpr u8 log_file_version = 1;
+    inline constexpr size_t log_file_header_size = 8;
+
+    /// Type of a record in a binary log file.
+    enum class LogFileRecord : u8 {
+        site = 1,
+        message = 2,
+        text = 3,
+    };
+
+    /// Type of an argument in a binary log record. Each argument is a type byte followed by its
+    /// value in native byte order: `boolean` is 1 byte, `character` and `float32` are 4 bytes,
+    /// `int64`, `uint64`, `float64` and `pointer` are 8 bytes, and `string` is a u32 length followed
+    /// by the string's narrow characters.
+    enum class LogArgType : u8 {
+        boolean = 1,
+        character = 2,
+        int64 = 3,
+        uint64 = 4,
+        float32 = 5,
+        float64 = 6,
+        string = 7,
+        pointer = 8,
+    };
+
+    /// Buffer of encoded log arguments.
+    using LogArgBuffer = fmt::basic_memory_buffer<u8, 256>;
+
+    /// Concept for argument types that can be stored in binary log records. Other types are
+    /// formatted when they're logged.
+    template<typename T>
+    concept BinaryLogArg = (std::is_arithmetic_v<T> && sizeof(T) <= 8 && !std::same_as<T, long double>)
+                           || std::same_as<T, const void*> || std::same_as<T, void*>
+                           || std::convertible_to<const T&, std::string_view>;
+
+    namespace detail {
+
+        inline void put_log_arg(LogArgBuffer& buffer, LogArgType type, const void* value, size_t size)
+        {
+            const u8* bytes = static_cast<const u8*>(value);
+
+            buffer.push_back(u8(type));
+            buffer.append(bytes, bytes + size);
+        }
+
+    } // namespace detail
+
+    /// Appends an encoded argument to a buffer.
+    template<BinaryLogArg T>
+    void write_log_arg(LogArgBuffer& buffer, const T& arg)
+    {
+        if constexpr (std::same_as<T, bool>) {
+            u8 value = arg ? 1 : 0;
+            detail::put_log_arg(buffer, LogArgType::boolean, &value, 1);
+        } else if constexpr (std::same_as<T, char> || std::same_as<T, wchar_t>) {
+            u32 value = u32(arg);
+            detail::put_log_arg(buffer, LogArgType::character, &value, 4);
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            i64 value = arg;
+            detail::put_log_arg(buffer, LogArgType::int64, &value, 8);
+        } else if constexpr (std::is_integral_v<T>) {
+            u64 value = arg;
+            detail::put_log_arg(buffer, LogArgType::uint64, &value, 8);
+        } else if constexpr (std::same_as<T, float>) {
+            detail::put_log_arg(buffer, LogArgType::float32, &arg, 4);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            f64 value = arg;
+            detail::put_log_arg(buffer, LogArgType::float64, &value, 8);
+        } else if constexpr (std::convertible_to<const T&, std::string_view>) {
+            std::string_view str = arg;
+            const u8* bytes = reinterpret_cast<const u8*>(str.data());
+            u32 length = u32(str.size());
+            detail::put_log_arg(buffer, LogArgType::string, &length, 4);
+            buffer.append(bytes, bytes + length);
+        } else {
+            u64 value = u64(reinterpret_cast<uptr>(arg));
+            detail::put_log_arg(buffer, LogArgType::pointer, &value, 8);
+        }
+    }
+
+    /// Formats a message from the encoded arguments of a binary log record. Returns false if the
+    /// arguments are malformed.
+    bool format_log_args(fmt::basic_memory_buffer<char>& out, std::string_view fmt, std::span<const u8> args);
+
+#ifdef _WIN32
+    bool format_log_args(fmt::basic_memory_buffer<wchar_t>& out, std::wstring_view fmt, std::span<const u8> args);
+#endif
+
+} // namespace geo::debug
+
+#endif // SYSTEM_BINARY_LOG_H_INCLUDED
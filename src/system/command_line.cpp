@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <limits>
+
+#include "command_line.h"
+#include "debug.h"
+
+using namespace geo;
+
+namespace {
+
+    const CommandLineOption& find_option(std::span<const CommandLineOption> options, OsStringView name)
+    {
+        for (const CommandLineOption& option : options)
+            if (option.name == name)
+                return option;
+
+        FATAL("Invalid option: --{}", name);
+    }
+
+} // namespace
+
+void command_line::parse(int argc, const oschar_t* const argv[], std::span<const CommandLineOption> options,
+                         void (*handle_argument)(const oschar_t* arg))
+{
+    if (argc < 1 || !argv || !argv[0])
+        return;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!argv[i])
+            break;
+
+        // Only long options are accepted, e.g., `--option`. Other arguments are left to the caller.
+        if (argv[i][0] != '-' || argv[i][1] != '-' || argv[i][2] == 0) {
+            if (handle_argument)
+                handle_argument(argv[i]);
+            else if (argv[i][0] != '-' || argv[i][1] == 0 || argv[i][1] == '-')
+                FATAL("Unexpected argument: {}", argv[i]);
+            else if (argv[i][2])
+                FATAL("Invalid option: -{} ({})", argv[i][1], argv[i]);
+            else
+                FATAL("Invalid option: -{}", argv[i][1]);
+
+            continue;
+        }
+
+        // Get the option string.
+        OsStringView name = &argv[i][2];
+        const oschar_t* equals_pos = str::find(name.data(), '=');
+        const oschar_t* param = nullptr;
+
+        if (equals_pos) {
+            name = name.substr(0, size_t(equals_pos - name.data()));
+            param = equals_pos + 1;
+        }
+
+        // Find the option entry.
+        const CommandLineOption& option = find_option(options, name);
+
+        if (option.expects_param) {
+            if (!param) {
+                if (i + 1 < argc && argv[i + 1])
+                    param = argv[++i];
+                else
+                    FATAL("Missing parameter: {}", argv[i]);
+            }
+        } else if (param) {
+            FATAL("Unexpected parameter: {}", argv[i]);
+        }
+
+        // Handle the option.
+        option.callback(param);
+    }
+}
+
+size_t command_line::parse_size(OsStringView str)
+{
+    size_t value = 0;
+    size_t pos = 0;
+
+    for (; pos < str.size() && str[pos] >= '0' && str[pos] <= '9'; ++pos) {
+        size_t digit = size_t(str[pos] - '0');
+
+        if (value > (std::numeric_limits<size_t>::max() - digit) / 10)
+            FATAL("Size is too large: {}", str);
+
+        value = value * 10 + digit;
+    }
+
+    if (!pos)
+        FATAL("Invalid size: {}", str);
+
+    OsStringView suffix = str.substr(pos);
+    int shift;
+
+    if (suffix.empty())
+        shift = 0;
+    else if (suffix == OSSTR "K")
+        shift = 10;
+    else if (suffix == OSSTR "M")
+        shift = 20;
+    else if (suffix == OSSTR "G")
+        shift = 30;
+    else
+        FATAL("Invalid size: {}", str);
+
+    if (value > std::numeric_limits<size_t>::max() >> shift)
+        FATAL("Size is too large: {}", str);
+
+    return value << shift;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SYSTEM_COMMAND_LINE_H_INCLUDED
+#define SYSTEM_COMMAND_LINE_H_INCLUDED
+
+#include <span>
+
+#include <core/str.h>
+
+namespace geo {
+
+    /// Long option accepted by @ref command_line::parse, e.g., `--name`, `--name=param`, or
+    /// `--name param`.
+    struct CommandLineOption {
+        OsStringView name = {};
+        bool expects_param = false;
+        void (*callback)(const oschar_t* param) = nullptr; ///< `param` is null if not expected
+    };
+
+    /// Command line parsing shared by the executables. Invalid arguments are fatal errors.
+    namespace command_line {
+
+        /// Calls the callback of each option in `argv`. Arguments that aren't options are passed to
+        /// `handle_argument`, or are rejected if it's null.
+        void parse(int argc, const oschar_t* const argv[], std::span<const CommandLineOption> options,
+                   void (*handle_argument)(const oschar_t* arg) = nullptr);
+
+        /// Parses a size in bytes with an optional `K`, `M`, or `G` suffix.
+        size_t parse_size(OsStringView str);
+
+    } // namespace command_line
+
+} // namespace geo
+
+#endif // SYSTEM_COMMAND_LINE_H_INCLUDED
@@ -6,22 +6,657 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
+#include <errno.h>
+#include <stdio.h>
+
+#include <atomic>
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+#include <core/endian.h>
 #include <math/math.h>
 
-#include "debug.h"
+#include "error.h"
+#include "logger.h"
 
 using namespace geo;
+using namespace geo::debug::detail;
+
+namespace {
+
+    // Number of records the queue can hold. Must be a power of two.
+    constexpr size_t queue_capacity = 1024;
+
+    // Records with up to this many bytes of text or arguments are stored in the queue. Longer
+    // records are copied to the heap.
+    constexpr size_t inline_data_size = 200 * sizeof(oschar_t);
+
+    // Maximum number of records written by the logger thread at once.
+    constexpr size_t max_batch_size = 64;
+
+    // Least severe level of messages that are written to the console while a binary log file is
+    // open.
+    constexpr LogLevel binary_log_console_level = LogLevel::warning;
+
+    // Log record that hasn't been written yet. It contains either formatted text, or the encoded
+    // arguments of a message from a registered call site.
+    struct PendingRecord {
+        LogLevel level = LogLevel::none;
+        const char* file = nullptr;
+        int line = 0;
+        const LogSite* site = nullptr; // Set if `data` contains arguments instead of text
+        std::span<const u8> data{};
+    };
+
+    // Queued log record. Each slot's sequence number indicates whether it's free for the producer
+    // that claims position `sequence`, or holds a record for the consumer at position
+    // `sequence - 1`, as in Dmitry Vyukov's bounded MPMC queue. Slots are trivially destructible so
+    // that the logger thread may still use them while the process exits after a fatal error.
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence;
+        LogLevel level;
+        const char* file;
+        int line;
+        const LogSite* site;
+        size_t size;
+        u8* long_data; // Heap-allocated data if it doesn't fit in `data`
+        alignas(oschar_t) u8 data[inline_data_size];
+    };
+
+    Slot slots[queue_capacity];
+    std::atomic<size_t> enqueue_pos = 0;
+    size_t dequeue_pos = 0; // Only accessed by the logger thread
+    std::atomic<size_t> written_pos = 0; // Records before this position have been written
+    std::atomic<u32> wake_signal = 0; // Changed to wake the logger thread
+    std::atomic<size_t> num_dropped = 0;
+    std::atomic<bool> running = false;
+    std::atomic<bool> stopping = false;
+    std::atomic<debug::LogOverflow> overflow = debug::LogOverflow::block;
+    std::thread* logger_thread = nullptr; // Never destroyed if the process exits without shutting down
+    std::thread::id logger_thread_id{};
+    std::mutex sink_mutex; // Held while writing records
+
+    // Binary log file and the IDs of the sites that have been written to it. Guarded by
+    // `sink_mutex`.
+    FILE* binary_log = nullptr;
+    std::vector<bool> sites_written;
+    fmt::basic_memory_buffer<u8, 1024> binary_buffer;
+
+    // Text of the records being written that were formatted by `write_records`. Guarded by
+    // `sink_mutex`.
+    fmt::basic_memory_buffer<oschar_t> formatted;
+
+    // Number of registered call sites. Guarded by `site_mutex`.
+    u32 num_sites = 0;
+    std::mutex site_mutex;
+
+    // Rate-limited call sites that have logged a message, which are reported on shutdown if they
+    // suppressed any messages afterward.
+    std::atomic<LimitedLogSite*> limited_sites = nullptr;
+
+    // Prevents recursive log messages, i.e., when a `formatter` attempts to log a message.
+    thread_local bool in_log = false;
+
+    void wake_logger_thread()
+    {
+        wake_signal.fetch_add(1, std::memory_order_release);
+        wake_signal.notify_one();
+    }
+
+    std::span<const u8> as_bytes(std::basic_string_view<oschar_t> text)
+    {
+        return {reinterpret_cast<const u8*>(text.data()), text.size() * sizeof(oschar_t)};
+    }
+
+    std::basic_string_view<oschar_t> as_text(std::span<const u8> data)
+    {
+        return {reinterpret_cast<const oschar_t*>(data.data()), data.size() / sizeof(oschar_t)};
+    }
+
+    void put_u8(u8 value)
+    {
+        binary_buffer.push_back(value);
+    }
+
+    void put_u16(u16 value)
+    {
+        u8 bytes[2];
+        endian::store_le16(bytes, value);
+        binary_buffer.append(bytes, bytes + 2);
+    }
+
+    void put_u32(u32 value)
+    {
+        u8 bytes[4];
+        endian::store_le32(bytes, value);
+        binary_buffer.append(bytes, bytes + 4);
+    }
+
+    void put_bytes(std::span<const u8> bytes)
+    {
+        binary_buffer.append(bytes.data(), bytes.data() + bytes.size());
+    }
+
+    // Appends a source file name, which is a u16 length followed by the name.
+    void put_file(const char* file)
+    {
+        size_t length = file ? math::min(std::strlen(file), size_t(0xFFFF)) : 0;
+
+        put_u16(u16(length));
+        put_bytes({reinterpret_cast<const u8*>(file), length});
+    }
+
+    // Appends text, which is a u32 length in code units followed by the code units.
+    void put_text(std::basic_string_view<oschar_t> text)
+    {
+        put_u32(u32(text.size()));
+        put_bytes(as_bytes(text));
+    }
+
+    // Appends a record to `binary_buffer`, preceded by the definition of its call site if it's the
+    // site's first record.
+    void put_binary_record(const PendingRecord& record)
+    {
+        if (!record.site) {
+            put_u8(u8(debug::LogFileRecord::text));
+            put_u8(u8(record.level));
+            put_u32(u32(record.line));
+            put_file(record.file);
+            put_text(as_text(record.data));
+            return;
+        }
+
+        u32 id = record.site->id.load(std::memory_order_relaxed);
+
+        if (id >= sites_written.size())
+            sites_written.resize(id + 1);
+
+        if (!sites_written[id]) {
+            sites_written[id] = true;
+            put_u8(u8(debug::LogFileRecord::site));
+            put_u32(id);
+            put_u8(u8(record.site->level));
+            put_u32(u32(record.site->line));
+            put_file(record.site->file);
+            put_text({record.site->fmt.data(), record.site->fmt.size()});
+        }
+
+        put_u8(u8(debug::LogFileRecord::message));
+        put_u32(id);
+        put_u32(u32(record.data.size()));
+        put_bytes(record.data);
+    }
+
+    // Writes records to the binary log file, if it's open, and formats the records that are
+    // written to the console. Must be called with `sink_mutex` locked.
+    void write_records(std::span<const PendingRecord> records)
+    {
+        LogRecord sink_records[max_batch_size];
+        size_t count = 0;
+
+        if (binary_log) {
+            binary_buffer.clear();
+
+            for (const PendingRecord& record : records)
+                put_binary_record(record);
+
+            fwrite(binary_buffer.data(), 1, binary_buffer.size(), binary_log);
+            fflush(binary_log);
+        }
+
+        // Format the deferred messages. The text is referenced by offset until all of it has been
+        // formatted, since `formatted` may be reallocated.
+        size_t offsets[max_batch_size];
+        formatted.clear();
+
+        for (const PendingRecord& record : records) {
+            if (binary_log && record.level > binary_log_console_level)
+                continue;
+
+            sink_records[count] = {.level = record.level, .file = record.file, .line = record.line};
+
+            if (record.site) {
+                offsets[count] = formatted.size();
+
+                if (!debug::format_log_args(formatted, {record.site->fmt.data(), record.site->fmt.size()}, record.data)) {
+                    formatted.resize(offsets[count]);
+                    fmt::format_to(std::back_inserter(formatted), OSSTR "(malformed log record)");
+                }
+
+                sink_records[count].text = {nullptr, formatted.size() - offsets[count]};
+            } else {
+                offsets[count] = 0;
+                sink_records[count].text = as_text(record.data);
+            }
+
+            ++count;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (!sink_records[i].text.data())
+                sink_records[i].text = {formatted.data() + offsets[i], sink_records[i].text.size()};
+        }
+
+        if (count)
+            write_log_records({sink_records, count});
+    }
+
+    // Writes records synchronously, bypassing the queue.
+    void write_now(std::span<const PendingRecord> records)
+    {
+        std::lock_guard lock{sink_mutex};
+        write_records(records);
+    }
+
+    // Writes a message that reports dropped messages, if any.
+    void report_dropped()
+    {
+        size_t dropped = num_dropped.exchange(0, std::memory_order_relaxed);
+
+        if (!dropped)
+            return;
+
+        auto text = fmt::format(OSSTR "{} log messages were dropped because the queue was full", dropped);
+        PendingRecord record = {.level = LogLevel::warning, .data = as_bytes(text)};
+        write_records({&record, 1});
+    }
+
+    void close_binary_log()
+    {
+        if (binary_log) {
+            fclose(binary_log);
+            binary_log = nullptr;
+        }
+
+        sites_written.clear();
+    }
+
+    // Writes the records that are ready, in batches. Returns false if there were none. Only called
+    // by the logger thread, or after it has stopped.
+    bool drain_queue()
+    {
+        PendingRecord records[max_batch_size];
+        bool any_written = false;
+
+        for (;;) {
+            size_t count = 0;
+
+            while (count < max_batch_size) {
+                Slot& slot = slots[(dequeue_pos + count) & (queue_capacity - 1)];
+
+                if (slot.sequence.load(std::memory_order_acquire) != dequeue_pos + count + 1)
+                    break;
+
+                records[count++] = {
+                    .level = slot.level,
+                    .file = slot.file,
+                    .line = slot.line,
+                    .site = slot.site,
+                    .data = {slot.long_data ? slot.long_data : slot.data, slot.size},
+                };
+            }
+
+            if (!count)
+                return any_written;
+
+            {
+                std::lock_guard lock{sink_mutex};
+                write_records({records, count});
+                report_dropped();
+            }
+
+            // Release the slots to the producers.
+            for (size_t i = 0; i < count; ++i) {
+                Slot& slot = slots[(dequeue_pos + i) & (queue_capacity - 1)];
+
+                delete[] slot.long_data;
+                slot.long_data = nullptr;
+                slot.sequence.store(dequeue_pos + i + queue_capacity, std::memory_order_release);
+            }
+
+            dequeue_pos += count;
+            written_pos.store(dequeue_pos, std::memory_order_release);
+            written_pos.notify_all();
+            any_written = true;
+        }
+    }
+
+    void logger_thread_main()
+    {
+        for (;;) {
+            u32 signal = wake_signal.load(std::memory_order_acquire);
+
+            if (drain_queue())
+                continue;
+            else if (stopping.load(std::memory_order_acquire))
+                break;
+
+            wake_signal.wait(signal, std::memory_order_acquire);
+        }
+    }
+
+    // Logs the number of messages that a rate-limited call site suppressed.
+    void log_suppressed(const LimitedLogSite& site, u64 count)
+    {
+        if (count == 1)
+            vlog_src(site.file, site.line, site.level, OSSTR "1 similar message was suppressed", {});
+        else if (count)
+            vlog_src(site.file, site.line, site.level, OSSTR "{} similar messages were suppressed",
+                     make_format_args(count));
+    }
+
+    // Logs the messages that rate-limited call sites suppressed since they last logged a message.
+    void report_suppressed()
+    {
+        for (LimitedLogSite* site = limited_sites.load(std::memory_order_acquire); site; site = site->next) {
+            u64 count = site->count.load(std::memory_order_relaxed);
+            u64 reported = site->reported.exchange(count, std::memory_order_relaxed);
+
+            if (count > reported)
+                log_suppressed(*site, count - reported);
+        }
+    }
+
+    // Registers a call site, assigning its ID.
+    void register_site(LogSite& site, StringView fmt)
+    {
+        std::lock_guard lock{site_mutex};
+
+        if (site.id.load(std::memory_order_relaxed))
+            return;
+
+        site.fmt = fmt;
+        site.id.store(++num_sites, std::memory_order_release);
+    }
+
+    // Copies a record into the queue. Returns false if the record wasn't queued because the queue
+    // is full and the overflow policy is to drop it, or because the logger thread stopped.
+    bool enqueue(const PendingRecord& record)
+    {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        for (;;) {
+            slot = &slots[pos & (queue_capacity - 1)];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+            if (sequence == pos) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (sequence < pos) {
+                // The queue is full.
+                if (!running.load(std::memory_order_relaxed))
+                    return false;
+
+                if (overflow.load(std::memory_order_relaxed) == debug::LogOverflow::drop) {
+                    num_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+
+                wake_logger_thread();
+                std::this_thread::yield();
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->level = record.level;
+        slot->file = record.file;
+        slot->line = record.line;
+        slot->site = record.site;
+        slot->size = record.data.size();
+
+        if (record.data.size() <= inline_data_size) {
+            std::memcpy(slot->data, record.data.data(), record.data.size());
+        } else {
+            slot->long_data = new u8[record.data.size()];
+            std::memcpy(slot->long_data, record.data.data(), record.data.size());
+        }
+
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        wake_logger_thread();
+        return true;
+    }
+
+} // namespace
 
 LogLevel debug::detail::max_log_level = LogLevel(LOG_LEVEL_DEFAULT);
 
+LogLevel debug::detail::max_log_levels[num_log_categories] = {
+    math::min(LogLevel(LOG_LEVEL_DEFAULT), compiled_max_log_levels[0]),
+    math::min(LogLevel(LOG_LEVEL_DEFAULT), compiled_max_log_levels[1]),
+    math::min(LogLevel(LOG_LEVEL_DEFAULT), compiled_max_log_levels[2]),
+    math::min(LogLevel(LOG_LEVEL_DEFAULT), compiled_max_log_levels[3]),
+    math::min(LogLevel(LOG_LEVEL_DEFAULT), compiled_max_log_levels[4]),
+    math::min(LogLevel(LOG_LEVEL_DEFAULT), compiled_max_log_levels[5]),
+};
+
+bool debug::detail::deferred_logging = false;
+
+void debug::flush_log()
+{
+    if (!running.load(std::memory_order_acquire) || std::this_thread::get_id() == logger_thread_id)
+        return;
+
+    size_t target = enqueue_pos.load(std::memory_order_acquire);
+    size_t written = written_pos.load(std::memory_order_acquire);
+
+    while (written < target && running.load(std::memory_order_acquire)) {
+        wake_logger_thread();
+        written_pos.wait(written, std::memory_order_acquire);
+        written = written_pos.load(std::memory_order_acquire);
+    }
+}
+
+void debug::init_logger()
+{
+    if (logger_thread)
+        return;
+
+    init_log_sink();
+
+    for (size_t i = 0; i < queue_capacity; ++i)
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+
+    enqueue_pos.store(0, std::memory_order_relaxed);
+    dequeue_pos = 0;
+    written_pos.store(0, std::memory_order_relaxed);
+    stopping.store(false, std::memory_order_relaxed);
+    logger_thread = new std::thread{logger_thread_main};
+    logger_thread_id = logger_thread->get_id();
+    running.store(true, std::memory_order_release);
+}
+
+bool debug::open_binary_log(const oschar_t* path, Error& out_error)
+{
+#ifdef _WIN32
+    FILE* fp = _wfopen(path, L"wb");
+#else
+    FILE* fp = fopen(path, "wb");
+#endif
+
+    if (!fp) {
+        out_error = {.description = "fopen failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    u8 header[log_file_header_size] = {};
+    std::memcpy(header, log_file_magic, sizeof(log_file_magic));
+    header[6] = log_file_version;
+    header[7] = u8(sizeof(oschar_t));
+
+    if (fwrite(header, 1, sizeof(header), fp) != sizeof(header)) {
+        out_error = {.description = "fwrite failed", .code = {errno, std::generic_category()}};
+        fclose(fp);
+        return false;
+    }
+
+    std::lock_guard lock{sink_mutex};
+    close_binary_log();
+    binary_log = fp;
+    detail::deferred_logging = true;
+    return true;
+}
+
+void debug::set_deferred_logging(bool enabled)
+{
+    detail::deferred_logging = enabled;
+}
+
+void debug::set_log_overflow(LogOverflow policy)
+{
+    overflow.store(policy, std::memory_order_relaxed);
+}
+
 void debug::set_max_log_level(LogLevel level)
 {
-    detail::max_log_level = math::clamp(level, LogLevel::none, LogLevel(LOG_LEVEL_MAX));
+    for (size_t i = 0; i < num_log_categories; ++i)
+        set_max_log_level(LogCategory(i), level);
+}
+
+void debug::set_max_log_level(LogCategory category, LogLevel level)
+{
+    LogLevel compiled_max = math::min(compiled_max_log_levels[size_t(category)], LogLevel(LOG_LEVEL_MAX));
+    LogLevel max_level = LogLevel::none;
+
+    detail::max_log_levels[size_t(category)] = math::clamp(level, LogLevel::none, compiled_max);
+
+    for (LogLevel category_level : detail::max_log_levels)
+        max_level = math::max(max_level, category_level);
+
+    detail::max_log_level = max_level;
+}
+
+void debug::shut_down_logger()
+{
+    if (!logger_thread)
+        return;
+
+    // New messages are written synchronously from now on.
+    running.store(false, std::memory_order_release);
+    stopping.store(true, std::memory_order_release);
+    wake_logger_thread();
+    written_pos.notify_all();
+    logger_thread->join();
+    delete logger_thread;
+    logger_thread = nullptr;
+    logger_thread_id = {};
+
+    // Write any messages that were queued while the logger thread was stopping.
+    drain_queue();
+    report_suppressed();
+
+    std::lock_guard lock{sink_mutex};
+    report_dropped();
+    close_binary_log();
+    shut_down_log_sink();
+}
+
+bool debug::detail::begin_limited_log(LimitedLogSite& site, u64 index, i64 time)
+{
+    u64 suppressed = 0;
+
+    // Only one of the threads that reach the end of an interval logs a message.
+    if (site.limit.kind == LogLimit::Kind::interval) {
+        i64 next_time = site.next_time.load(std::memory_order_relaxed);
+
+        if (index != 0 && (time < next_time
+                           || !site.next_time.compare_exchange_strong(next_time, time + i64(site.limit.n),
+                                                                      std::memory_order_relaxed)))
+            return false;
+        else if (index == 0)
+            site.next_time.store(time + i64(site.limit.n), std::memory_order_relaxed);
+    }
+
+    if (index == 0) {
+        // The first message from the site is always logged, and adds the site to the list.
+        site.next = limited_sites.load(std::memory_order_relaxed);
+
+        while (!limited_sites.compare_exchange_weak(site.next, &site, std::memory_order_release,
+                                                    std::memory_order_relaxed))
+        {
+        }
+    } else if (site.limit.kind == LogLimit::Kind::every) {
+        suppressed = site.limit.n - 1;
+    } else {
+        u64 last_index = site.last_index.exchange(index, std::memory_order_relaxed);
+        suppressed = index > last_index ? index - last_index - 1 : 0;
+    }
+
+    site.reported.fetch_add(suppressed + 1, std::memory_order_relaxed);
+    log_suppressed(site, suppressed);
+    return true;
 }
 
 void debug::detail::exit_fatal()
 {
     std::exit(EXIT_FAILURE);
 }
+
+debug::LogArgBuffer& debug::detail::begin_log_args()
+{
+    thread_local LogArgBuffer buffer;
+
+    buffer.clear();
+    return buffer;
+}
+
+void debug::detail::vlog_deferred(LogSite& site, StringView fmt, const LogArgBuffer& args)
+{
+    if (!site.id.load(std::memory_order_acquire))
+        register_site(site, fmt);
+
+    PendingRecord record = {
+        .level = site.level,
+        .file = site.file,
+        .line = site.line,
+        .site = &site,
+        .data = {args.data(), args.size()},
+    };
+
+    if (!running.load(std::memory_order_acquire) || !enqueue(record))
+        write_now({&record, 1});
+}
+
+void debug::detail::vlog_src(const char* file, int line, LogLevel level, StringView fmt, FormatArgs args)
+{
+    thread_local fmt::basic_memory_buffer<oschar_t, 256> buffer;
+
+    if (level < LogLevel(1) || level > max_log_level || in_log)
+        return;
+
+    // The process exits without shutting down the logger after a fatal error, so the messages that
+    // rate-limited call sites suppressed are reported first.
+    if (level == LogLevel::fatal)
+        report_suppressed();
+
+    in_log = true;
+    buffer.clear();
+    fmt::vformat_to(std::back_inserter(buffer), fmt, args);
+
+    PendingRecord record = {
+        .level = level,
+        .file = file,
+        .line = line,
+        .data = as_bytes({buffer.data(), buffer.size()}),
+    };
+
+    // Fatal errors are written after everything that was logged before them. The sink stays locked
+    // while exiting so the logger thread can't write while static objects are destroyed.
+    if (level == LogLevel::fatal) {
+        flush_log();
+        sink_mutex.lock();
+        report_dropped();
+        write_records({&record, 1});
+        exit_fatal();
+    }
+
+    if (!running.load(std::memory_order_acquire) || !enqueue(record))
+        write_now({&record, 1});
+
+    in_log = false;
+}
@@ -9,6 +9,8 @@
 #ifndef SYSTEM_DEBUG_H_INCLUDED
 #define SYSTEM_DEBUG_H_INCLUDED
 
+#include <atomic>
+#include <chrono>
 #include <concepts>
 #include <iterator>
 #include <optional>
@@ -19,6 +21,7 @@
 
 #include <core/str.h>
 
+#include "binary_log.h"
 #include "encoding.h"
 
 // All log levels
@@ -46,6 +49,35 @@
 # define LOG_LEVEL_DEFAULT LOG_LEVEL_MAX
 #endif
 
+/// @def LOG_CATEGORY
+/// Category of the messages logged by the current source file. The build sets this for each file
+/// from its directory.
+#ifndef LOG_CATEGORY
+# define LOG_CATEGORY general
+#endif
+
+/// @def LOG_LEVEL_MAX_GENERAL
+/// Compile-time maximum log level for each category, which may be lower than @ref LOG_LEVEL_MAX.
+/// Setting one of these to `LOG_LEVEL_NONE` removes all of that category's messages from the build.
+#ifndef LOG_LEVEL_MAX_GENERAL
+# define LOG_LEVEL_MAX_GENERAL LOG_LEVEL_MAX
+#endif
+#ifndef LOG_LEVEL_MAX_CLIENT
+# define LOG_LEVEL_MAX_CLIENT LOG_LEVEL_MAX
+#endif
+#ifndef LOG_LEVEL_MAX_IO
+# define LOG_LEVEL_MAX_IO LOG_LEVEL_MAX
+#endif
+#ifndef LOG_LEVEL_MAX_RENDER
+# define LOG_LEVEL_MAX_RENDER LOG_LEVEL_MAX
+#endif
+#ifndef LOG_LEVEL_MAX_SYSTEM
+# define LOG_LEVEL_MAX_SYSTEM LOG_LEVEL_MAX
+#endif
+#ifndef LOG_LEVEL_MAX_TOOLS
+# define LOG_LEVEL_MAX_TOOLS LOG_LEVEL_MAX
+#endif
+
 /// @def FATAL
 /// Logs a fatal error message and exits with an error code.
 #if LOG_LEVEL_MAX < LOG_LEVEL_FATAL
@@ -56,54 +88,113 @@
 # define FATAL(...) ::geo::debug::detail::fatal_src(__FILE__, __LINE__, OSSTR __VA_ARGS__)
 #endif
 
+/// @def LOG_AT_SITE
+/// Logs a message with the specified level in the current file's @ref LOG_CATEGORY. Each use of
+/// this macro has a static @ref geo::debug::detail::LogSite, which identifies the message in binary
+/// log records. The arguments aren't evaluated unless the category's level permits the message.
+#ifdef LOG_NO_SOURCE
+# define LOG_SITE_FILE nullptr
+#else
+# define LOG_SITE_FILE __FILE__
+#endif
+#define LOG_AT_SITE(level, ...) \
+    do { \
+        if constexpr (::geo::debug::detail::is_log_compiled(::geo::LogCategory::LOG_CATEGORY, level)) { \
+            static ::geo::debug::detail::LogSite log_site_{LOG_SITE_FILE, __LINE__, level}; \
+            if (::geo::debug::detail::is_log_enabled(::geo::LogCategory::LOG_CATEGORY, level)) \
+                ::geo::debug::detail::log_site(log_site_, OSSTR __VA_ARGS__); \
+        } else { \
+            ::geo::debug::detail::log_nop(OSSTR __VA_ARGS__); \
+        } \
+    } while (0)
+
+/// @def LOG_LIMITED
+/// Like @ref LOG_AT_SITE, but only logs the messages permitted by a
+/// @ref geo::debug::detail::LogLimit. The others are counted, and the number of suppressed messages
+/// is logged before the site's next message, when the logger shuts down, and before a fatal error
+/// exits.
+#define LOG_LIMITED(level, limit, ...) \
+    do { \
+        if constexpr (::geo::debug::detail::is_log_compiled(::geo::LogCategory::LOG_CATEGORY, level)) { \
+            static ::geo::debug::detail::LimitedLogSite log_site_{{LOG_SITE_FILE, __LINE__, level}, limit}; \
+            if (::geo::debug::detail::is_log_enabled(::geo::LogCategory::LOG_CATEGORY, level) \
+                && ::geo::debug::detail::should_log_limited(log_site_)) \
+                ::geo::debug::detail::log_site(log_site_, OSSTR __VA_ARGS__); \
+        } else { \
+            ::geo::debug::detail::log_nop(OSSTR __VA_ARGS__); \
+        } \
+    } while (0)
+
+/// @def LOG_LIMITED_AT
+/// Like @ref LOG_LIMITED, but counts the message at `site`, a
+/// @ref geo::debug::detail::LimitedLogSite with the same level, instead of a static site of its
+/// own. This lets one call site keep separate limits, e.g., for each value of a runtime code.
+#define LOG_LIMITED_AT(level, site, ...) \
+    do { \
+        if constexpr (::geo::debug::detail::is_log_compiled(::geo::LogCategory::LOG_CATEGORY, level)) { \
+            ::geo::debug::detail::LimitedLogSite& log_site_ = (site); \
+            if (::geo::debug::detail::is_log_enabled(::geo::LogCategory::LOG_CATEGORY, level) \
+                && ::geo::debug::detail::should_log_limited(log_site_)) \
+                ::geo::debug::detail::log_site(log_site_, OSSTR __VA_ARGS__); \
+        } else { \
+            ::geo::debug::detail::log_nop(OSSTR __VA_ARGS__); \
+        } \
+    } while (0)
+
+/// @def LOG_ONCE
+/// Logs a message with the specified level, e.g., `error`, only the first time the call site is
+/// reached.
+#define LOG_ONCE(level, ...) \
+    LOG_LIMITED(::geo::LogLevel::level, ::geo::debug::detail::LogLimit::once(), __VA_ARGS__)
+
+/// @def LOG_EVERY_N
+/// Logs the first message and every `n`th message after it from the call site.
+#define LOG_EVERY_N(level, n, ...) \
+    LOG_LIMITED(::geo::LogLevel::level, ::geo::debug::detail::LogLimit::every(n), __VA_ARGS__)
+
+/// @def LOG_RATE_LIMITED
+/// Logs at most one message from the call site every `interval_ms` milliseconds.
+#define LOG_RATE_LIMITED(level, interval_ms, ...) \
+    LOG_LIMITED(::geo::LogLevel::level, ::geo::debug::detail::LogLimit::interval(interval_ms), __VA_ARGS__)
+
 /// @def LOG_ERROR
 /// Logs a non-fatal error message.
 #if LOG_LEVEL_MAX < LOG_LEVEL_ERROR
 # define LOG_ERROR(...) ::geo::debug::detail::log_nop(OSSTR __VA_ARGS__)
-#elif defined(LOG_NO_SOURCE)
-# define LOG_ERROR(...) ::geo::debug::detail::log(::geo::LogLevel::error, OSSTR __VA_ARGS__)
 #else
-# define LOG_ERROR(...) ::geo::debug::detail::log_src(__FILE__, __LINE__, ::geo::LogLevel::error, OSSTR __VA_ARGS__)
+# define LOG_ERROR(...) LOG_AT_SITE(::geo::LogLevel::error, __VA_ARGS__)
 #endif
 
 /// @def LOG_WARNING
 /// Logs a non-critical issue.
 #if LOG_LEVEL_MAX < LOG_LEVEL_WARNING
 # define LOG_WARNING(...) ::geo::debug::detail::log_nop(OSSTR __VA_ARGS__)
-#elif defined(LOG_NO_SOURCE)
-# define LOG_WARNING(...) ::geo::debug::detail::log(::geo::LogLevel::warning, OSSTR __VA_ARGS__)
 #else
-# define LOG_WARNING(...) ::geo::debug::detail::log_src(__FILE__, __LINE__, ::geo::LogLevel::warning, OSSTR __VA_ARGS__)
+# define LOG_WARNING(...) LOG_AT_SITE(::geo::LogLevel::warning, __VA_ARGS__)
 #endif
 
 /// @def LOG_INFO
 /// Logs a neutral status message.
 #if LOG_LEVEL_MAX < LOG_LEVEL_INFO
 # define LOG_INFO(...) ::geo::debug::detail::log_nop(OSSTR __VA_ARGS__)
-#elif defined(LOG_NO_SOURCE)
-# define LOG_INFO(...) ::geo::debug::detail::log(::geo::LogLevel::info, OSSTR __VA_ARGS__)
 #else
-# define LOG_INFO(...) ::geo::debug::detail::log_src(__FILE__, __LINE__, ::geo::LogLevel::info, OSSTR __VA_ARGS__)
+# define LOG_INFO(...) LOG_AT_SITE(::geo::LogLevel::info, __VA_ARGS__)
 #endif
 
 /// @def LOG_DEBUG
 /// Logs an important debugging message.
 #if LOG_LEVEL_MAX < LOG_LEVEL_DEBUG
 # define LOG_DEBUG(...) ::geo::debug::detail::log_nop(OSSTR __VA_ARGS__)
-#elif defined(LOG_NO_SOURCE)
-# define LOG_DEBUG(...) ::geo::debug::detail::log(::geo::LogLevel::debug, OSSTR __VA_ARGS__)
 #else
-# define LOG_DEBUG(...) ::geo::debug::detail::log_src(__FILE__, __LINE__, ::geo::LogLevel::debug, OSSTR __VA_ARGS__)
+# define LOG_DEBUG(...) LOG_AT_SITE(::geo::LogLevel::debug, __VA_ARGS__)
 #endif
 
 /// @def LOG_TRACE
 /// Logs a verbose debugging message.
 #if LOG_LEVEL_MAX < LOG_LEVEL_TRACE
 # define LOG_TRACE(...) ::geo::debug::detail::log_nop(OSSTR __VA_ARGS__)
-#elif defined(LOG_NO_SOURCE)
-# define LOG_TRACE(...) ::geo::debug::detail::log(::geo::LogLevel::trace, OSSTR __VA_ARGS__)
 #else
-# define LOG_TRACE(...) ::geo::debug::detail::log_src(__FILE__, __LINE__, ::geo::LogLevel::trace, OSSTR __VA_ARGS__)
+# define LOG_TRACE(...) LOG_AT_SITE(::geo::LogLevel::trace, __VA_ARGS__)
 #endif
 
 /// @def ASSERT
@@ -119,8 +210,36 @@
 # define ASSERT(x) do { if (!(x)) ::geo::debug::detail::fatal_src(__FILE__, __LINE__, OSSTR "Assertion failed: {}", #x); } while (0)
 #endif
 
+/// @def PROFILE_ENABLED
+/// Set to 0 to remove the profiler from the build.
+#ifndef PROFILE_ENABLED
+# define PROFILE_ENABLED 1
+#endif
+
+/// @def PROFILE_SCOPE
+/// Records the time from this point to the end of the enclosing scope while the profiler is
+/// running. `name` must be a string literal.
+#define PROFILE_CONCAT_(x, y) x##y
+#define PROFILE_CONCAT(x, y) PROFILE_CONCAT_(x, y)
+#if PROFILE_ENABLED
+# define PROFILE_SCOPE(name) ::geo::debug::detail::ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__){name}
+#else
+# define PROFILE_SCOPE(name) ::geo::debug::detail::profile_nop(name)
+#endif
+
+/// @def PROFILE_FRAME
+/// Marks the start of a frame. Frames determine how much of the profile is written by
+/// @ref geo::debug::write_profile.
+#if PROFILE_ENABLED
+# define PROFILE_FRAME() ::geo::debug::detail::profile_frame()
+#else
+# define PROFILE_FRAME() ((void)0)
+#endif
+
 namespace geo {
 
+    struct Error;
+
     /// Determines the severity level of a log message.
     enum class LogLevel {
         none = LOG_LEVEL_NONE,
@@ -132,21 +251,209 @@ namespace geo {
         trace = LOG_LEVEL_TRACE,
     };
 
+    /// Subsystem that a log message comes from. Each category has its own maximum log level.
+    enum class LogCategory {
+        general,
+        client,
+        io,
+        render,
+        system,
+        tools,
+    };
+
+    inline constexpr size_t num_log_categories = size_t(LogCategory::tools) + 1;
+
     /// Debugging and logging utilities.
     namespace debug {
 
+        /// Determines what a thread does when it logs a message while the logger's queue is full.
+        enum class LogOverflow {
+            block, ///< Wait for the logger thread to make room.
+            drop, ///< Discard the message. The number of dropped messages is logged later.
+        };
+
+        /// Starts the logger thread, which writes messages queued by other threads. Messages logged
+        /// before the logger is initialized or after it's shut down are written synchronously.
         void init_logger();
+
+        /// Writes the remaining queued messages and stops the logger thread.
         void shut_down_logger();
+
         void enable_console();
+
+        /// Blocks until every message logged by any thread so far has been written.
+        void flush_log();
+
+        /// Opens a binary log file and enables deferred logging. While it's open, messages are
+        /// written to it instead of the console, except that warnings and errors are written to
+        /// both. Binary log files are read by `geo_logdecode`. The file is closed by
+        /// @ref shut_down_logger.
+        bool open_binary_log(const oschar_t* path, Error& out_error);
+
+        /// Enables or disables deferred logging. While it's enabled, messages whose arguments are
+        /// all numbers, strings, or `void` pointers are queued as binary records, and the logger
+        /// thread formats them instead of the calling thread.
+        void set_deferred_logging(bool enabled);
+
+        void set_log_overflow(LogOverflow overflow);
+
+        /// Starts recording the events of @ref PROFILE_SCOPE on every thread, keeping enough frames
+        /// of history for @ref write_profile to write the last `num_frames` frames. Each thread
+        /// keeps its events in a fixed-size ring buffer, so long frames may be cut off.
+        void start_profiler(size_t num_frames);
+
+        /// Writes the events of the last frames recorded by the profiler as Chrome trace JSON,
+        /// which can be viewed with Perfetto or `chrome://tracing`.
+        bool write_profile(const oschar_t* path, Error& out_error);
+
+        /// Sets the maximum log level of every category.
         void set_max_log_level(LogLevel level);
 
+        /// Sets the maximum log level of one category. Levels above the category's compile-time
+        /// maximum are clamped.
+        void set_max_log_level(LogCategory category, LogLevel level);
+
         namespace detail {
 
             using FormatContext = fmt::buffered_context<oschar_t>;
             using FormatArgs = fmt::basic_format_args<FormatContext>;
             using StringView = fmt::basic_string_view<oschar_t>;
 
-            extern LogLevel max_log_level;
+            extern LogLevel max_log_level; // Highest level of any category
+            extern LogLevel max_log_levels[num_log_categories];
+            extern bool deferred_logging;
+
+            // Compile-time maximum log level of each category.
+            inline constexpr LogLevel compiled_max_log_levels[num_log_categories] = {
+                LogLevel(LOG_LEVEL_MAX_GENERAL),
+                LogLevel(LOG_LEVEL_MAX_CLIENT),
+                LogLevel(LOG_LEVEL_MAX_IO),
+                LogLevel(LOG_LEVEL_MAX_RENDER),
+                LogLevel(LOG_LEVEL_MAX_SYSTEM),
+                LogLevel(LOG_LEVEL_MAX_TOOLS),
+            };
+
+            // Returns true if messages with a category and level are compiled in.
+            constexpr bool is_log_compiled(LogCategory category, LogLevel level)
+            {
+                return level <= compiled_max_log_levels[size_t(category)]
+                       && level <= LogLevel(LOG_LEVEL_MAX);
+            }
+
+            // Returns true if messages with a category and level are currently logged. With constant
+            // arguments, this is a single load and compare.
+            inline bool is_log_enabled(LogCategory category, LogLevel level)
+            {
+                return level <= max_log_levels[size_t(category)];
+            }
+
+            // Call site of a `LOG_*` macro. Sites are constant-initialized, and registered when
+            // they first log a deferred message.
+            struct LogSite {
+                const char* file; // Null if not logged
+                int line;
+                LogLevel level;
+                StringView fmt{}; // Set when the site is registered
+                std::atomic<u32> id = 0; // Nonzero once the site is registered
+            };
+
+            // Determines which messages a rate-limited call site logs.
+            struct LogLimit {
+                enum class Kind { once, every, interval };
+
+                Kind kind;
+                u64 n; // Every `n`th message, or an interval in nanoseconds
+
+                static constexpr LogLimit once() { return {Kind::once, 0}; }
+                static constexpr LogLimit every(u64 n) { return {Kind::every, n ? n : 1}; }
+                static constexpr LogLimit interval(u64 ms) { return {Kind::interval, ms * 1000000}; }
+            };
+
+            // Call site of a rate-limited `LOG_*` macro. The counters are only updated with relaxed
+            // atomics, so the counts may be slightly off when several threads log at once.
+            struct LimitedLogSite : LogSite {
+                LogLimit limit;
+                std::atomic<u64> count = 0; // Messages that reached the site
+                std::atomic<u64> reported = 0; // Messages that were logged or reported as suppressed
+                std::atomic<u64> last_index = 0; // Index of the last logged message
+                std::atomic<i64> next_time = 0; // Earliest time of the next message, for intervals
+                LimitedLogSite* next = nullptr; // Next site in the list reported on shutdown
+            };
+
+            // Gets the time of the steady clock in nanoseconds. Used for rate limits and profiling.
+            inline i64 get_steady_time()
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            // Claims a message that was permitted by a site's limit, and logs the number of
+            // messages that were suppressed since the previous one. Returns false if another thread
+            // claimed the site's interval first.
+            bool begin_limited_log(LimitedLogSite& site, u64 index, i64 time);
+
+            // Counts a message from a rate-limited call site and returns true if it should be
+            // logged. Suppressed messages only cost an atomic increment, plus reading the clock for
+            // intervals.
+            inline bool should_log_limited(LimitedLogSite& site)
+            {
+                u64 index = site.count.fetch_add(1, std::memory_order_relaxed);
+                i64 time = 0;
+
+                switch (site.limit.kind) {
+                    case LogLimit::Kind::once:
+                        if (index != 0)
+                            return false;
+                        break;
+
+                    case LogLimit::Kind::every:
+                        if (index % site.limit.n != 0)
+                            return false;
+                        break;
+
+                    case LogLimit::Kind::interval:
+                        time = detail::get_steady_time();
+                        if (index != 0 && time < site.next_time.load(std::memory_order_relaxed))
+                            return false;
+                        break;
+                }
+
+                return detail::begin_limited_log(site, index, time);
+            }
+
+            extern bool profiling;
+
+            // Adds an event to the calling thread's profiler buffer without locking.
+            void record_profile_event(const char* name, i64 begin_time, i64 end_time);
+
+            void profile_frame();
+
+            // Records an event for the lifetime of the object if the profiler is running.
+            class ProfileScope {
+            public:
+                explicit ProfileScope(const char* name)
+                    : name_{name}, begin_time_{profiling ? detail::get_steady_time() : -1}
+                {
+                }
+
+                ProfileScope(const ProfileScope&) = delete;
+                ProfileScope& operator=(const ProfileScope&) = delete;
+
+                ~ProfileScope()
+                {
+                    if (begin_time_ >= 0)
+                        detail::record_profile_event(name_, begin_time_, detail::get_steady_time());
+                }
+
+            private:
+                const char* name_;
+                i64 begin_time_;
+            };
+
+            // Discards a profiler scope.
+            constexpr void profile_nop(const char*)
+            {
+            }
 
             [[noreturn]] void exit_fatal();
 
@@ -195,7 +502,7 @@ namespace geo {
             template<Formattable...Args>
             using FormatString = fmt::basic_format_string<oschar_t, std::type_identity_t<forward_t<Args>>...>;
 
-            // Platform-dependent implementation for all log messages.
+            // Formats a log message on the calling thread and queues it for the logger thread.
             void vlog_src(const char* file, int line, LogLevel level, StringView fmt, FormatArgs args);
 
             inline void vlog(LogLevel level, StringView fmt, FormatArgs args)
@@ -209,18 +516,28 @@ namespace geo {
             {
             }
 
-            // Logs a message.
-            template<Formattable...Args>
-            void log(LogLevel level, FormatString<Args...> fmt, const Args&...args)
-            {
-                detail::vlog(level, fmt.get(), detail::make_format_args(args...));
-            }
+            // Gets the calling thread's argument buffer for a deferred message, cleared.
+            LogArgBuffer& begin_log_args();
+
+            // Queues a binary record with a message's encoded arguments for the logger thread.
+            void vlog_deferred(LogSite& site, StringView fmt, const LogArgBuffer& args);
 
-            // Logs a message with a source location.
+            // Logs a message from a call site whose level has already been checked. If deferred
+            // logging is enabled and all of the arguments can be encoded, only the arguments are
+            // copied on the calling thread.
             template<Formattable...Args>
-            void log_src(const char* file, int line, LogLevel level, FormatString<Args...> fmt, const Args&...args)
+            void log_site(LogSite& site, FormatString<Args...> fmt, const Args&...args)
             {
-                detail::vlog_src(file, line, level, fmt.get(), detail::make_format_args(args...));
+                if constexpr ((BinaryLogArg<Args> && ...)) {
+                    if (deferred_logging) {
+                        LogArgBuffer& buffer = detail::begin_log_args();
+                        (debug::write_log_arg(buffer, args), ...);
+                        detail::vlog_deferred(site, fmt.get(), buffer);
+                        return;
+                    }
+                }
+
+                detail::vlog_src(site.file, site.line, site.level, fmt.get(), detail::make_format_args(args...));
             }
 
             // Discards a fatal error message then exits with an error code.
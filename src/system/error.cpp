@@ -6,77 +6,212 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
+#include <cstring>
+
 #include "encoding.h"
 #include "error.h"
 
 using namespace geo;
 
-void Error::clear()
+namespace {
+
+    // Writes an error's own description and code. Returns true if anything was written.
+    bool write_frame(fmt::format_context::iterator& out, const ErrorDescription& description,
+                     const std::error_code& code)
+    {
+        bool anything_written = false;
+
+        if (!description.empty()) {
+            out = fmt::format_to(out, "{}", description.c_str());
+            anything_written = true;
+        }
+
+        if (code) {
+            auto code_msg = code.message();
+
+            if (anything_written)
+                *out++ = ' ';
+            if (!code_msg.empty())
+                out = fmt::format_to(out, "{} ", code_msg);
+
+            out = fmt::format_to(out, " [{}: {}]", code.category().name(), code.value());
+            anything_written = true;
+        }
+
+        return anything_written;
+    }
+
+} // namespace
+
+//==================================================================================================
+// ErrorDescription
+//==================================================================================================
+
+ErrorDescription::ErrorDescription(const std::string& str)
 {
-    description.clear();
-    code.clear();
-    cause.reset();
+    if (str.empty())
+        return;
+
+    char* copy = new char[str.size() + 1];
+    std::memcpy(copy, str.c_str(), str.size() + 1);
+    str_ = copy;
+    owned_ = true;
 }
 
-bool Error::is_empty() const
+ErrorDescription::ErrorDescription(ErrorDescription&& other)
+    : str_{other.str_}
+    , owned_{other.owned_}
 {
-    return description.empty() && !code && !cause;
+    other.str_ = nullptr;
+    other.owned_ = false;
+}
+
+ErrorDescription& ErrorDescription::operator=(ErrorDescription&& other)
+{
+    if (&other != this) {
+        clear();
+        str_ = other.str_;
+        owned_ = other.owned_;
+        other.str_ = nullptr;
+        other.owned_ = false;
+    }
+
+    return *this;
+}
+
+void ErrorDescription::clear()
+{
+    if (owned_)
+        delete[] str_;
+
+    str_ = nullptr;
+    owned_ = false;
+}
+
+//==================================================================================================
+// ErrorCause
+//==================================================================================================
+
+ErrorCause::ErrorCause(ErrorCause&& other)
+{
+    *this = std::move(other);
+}
+
+ErrorCause::ErrorCause(Error&& error)
+{
+    push(std::move(error.description), error.code);
+
+    for (size_t i = 0; i < error.cause.depth_; ++i)
+        push(std::move(error.cause.frames_[i].description), error.cause.frames_[i].code);
+
+    truncated_ |= error.cause.truncated_;
+    error.clear();
+}
+
+ErrorCause& ErrorCause::operator=(ErrorCause&& other)
+{
+    if (&other != this) {
+        for (size_t i = 0; i < max_depth; ++i) {
+            frames_[i].description = std::move(other.frames_[i].description);
+            frames_[i].code = other.frames_[i].code;
+        }
+
+        depth_ = other.depth_;
+        truncated_ = other.truncated_;
+        other.clear();
+    }
+
+    return *this;
+}
+
+void ErrorCause::clear()
+{
+    for (size_t i = 0; i < depth_; ++i) {
+        frames_[i].description.clear();
+        frames_[i].code.clear();
+    }
+
+    depth_ = 0;
+    truncated_ = false;
+}
+
+void ErrorCause::push(ErrorDescription&& description, std::error_code code)
+{
+    if (description.empty() && !code)
+        return;
+    else if (depth_ == max_depth) {
+        truncated_ = true;
+        return;
+    }
+
+    frames_[depth_].description = std::move(description);
+    frames_[depth_].code = code;
+    ++depth_;
+}
+
+//==================================================================================================
+// Error
+//==================================================================================================
+
+void Error::clear()
+{
+    description.clear();
+    code.clear();
+    cause.clear();
 }
 
 bool Error::matches(const std::error_code& code) const
 {
     if (this->code == code)
         return true;
-    else if (cause)
-        return cause->matches(code);
-    else
-        return false;
+
+    for (size_t i = 0; i < cause.depth(); ++i) {
+        if (cause[i].code == code)
+            return true;
+    }
+
+    return false;
 }
 
 bool Error::matches(const std::error_condition& cond) const
 {
     if (this->code == cond)
         return true;
-    else if (cause)
-        return cause->matches(cond);
-    else
-        return false;
+
+    for (size_t i = 0; i < cause.depth(); ++i) {
+        if (cause[i].code == cond)
+            return true;
+    }
+
+    return false;
 }
 
 fmt::format_context::iterator Error::write_to(fmt::format_context& ctx) const
 {
     auto out = ctx.out();
-    bool anything_written = false;
+    size_t num_open_causes = 0;
 
     if (is_empty())
         return fmt::format_to(out, "No error");
 
-    if (!description.empty()) {
-        fmt::format_to(out, "{}", description);
-        anything_written = true;
-    }
-
-    if (code) {
-        auto code_msg = code.message();
+    // Each cause is enclosed in the parentheses of the level above it, unless that level wrote
+    // nothing of its own.
+    bool anything_written = write_frame(out, description, code);
 
-        if (anything_written)
-            *out++ = ' ';
-        if (!code_msg.empty())
-            fmt::format_to(out, "{} ", code_msg);
+    for (size_t i = 0; i < cause.depth(); ++i) {
+        if (anything_written) {
+            out = fmt::format_to(out, " (Caused by: ");
+            ++num_open_causes;
+        }
 
-        fmt::format_to(out, " [{}: {}]", code.category().name(), code.value());
-        anything_written = true;
+        anything_written = write_frame(out, cause[i].description, cause[i].code);
     }
 
-    if (cause && !cause->is_empty()) {
-        if (anything_written)
-            fmt::format_to(out, " (Caused by: ");
+    if (cause.is_truncated())
+        out = fmt::format_to(out, " (Caused by: ...)");
 
-        cause->write_to(ctx);
-
-        if (anything_written)
-            *out++ = ')';
-    }
+    for (; num_open_causes > 0; --num_open_causes)
+        *out++ = ')';
 
     return out;
 }
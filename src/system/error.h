@@ -11,6 +11,7 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <system_error>
 
 #include <fmt/format.h>
@@ -20,11 +21,81 @@
 
 namespace geo {
 
-    /// General-purpose error type.
+    struct Error;
+
+    /// Description of an @ref Error. Descriptions constructed from string literals refer to the
+    /// string without copying it. Those constructors are `consteval`, so they reject strings that
+    /// might not outlive the description. Descriptions constructed from `std::string`, e.g., the
+    /// result of `fmt::format`, are copied to the heap, so they should be reserved for messages
+    /// that must include details.
+    class ErrorDescription {
+    public:
+        ErrorDescription() = default;
+        template<size_t N> consteval ErrorDescription(const char (&str)[N]) : str_{str} {}
+        explicit consteval ErrorDescription(const char* str) : str_{str} {}
+        ErrorDescription(const std::string& str);
+        ErrorDescription(const ErrorDescription&) = delete;
+        ErrorDescription(ErrorDescription&& other);
+        ~ErrorDescription() { clear(); }
+
+        ErrorDescription& operator=(ErrorDescription&& other);
+
+        void clear();
+        const char* c_str() const { return str_ ? str_ : ""; }
+        bool empty() const { return !str_ || !*str_; }
+
+    private:
+        const char* str_ = nullptr;
+        bool owned_ = false;
+    };
+
+    /// Nested causes of an @ref Error. Causes are stored inline rather than allocated. Causes
+    /// nested more than @ref max_depth levels deep are dropped, which is indicated when the error
+    /// is formatted.
+    class ErrorCause {
+    public:
+        static constexpr size_t max_depth = 3;
+
+        /// Description and code of one level of the cause chain.
+        struct Frame {
+            ErrorDescription description{};
+            std::error_code code{};
+        };
+
+        ErrorCause() = default;
+        ErrorCause(const ErrorCause&) = delete;
+        ErrorCause(ErrorCause&& other);
+
+        /// Takes the description, code, and causes of `error`. Levels without a description or
+        /// code are skipped.
+        ErrorCause(Error&& error);
+
+        ErrorCause& operator=(ErrorCause&& other);
+
+        explicit operator bool() const { return depth_ != 0; }
+        const Frame& operator[](size_t index) const { return frames_[index]; }
+
+        void clear();
+        size_t depth() const { return depth_; }
+
+        /// Indicates whether causes were dropped because they were nested too deeply.
+        bool is_truncated() const { return truncated_; }
+
+    private:
+        Frame frames_[max_depth];
+        size_t depth_ = 0;
+        bool truncated_ = false;
+
+        void push(ErrorDescription&& description, std::error_code code);
+    };
+
+    /// General-purpose error type. Creating, moving, and destroying errors doesn't allocate unless
+    /// a description is constructed from a `std::string`, and error messages are only formatted
+    /// when the error is.
     struct Error {
-        std::string description{};
+        ErrorDescription description{};
         std::error_code code{};
-        std::unique_ptr<const Error> cause{};
+        ErrorCause cause{};
 
         /// Indicates whether the error is non-empty, i.e. any of its fields are non-empty.
         explicit operator bool() const { return !is_empty(); }
@@ -33,7 +104,7 @@ namespace geo {
         void clear();
 
         /// Indicates whether the error is empty, i.e., all of its fields are empty.
-        bool is_empty() const;
+        bool is_empty() const { return description.empty() && !code && !cause; }
 
         /// Recursively checks if the error or any of its nested causes has the specified error
         /// code.
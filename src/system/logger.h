@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SYSTEM_LOGGER_H_INCLUDED
+#define SYSTEM_LOGGER_H_INCLUDED
+
+#include <span>
+
+#include "debug.h"
+
+// Interface between the platform-independent logger in debug.cpp and the platform-dependent log
+// sinks. This header is private to the system module.
+
+namespace geo::debug::detail {
+
+    // Formatted log message, ready to be written by a sink.
+    struct LogRecord {
+        LogLevel level = LogLevel::none;
+        const char* file = nullptr; // Source location, or null if not logged
+        int line = 0;
+        std::basic_string_view<oschar_t> text{};
+    };
+
+    // Sets up the platform's log sink. Called by `init_logger` before any records are written.
+    void init_log_sink();
+
+    // Releases the platform's log sink. Called by `shut_down_logger` after all records are written.
+    void shut_down_log_sink();
+
+    // Writes a batch of records, batching the underlying I/O where possible. Only one thread writes
+    // records at a time. Fatal records are shown to the user before returning, but don't exit.
+    void write_log_records(std::span<const LogRecord> records);
+
+} // namespace geo::debug::detail
+
+#endif // SYSTEM_LOGGER_H_INCLUDED
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SYSTEM_MAPPING_H_INCLUDED
+#define SYSTEM_MAPPING_H_INCLUDED
+
+#include <span>
+
+#include "error.h"
+
+namespace geo {
+
+    /// Read-only memory mapping of an entire file.
+    class FileMapping {
+    public:
+        FileMapping() = default;
+        FileMapping(const FileMapping&) = delete;
+        FileMapping(FileMapping&& other);
+        explicit FileMapping(const oschar_t* path, Error& out_error);
+        ~FileMapping();
+
+        FileMapping& operator=(FileMapping&& other);
+
+        void close();
+        bool is_open() const { return is_open_; }
+        bool open(const oschar_t* path, Error& out_error);
+
+        /// Returns the mapped file contents. The span is invalidated when the mapping is closed.
+        std::span<const u8> bytes() const { return {data_, size_}; }
+
+        /// Hints that a range of @ref bytes will be read soon, so the OS can start reading it into
+        /// memory in the background. This doesn't wait for I/O.
+        void prefetch(std::span<const u8> range) const;
+
+    private:
+        const u8* data_ = nullptr;
+        size_t size_ = 0;
+        bool is_open_ = false;
+    };
+
+} // namespace geo
+
+#endif // SYSTEM_MAPPING_H_INCLUDED
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <vector>
+
+#include "debug.h"
+#include "error.h"
+
+using namespace geo;
+using namespace geo::debug::detail;
+
+namespace {
+
+    // Number of events each thread's ring buffer can hold. Must be a power of two.
+    constexpr size_t events_per_thread = 65536;
+
+    struct ProfileEvent {
+        const char* name;
+        i64 begin_time;
+        i64 end_time;
+    };
+
+    // Ring buffer of a thread's events. Only the owning thread writes to it. Buffers are never
+    // freed, so the events of threads that have exited can still be written.
+    struct ThreadEvents {
+        ProfileEvent events[events_per_thread];
+        std::atomic<u64> count = 0; // Number of events ever recorded
+        u32 thread_id = 0;
+        ThreadEvents* next = nullptr;
+    };
+
+    std::atomic<ThreadEvents*> thread_events = nullptr;
+    std::atomic<u32> num_threads = 0;
+    thread_local ThreadEvents* current_thread_events = nullptr;
+
+    // Start times of the most recent frames, indexed by frame number modulo the size. Only accessed
+    // by the thread that calls `PROFILE_FRAME`.
+    std::vector<i64> frame_times;
+    u64 frame_count = 0;
+
+    ThreadEvents* register_thread()
+    {
+        ThreadEvents* events = new ThreadEvents;
+
+        events->thread_id = num_threads.fetch_add(1, std::memory_order_relaxed) + 1;
+        events->next = thread_events.load(std::memory_order_relaxed);
+
+        while (!thread_events.compare_exchange_weak(events->next, events, std::memory_order_release,
+                                                    std::memory_order_relaxed))
+        {
+        }
+
+        current_thread_events = events;
+        return events;
+    }
+
+    // Copies the events of a thread that began at or after `start_time`. Events that the thread
+    // overwrites while they're being copied are discarded.
+    void collect_events(const ThreadEvents& events, i64 start_time, std::vector<ProfileEvent>& out_events)
+    {
+        u64 end = events.count.load(std::memory_order_acquire);
+        u64 begin = end > events_per_thread ? end - events_per_thread : 0;
+        size_t first_new = out_events.size();
+
+        for (u64 i = begin; i < end; ++i)
+            out_events.push_back(events.events[i & (events_per_thread - 1)]);
+
+        u64 new_end = events.count.load(std::memory_order_acquire);
+        u64 num_overwritten = new_end > begin + events_per_thread ? new_end - begin - events_per_thread : 0;
+        auto first = out_events.begin() + std::ptrdiff_t(first_new);
+
+        first = out_events.erase(first, first + std::ptrdiff_t(std::min(num_overwritten, end - begin)));
+        out_events.erase(std::remove_if(first, out_events.end(),
+                                        [&](const ProfileEvent& event) { return event.begin_time < start_time; }),
+                         out_events.end());
+    }
+
+    // Appends a string to JSON output, escaping it as needed.
+    void write_json_string(fmt::memory_buffer& out, const char* str)
+    {
+        out.push_back('"');
+
+        for (; *str; ++str) {
+            if (*str == '"' || *str == '\\')
+                out.push_back('\\');
+
+            if (u8(*str) < 0x20)
+                fmt::format_to(std::back_inserter(out), "\\u{:04x}", unsigned(u8(*str)));
+            else
+                out.push_back(*str);
+        }
+
+        out.push_back('"');
+    }
+
+} // namespace
+
+bool debug::detail::profiling = false;
+
+void debug::start_profiler(size_t num_frames)
+{
+    // One more frame is kept so that the oldest frame's start time is known.
+    frame_times.assign(num_frames + 1, 0);
+    frame_count = 0;
+    detail::profiling = true;
+}
+
+bool debug::write_profile(const oschar_t* path, Error& out_error)
+{
+    std::vector<ProfileEvent> events;
+    std::vector<u32> event_threads;
+    i64 start_time = 0;
+
+    // Start from the oldest frame that's still in the ring.
+    if (frame_count >= frame_times.size())
+        start_time = frame_times[frame_count % frame_times.size()];
+    else if (frame_count)
+        start_time = frame_times[0];
+
+    for (ThreadEvents* thread = thread_events.load(std::memory_order_acquire); thread; thread = thread->next) {
+        collect_events(*thread, start_time, events);
+        event_threads.resize(events.size(), thread->thread_id);
+    }
+
+#ifdef _WIN32
+    FILE* fp = _wfopen(path, L"wb");
+#else
+    FILE* fp = fopen(path, "wb");
+#endif
+
+    if (!fp) {
+        out_error = {.description = "fopen failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    fmt::memory_buffer out;
+    out.append(std::string_view{"{\"displayTimeUnit\":\"ms\",\"traceEvents\":["});
+
+    for (size_t i = 0; i < events.size(); ++i) {
+        const ProfileEvent& event = events[i];
+
+        if (i)
+            out.push_back(',');
+
+        out.append(std::string_view{"\n{\"name\":"});
+        write_json_string(out, event.name);
+        fmt::format_to(std::back_inserter(out), ",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":1,\"tid\":{}}}",
+                       f64(event.begin_time - start_time) / 1000.0,
+                       f64(event.end_time - event.begin_time) / 1000.0, event_threads[i]);
+    }
+
+    out.append(std::string_view{"\n]}\n"});
+
+    bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+
+    if (fclose(fp) != 0)
+        ok = false;
+
+    if (!ok) {
+        out_error = {.description = "fwrite failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    LOG_INFO("Wrote {} profiler events to: {}", events.size(), path);
+    return true;
+}
+
+void debug::detail::record_profile_event(const char* name, i64 begin_time, i64 end_time)
+{
+    ThreadEvents* events = current_thread_events;
+
+    if (!events)
+        events = register_thread();
+
+    u64 count = events->count.load(std::memory_order_relaxed);
+    events->events[count & (events_per_thread - 1)] = {name, begin_time, end_time};
+    events->count.store(count + 1, std::memory_order_release);
+}
+
+void debug::detail::profile_frame()
+{
+    if (!profiling)
+        return;
+
+    i64 time = get_steady_time();
+
+    // Each frame is also an event that lasts until the next frame starts.
+    if (frame_count)
+        record_profile_event("frame", frame_times[(frame_count - 1) % frame_times.size()], time);
+
+    frame_times[frame_count % frame_times.size()] = time;
+    ++frame_count;
+}
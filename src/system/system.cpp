@@ -6,6 +6,7 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
+#include <io/mapped_pak.h>
 #include <io/zip.h>
 
 #include "debug.h"
@@ -13,7 +14,8 @@
 
 using namespace geo;
 
-std::unique_ptr<StreamProvider> system::open_pak(const oschar_t* explicit_path)
+std::unique_ptr<StreamProvider> system::open_pak(const oschar_t* explicit_path, PakBackend backend,
+                                                 ZipArchive** out_archive)
 {
     OsString path;
 
@@ -25,10 +27,28 @@ std::unique_ptr<StreamProvider> system::open_pak(const oschar_t* explicit_path)
     LOG_INFO("Reading assets from: {}", path);
 
     Error error;
+
+    if (backend == PakBackend::mapped) {
+        auto pak = std::make_unique<MappedPak>(path.c_str(), error);
+
+        if (!error) {
+            if (out_archive)
+                *out_archive = &pak->get_archive();
+
+            return pak;
+        }
+
+        LOG_WARNING("Can't map PAK, falling back to stdio: {}", error);
+        error.clear();
+    }
+
     auto archive = std::make_unique<ZipArchive>(path.c_str(), error);
 
     if (error)
         FATAL("{}: {}", path, error);
 
+    if (out_archive)
+        *out_archive = archive.get();
+
     return archive;
 }
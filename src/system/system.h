@@ -14,18 +14,43 @@
 
 #include <core/str.h>
 
+#include "error.h"
+
 namespace geo {
 
     class StreamProvider;
+    class ZipArchive;
+
+    /// Determines how the asset PAK is read.
+    enum class PakBackend {
+        stdio, ///< Read through stdio and libzip (see @ref ZipArchive).
+        mapped, ///< Memory-map the PAK, falling back to `stdio` if mapping fails (see @ref MappedPak).
+    };
+
+    /// File metadata returned by @ref system::get_file_info.
+    struct FileInfo {
+        u64 size = 0;
+        i64 mtime = 0; ///< Modification time in nanoseconds since a platform-specific epoch
+    };
 
     /// Functions for interacting with the operating system.
     namespace system {
 
+        /// Gets the directory for per-user cache files, e.g., `$XDG_CACHE_HOME/geo`. The directory
+        /// may not exist yet. Returns an empty string if it can't be determined.
+        OsString get_cache_dir();
+
         /// Gets the default path to the asset PAK. Used if not specified from the command line.
         OsString get_default_pak_path();
 
-        /// Opens the asset PAK. If `path` is null, @ref get_default_pak_path is used.
-        std::unique_ptr<StreamProvider> open_pak(const oschar_t* path);
+        /// Gets a file's size and modification time.
+        bool get_file_info(const oschar_t* path, FileInfo& out_info, Error& out_error);
+
+        /// Opens the asset PAK. If `path` is null, @ref get_default_pak_path is used. If
+        /// `out_archive` is not null, it is set to the archive that reads the PAK's entries, which
+        /// is owned by the returned provider.
+        std::unique_ptr<StreamProvider> open_pak(const oschar_t* path, PakBackend backend = PakBackend::mapped,
+                                                 ZipArchive** out_archive = nullptr);
 
     } // namespace system
 
@@ -0,0 +1,576 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef __linux__
+# include <linux/io_uring.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#include <math/math.h>
+#include <system/async_file.h>
+#include <system/debug.h>
+
+using namespace geo;
+
+namespace {
+
+    Error make_errno_error(ErrorDescription description, int errnum)
+    {
+        return {.description = std::move(description), .code = {errnum, std::generic_category()}};
+    }
+
+    // Read that has been submitted but not yet completed.
+    struct PendingRead {
+        AsyncReadRequest request;
+        size_t size = 0; // Bytes read so far
+        Error error{};
+        iovec iov{};
+    };
+
+#ifdef __linux__
+
+    constexpr unsigned ring_entries = 64;
+
+    // Minimal io_uring wrapper using raw system calls, since liburing is not a dependency.
+    class IoUring {
+    public:
+        IoUring() = default;
+        IoUring(const IoUring&) = delete;
+        ~IoUring();
+
+        IoUring& operator=(const IoUring&) = delete;
+
+        unsigned capacity() const { return cq_entries_; }
+        bool init(Error& out_error);
+
+        // Adds a readv operation to the submission queue. Returns false if the queue is full.
+        bool push_readv(int fd, const iovec* iov, u64 offset, u64 user_data);
+        bool push_nop(u64 user_data);
+
+        // Submits queued operations to the kernel.
+        bool submit(Error& out_error);
+
+        // Waits for at least one completion, then calls `handler` for each available completion.
+        template<typename F>
+        bool wait(F&& handler, Error& out_error);
+
+    private:
+        int fd_ = -1;
+        void* ring_ = nullptr;
+        size_t ring_size_ = 0;
+        io_uring_sqe* sqes_ = nullptr;
+        size_t sqes_size_ = 0;
+        unsigned* sq_head_ = nullptr;
+        unsigned* sq_tail_ = nullptr;
+        unsigned* sq_array_ = nullptr;
+        unsigned sq_mask_ = 0;
+        unsigned sq_entries_ = 0;
+        unsigned to_submit_ = 0;
+        unsigned* cq_head_ = nullptr;
+        unsigned* cq_tail_ = nullptr;
+        io_uring_cqe* cqes_ = nullptr;
+        unsigned cq_mask_ = 0;
+        unsigned cq_entries_ = 0;
+
+        io_uring_sqe* get_sqe();
+        int enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+    };
+
+    IoUring::~IoUring()
+    {
+        if (sqes_)
+            munmap(sqes_, sqes_size_);
+        if (ring_)
+            munmap(ring_, ring_size_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    bool IoUring::init(Error& out_error)
+    {
+        io_uring_params params{};
+
+        fd_ = int(syscall(__NR_io_uring_setup, ring_entries, &params));
+
+        if (fd_ < 0) {
+            out_error = make_errno_error("io_uring_setup failed", errno);
+            return false;
+        } else if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+            out_error = {.description = "io_uring is too old", .code = std::make_error_code(std::errc::not_supported)};
+            return false;
+        }
+
+        // Map the submission and completion rings, which share a single mapping.
+        ring_size_ = math::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                               params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        ring_ = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+
+        if (ring_ == MAP_FAILED) {
+            ring_ = nullptr;
+            out_error = make_errno_error("mmap failed", errno);
+            return false;
+        }
+
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+
+        if (sqes == MAP_FAILED) {
+            out_error = make_errno_error("mmap failed", errno);
+            return false;
+        }
+
+        u8* ring = static_cast<u8*>(ring_);
+
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+        sq_head_ = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+        sq_array_ = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+        sq_mask_ = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        cq_head_ = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+        cq_mask_ = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+        cq_entries_ = params.cq_entries;
+        return true;
+    }
+
+    int IoUring::enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        int result;
+
+        do {
+            result = int(syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, flags, nullptr, 0));
+        } while (result < 0 && errno == EINTR);
+
+        return result;
+    }
+
+    io_uring_sqe* IoUring::get_sqe()
+    {
+        unsigned head = std::atomic_ref{*sq_head_}.load(std::memory_order_acquire);
+        unsigned tail = *sq_tail_;
+
+        if (tail - head >= sq_entries_)
+            return nullptr;
+
+        unsigned index = tail & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+
+        *sqe = {};
+        sq_array_[index] = index;
+        return sqe;
+    }
+
+    bool IoUring::push_readv(int fd, const iovec* iov, u64 offset, u64 user_data)
+    {
+        io_uring_sqe* sqe = get_sqe();
+
+        if (!sqe)
+            return false;
+
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->off = offset;
+        sqe->addr = u64(uptr(iov));
+        sqe->len = 1;
+        sqe->user_data = user_data;
+        std::atomic_ref{*sq_tail_}.store(*sq_tail_ + 1, std::memory_order_release);
+        ++to_submit_;
+        return true;
+    }
+
+    bool IoUring::push_nop(u64 user_data)
+    {
+        io_uring_sqe* sqe = get_sqe();
+
+        if (!sqe)
+            return false;
+
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = user_data;
+        std::atomic_ref{*sq_tail_}.store(*sq_tail_ + 1, std::memory_order_release);
+        ++to_submit_;
+        return true;
+    }
+
+    bool IoUring::submit(Error& out_error)
+    {
+        if (!to_submit_)
+            return true;
+
+        int result = enter(to_submit_, 0, 0);
+
+        if (result < 0) {
+            out_error = make_errno_error("io_uring_enter failed", errno);
+            return false;
+        }
+
+        to_submit_ -= unsigned(result);
+        return true;
+    }
+
+    template<typename F>
+    bool IoUring::wait(F&& handler, Error& out_error)
+    {
+        if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+            out_error = make_errno_error("io_uring_enter failed", errno);
+            return false;
+        }
+
+        unsigned head = *cq_head_;
+        unsigned tail = std::atomic_ref{*cq_tail_}.load(std::memory_order_acquire);
+
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            handler(cqe.user_data, cqe.res);
+        }
+
+        std::atomic_ref{*cq_head_}.store(head, std::memory_order_release);
+        return true;
+    }
+
+#endif // defined(__linux__)
+
+} // namespace
+
+//==================================================================================================
+// AsyncFile::Impl
+//==================================================================================================
+
+struct AsyncFile::Impl {
+    int fd = -1;
+
+    // Worker threads, which run callbacks and, without io_uring, perform the reads themselves.
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_available;
+    std::condition_variable idle;
+    size_t outstanding = 0; // Reads submitted but not yet called back
+    bool stopping = false;
+
+#ifdef __linux__
+    std::unique_ptr<IoUring> ring;
+    std::thread reaper;
+    std::mutex ring_mutex;
+    std::deque<PendingRead*> backlog; // Reads that did not fit in the ring
+    unsigned in_flight = 0;
+#endif
+
+    ~Impl();
+
+    void complete(PendingRead* read, Error&& error);
+    void post(std::function<void()>&& task);
+    void read_sync(PendingRead* read);
+    void run_worker();
+
+#ifdef __linux__
+    void flush_backlog();
+    void run_reaper();
+#endif
+};
+
+AsyncFile::Impl::~Impl()
+{
+    // Wait for all reads to be called back.
+    {
+        std::unique_lock lock{mutex};
+        idle.wait(lock, [this] { return outstanding == 0; });
+    }
+
+#ifdef __linux__
+    // Wake the reaper with a no-op that has null user data.
+    if (reaper.joinable()) {
+        {
+            std::lock_guard lock{ring_mutex};
+            Error error;
+
+            if (!ring->push_nop(0) || !ring->submit(error))
+                FATAL("Failed to stop io_uring reaper: {}", error);
+        }
+
+        reaper.join();
+    }
+#endif
+
+    {
+        std::lock_guard lock{mutex};
+        stopping = true;
+    }
+
+    task_available.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    if (fd >= 0)
+        ::close(fd);
+}
+
+void AsyncFile::Impl::complete(PendingRead* read, Error&& error)
+{
+    read->error = std::move(error);
+
+    post([this, read] {
+        std::unique_ptr<PendingRead> owned_read{read};
+
+        owned_read->request.callback(owned_read->size, owned_read->error);
+
+        std::lock_guard lock{mutex};
+        if (!--outstanding)
+            idle.notify_all();
+    });
+}
+
+void AsyncFile::Impl::post(std::function<void()>&& task)
+{
+    {
+        std::lock_guard lock{mutex};
+        tasks.push_back(std::move(task));
+    }
+
+    task_available.notify_one();
+}
+
+void AsyncFile::Impl::read_sync(PendingRead* read)
+{
+    std::span<u8> buffer = read->request.buffer;
+
+    while (read->size < buffer.size()) {
+        ssize_t result = pread(fd, &buffer[read->size], buffer.size() - read->size,
+                               off_t(read->request.offset + read->size));
+
+        if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result < 0) {
+            complete(read, make_errno_error("pread failed", errno));
+            return;
+        } else if (result == 0) {
+            break;
+        }
+
+        read->size += size_t(result);
+    }
+
+    complete(read, {});
+}
+
+void AsyncFile::Impl::run_worker()
+{
+    std::unique_lock lock{mutex};
+
+    for (;;) {
+        task_available.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+        if (tasks.empty())
+            return;
+
+        std::function<void()> task = std::move(tasks.front());
+        tasks.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+#ifdef __linux__
+
+void AsyncFile::Impl::flush_backlog()
+{
+    Error error;
+
+    // Leave room in the completion queue for the reaper's wake-up no-op.
+    while (!backlog.empty() && in_flight + 1 < ring->capacity()) {
+        PendingRead* read = backlog.front();
+        std::span<u8> remaining = read->request.buffer.subspan(read->size);
+
+        read->iov = {remaining.data(), remaining.size()};
+
+        if (!ring->push_readv(fd, &read->iov, read->request.offset + read->size, u64(uptr(read))))
+            break;
+
+        backlog.pop_front();
+        ++in_flight;
+    }
+
+    if (!ring->submit(error))
+        FATAL("Failed to submit reads: {}", error);
+}
+
+void AsyncFile::Impl::run_reaper()
+{
+    bool running = true;
+
+    while (running) {
+        Error error;
+        bool ok = ring->wait([&](u64 user_data, i32 result) {
+            PendingRead* read = reinterpret_cast<PendingRead*>(uptr(user_data));
+
+            if (!read) {
+                running = false;
+                return;
+            }
+
+            std::lock_guard lock{ring_mutex};
+            --in_flight;
+
+            if (result < 0) {
+                complete(read, make_errno_error("read failed", -result));
+                return;
+            }
+
+            read->size += size_t(result);
+
+            // Resubmit the remainder of short reads unless the end of the file was reached.
+            if (result > 0 && read->size < read->request.buffer.size())
+                backlog.push_front(read);
+            else
+                complete(read, {});
+        }, error);
+
+        if (!ok)
+            FATAL("Failed to wait for reads: {}", error);
+
+        std::lock_guard lock{ring_mutex};
+        flush_backlog();
+    }
+}
+
+#endif // defined(__linux__)
+
+//==================================================================================================
+// AsyncFile
+//==================================================================================================
+
+AsyncFile::AsyncFile()
+{
+}
+
+AsyncFile::AsyncFile(const oschar_t* path, Error& out_error, size_t num_threads)
+{
+    open(path, out_error, num_threads);
+}
+
+AsyncFile::~AsyncFile()
+{
+    close();
+}
+
+void AsyncFile::close()
+{
+    impl_.reset();
+}
+
+const char* AsyncFile::get_backend_name() const
+{
+#ifdef __linux__
+    if (impl_ && impl_->ring)
+        return "io_uring";
+#endif
+
+    return "pread";
+}
+
+bool AsyncFile::open(const oschar_t* path, Error& out_error, size_t num_threads)
+{
+    close();
+
+    auto impl = std::make_unique<Impl>();
+
+    impl->fd = ::open(path, O_RDONLY | O_CLOEXEC);
+
+    if (impl->fd < 0) {
+        out_error = make_errno_error("open failed", errno);
+        return false;
+    }
+
+#ifdef __linux__
+    // Fall back to reading on the worker threads if io_uring is unavailable, e.g., on older
+    // kernels or if it has been disabled.
+    Error ring_error;
+    auto ring = std::make_unique<IoUring>();
+
+    if (ring->init(ring_error)) {
+        impl->ring = std::move(ring);
+        impl->reaper = std::thread{[impl = impl.get()] { impl->run_reaper(); }};
+    } else {
+        LOG_DEBUG("io_uring unavailable, using pread: {}", ring_error);
+    }
+#endif
+
+    if (!num_threads)
+        num_threads = math::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+
+    for (size_t i = 0; i < num_threads; ++i)
+        impl->workers.emplace_back([impl = impl.get()] { impl->run_worker(); });
+
+    impl_ = std::move(impl);
+    return true;
+}
+
+void AsyncFile::prefetch(u64 offset, u64 size)
+{
+    ASSERT(impl_ != nullptr);
+
+    if (!size || offset > u64(std::numeric_limits<off_t>::max()) || size > u64(std::numeric_limits<off_t>::max()))
+        return;
+
+    // Failure is harmless, since this is only a hint.
+#if defined(__APPLE__)
+    radvisory advisory = {.ra_offset = off_t(offset), .ra_count = int(math::min(size, u64(INT_MAX)))};
+    fcntl(impl_->fd, F_RDADVISE, &advisory);
+#elif defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(impl_->fd, off_t(offset), off_t(size), POSIX_FADV_WILLNEED);
+#endif
+}
+
+void AsyncFile::submit(std::vector<AsyncReadRequest>&& requests)
+{
+    ASSERT(impl_ != nullptr);
+
+    if (requests.empty())
+        return;
+
+    {
+        std::lock_guard lock{impl_->mutex};
+        impl_->outstanding += requests.size();
+    }
+
+#ifdef __linux__
+    if (impl_->ring) {
+        std::lock_guard lock{impl_->ring_mutex};
+
+        for (AsyncReadRequest& request : requests)
+            impl_->backlog.push_back(new PendingRead{.request = std::move(request)});
+
+        impl_->flush_backlog();
+        return;
+    }
+#endif
+
+    for (AsyncReadRequest& request : requests) {
+        PendingRead* read = new PendingRead{.request = std::move(request)};
+        impl_->post([impl = impl_.get(), read] { impl->read_sync(read); });
+    }
+}
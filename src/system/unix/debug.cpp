@@ -6,128 +6,101 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
-#include <err.h>
-#include <pthread.h>
-#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
 
-#include <system/debug.h>
+#include <system/logger.h>
 
 using namespace geo;
 
 namespace {
 
-    // Output iterator that calls `fputc(ch, stderr)` each time it's assigned a char.
-    class LogIterator {
-    public:
-        using difference_type = ptrdiff_t;
-        using iterator_category = std::output_iterator_tag;
-        using pointer = char*;
-        using reference = char&;
-        using value_type = char;
-
-        constexpr LogIterator() = default;
-        constexpr LogIterator(const LogIterator& other) = default;
-        constexpr LogIterator& operator=(const LogIterator& other) = default;
-
-        LogIterator& operator=(char ch)
-        {
-            fputc(ch, stderr);
-            return *this;
-        }
-
-        constexpr LogIterator& operator*() { return *this; }
-        constexpr LogIterator& operator++() { return *this; }
-        constexpr LogIterator& operator++(int) { return *this; }
-    };
-
-    pthread_mutex_t logger_mutex = PTHREAD_MUTEX_INITIALIZER;
-    bool logger_locked = false; // Secondary lock to prevent recursive logging.
-
-} // namespace
-
-void debug::init_logger()
-{
-    static char stderr_buffer[BUFSIZ];
-
-    if (pthread_mutex_init(&logger_mutex, nullptr))
-        errx(EXIT_FAILURE, "Failed to initialize logger mutex");
-
-    // stderr is unbuffered by default. By making it buffered, we improve logging performance by
-    // reducing the number of syscalls, typically to one write() per message.
-    setvbuf(stderr, stderr_buffer, _IOLBF, sizeof(stderr_buffer));
-}
-
-void debug::shut_down_logger()
-{
-    pthread_mutex_destroy(&logger_mutex);
-}
-
-void debug::enable_console()
-{
-}
-
-void debug::detail::vlog_src(const char* file, int line, LogLevel level, StringView fmt, FormatArgs args)
-{
-    const char* prefix;
-
-    if (level < LogLevel(1) || level > max_log_level)
-        return;
+    // Batch of output that is written to stderr at once.
+    fmt::memory_buffer output;
 
     // Note: These contain ANSI escape sequences that change the color and format of output text.
-    switch (level) {
+    const char* get_prefix(LogLevel level)
+    {
+        switch (level) {
 #if LOG_LEVEL_MAX >= LOG_LEVEL_FATAL
-        case LogLevel::fatal:
-            prefix = "\033[1;31mFATAL ERROR: \033[0;31m";
-            break;
+            case LogLevel::fatal:
+                return "\033[1;31mFATAL ERROR: \033[0;31m";
 #endif
 #if LOG_LEVEL_MAX >= LOG_LEVEL_ERROR
-        case LogLevel::error:
-            prefix = "\033[1;31mERROR: \033[0m";
-            break;
+            case LogLevel::error:
+                return "\033[1;31mERROR: \033[0m";
 #endif
 #if LOG_LEVEL_MAX >= LOG_LEVEL_WARNING
-        case LogLevel::warning:
-            prefix = "\033[1;33mWARNING: \033[0m";
-            break;
+            case LogLevel::warning:
+                return "\033[1;33mWARNING: \033[0m";
 #endif
 #if LOG_LEVEL_MAX >= LOG_LEVEL_INFO
-        case LogLevel::info:
-            prefix = "\033[1;34mINFO: \033[0m";
-            break;
+            case LogLevel::info:
+                return "\033[1;34mINFO: \033[0m";
 #endif
 #if LOG_LEVEL_MAX >= LOG_LEVEL_DEBUG
-        case LogLevel::debug:
-            prefix = "\033[1;32mDEBUG: \033[0;32m";
-            break;
+            case LogLevel::debug:
+                return "\033[1;32mDEBUG: \033[0;32m";
 #endif
 #if LOG_LEVEL_MAX >= LOG_LEVEL_TRACE
-        case LogLevel::trace:
-            prefix = "\033[2;36mTRACE: \033[0;2m";
-            break;
+            case LogLevel::trace:
+                return "\033[2;36mTRACE: \033[0;2m";
 #endif
-        default:
-            return;
+            default:
+                return nullptr;
+        }
     }
 
-    if (pthread_mutex_lock(&logger_mutex))
-        return;
+    void write_output()
+    {
+        const char* data = output.data();
+        size_t size = output.size();
 
-    // Prevent recursive log messages (i.e. if a formatter attempts to log a message).
-    if (logger_locked)
-        return;
+        while (size > 0) {
+            ssize_t result = write(STDERR_FILENO, data, size);
 
-    logger_locked = true;
-    fputs(prefix, stderr);
-    fmt::vformat_to(LogIterator{}, fmt, args);
+            if (result < 0 && errno == EINTR)
+                continue;
+            else if (result <= 0)
+                break;
 
-    if (file)
-        fprintf(stderr, " \033[2m(%s:%d)", file, line);
+            data += result;
+            size -= size_t(result);
+        }
+
+        output.clear();
+    }
+
+} // namespace
+
+void debug::detail::init_log_sink()
+{
+}
+
+void debug::detail::shut_down_log_sink()
+{
+}
+
+void debug::enable_console()
+{
+}
 
-    fputs("\033[0m\n", stderr);
+void debug::detail::write_log_records(std::span<const LogRecord> records)
+{
+    for (const LogRecord& record : records) {
+        const char* prefix = get_prefix(record.level);
+
+        if (!prefix)
+            continue;
+
+        output.append(std::string_view{prefix});
+        output.append(record.text);
 
-    if (level == LogLevel::fatal)
-        exit_fatal();
+        if (record.file)
+            fmt::format_to(std::back_inserter(output), " \033[2m({}:{})", record.file, record.line);
+
+        output.append(std::string_view{"\033[0m\n"});
+    }
 
-    logger_locked = false;
-    pthread_mutex_unlock(&logger_mutex);
+    write_output();
 }
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <limits>
+
+#include <core/finally.h>
+#include <system/debug.h>
+#include <system/mapping.h>
+
+using namespace geo;
+
+FileMapping::FileMapping(FileMapping&& other)
+    : data_{other.data_}
+    , size_{other.size_}
+    , is_open_{other.is_open_}
+{
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.is_open_ = false;
+}
+
+FileMapping::FileMapping(const oschar_t* path, Error& out_error)
+{
+    open(path, out_error);
+}
+
+FileMapping::~FileMapping()
+{
+    close();
+}
+
+FileMapping& FileMapping::operator=(FileMapping&& other)
+{
+    if (&other != this) {
+        close();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(is_open_, other.is_open_);
+    }
+    return *this;
+}
+
+void FileMapping::close()
+{
+    if (data_ && munmap(const_cast<u8*>(data_), size_))
+        LOG_ERROR("munmap failed: {}", std::generic_category().message(errno));
+
+    data_ = nullptr;
+    size_ = 0;
+    is_open_ = false;
+}
+
+bool FileMapping::open(const oschar_t* path, Error& out_error)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        out_error = {.description = "open failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    Finally close_fd = [&] { ::close(fd); };
+
+    // Get the file size.
+    struct stat st;
+
+    if (fstat(fd, &st)) {
+        out_error = {.description = "fstat failed", .code = {errno, std::generic_category()}};
+        return false;
+    } else if (u64(st.st_size) > std::numeric_limits<size_t>::max()) {
+        out_error = {.description = "File is too large to map", .code = std::make_error_code(std::errc::file_too_large)};
+        return false;
+    }
+
+    // Empty files can't be mapped, but are still valid.
+    if (st.st_size > 0) {
+        void* addr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (addr == MAP_FAILED) {
+            out_error = {.description = "mmap failed", .code = {errno, std::generic_category()}};
+            return false;
+        }
+
+        data_ = static_cast<const u8*>(addr);
+        size_ = size_t(st.st_size);
+    }
+
+    is_open_ = true;
+    return true;
+}
+
+void FileMapping::prefetch(std::span<const u8> range) const
+{
+    if (range.empty() || range.data() < data_ || range.data() + range.size() > data_ + size_)
+        return;
+
+    // madvise requires a page-aligned address. Failure is harmless, since this is only a hint.
+    static const uptr page_size = uptr(sysconf(_SC_PAGESIZE));
+    uptr begin = uptr(range.data()) & ~(page_size - 1);
+    uptr end = uptr(range.data() + range.size());
+
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
@@ -6,7 +6,9 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
+#include <errno.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <core/game_defs.h>
@@ -15,6 +17,21 @@
 
 using namespace geo;
 
+OsString system::get_cache_dir()
+{
+    const char* cache_home = getenv("XDG_CACHE_HOME");
+
+    if (cache_home && cache_home[0])
+        return std::string{cache_home} + "/" GAME_ID;
+
+    const char* home = getenv("HOME");
+
+    if (home && home[0])
+        return std::string{home} + "/.cache/" GAME_ID;
+
+    return {};
+}
+
 OsString system::get_default_pak_path()
 {
     LOG_WARNING("Specifying the assets path with --assets=PATH is recommended on this platform");
@@ -52,3 +69,17 @@ OsString system::get_default_pak_path()
         }
     }
 }
+
+bool system::get_file_info(const oschar_t* path, FileInfo& out_info, Error& out_error)
+{
+    struct stat st;
+
+    if (stat(path, &st)) {
+        out_error = {.description = "stat failed", .code = {errno, std::generic_category()}};
+        return false;
+    }
+
+    out_info.size = u64(st.st_size);
+    out_info.mtime = i64(st.st_mtim.tv_sec) * 1000000000 + i64(st.st_mtim.tv_nsec);
+    return true;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <windows.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <math/math.h>
+#include <system/async_file.h>
+#include <system/debug.h>
+
+#include "win32.h"
+
+using namespace geo;
+
+namespace {
+
+    Error make_win32_error(ErrorDescription description, DWORD errnum)
+    {
+        return {.description = std::move(description), .code = {int(errnum), std::system_category()}};
+    }
+
+} // namespace
+
+//==================================================================================================
+// AsyncFile::Impl
+//==================================================================================================
+
+struct AsyncFile::Impl {
+    HANDLE handle = INVALID_HANDLE_VALUE;
+
+    // Worker threads, which perform the reads and run the callbacks.
+    std::vector<std::thread> workers;
+    std::deque<AsyncReadRequest> requests;
+    std::mutex mutex;
+    std::condition_variable request_available;
+    bool stopping = false;
+
+    ~Impl();
+
+    void read(AsyncReadRequest& request);
+    void run_worker();
+};
+
+AsyncFile::Impl::~Impl()
+{
+    // Workers complete the remaining requests before exiting.
+    {
+        std::lock_guard lock{mutex};
+        stopping = true;
+    }
+
+    request_available.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+
+    if (handle != INVALID_HANDLE_VALUE)
+        CloseHandle(handle);
+}
+
+void AsyncFile::Impl::read(AsyncReadRequest& request)
+{
+    Error error;
+    size_t size = 0;
+
+    while (size < request.buffer.size()) {
+        // Positional reads on a synchronous handle don't affect other threads.
+        u64 offset = request.offset + size;
+        OVERLAPPED overlapped{};
+        DWORD pass_size = DWORD(math::min(request.buffer.size() - size, size_t(0x40000000)));
+        DWORD pass_result = 0;
+
+        overlapped.Offset = DWORD(offset);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+
+        if (!ReadFile(handle, &request.buffer[size], pass_size, &pass_result, &overlapped)) {
+            DWORD errnum = GetLastError();
+
+            if (errnum != ERROR_HANDLE_EOF)
+                error = make_win32_error("ReadFile failed", errnum);
+            break;
+        } else if (!pass_result) {
+            break;
+        }
+
+        size += pass_result;
+    }
+
+    request.callback(size, error);
+}
+
+void AsyncFile::Impl::run_worker()
+{
+    std::unique_lock lock{mutex};
+
+    for (;;) {
+        request_available.wait(lock, [this] { return stopping || !requests.empty(); });
+
+        if (requests.empty())
+            return;
+
+        AsyncReadRequest request = std::move(requests.front());
+        requests.pop_front();
+        lock.unlock();
+        read(request);
+        lock.lock();
+    }
+}
+
+//==================================================================================================
+// AsyncFile
+//==================================================================================================
+
+AsyncFile::AsyncFile()
+{
+}
+
+AsyncFile::AsyncFile(const oschar_t* path, Error& out_error, size_t num_threads)
+{
+    open(path, out_error, num_threads);
+}
+
+AsyncFile::~AsyncFile()
+{
+    close();
+}
+
+void AsyncFile::close()
+{
+    impl_.reset();
+}
+
+const char* AsyncFile::get_backend_name() const
+{
+    return "ReadFile";
+}
+
+bool AsyncFile::open(const oschar_t* path, Error& out_error, size_t num_threads)
+{
+    close();
+
+    auto impl = std::make_unique<Impl>();
+
+    impl->handle = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (impl->handle == INVALID_HANDLE_VALUE) {
+        out_error = make_win32_error("CreateFileW failed", GetLastError());
+        return false;
+    }
+
+    if (!num_threads)
+        num_threads = math::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+
+    for (size_t i = 0; i < num_threads; ++i)
+        impl->workers.emplace_back([impl = impl.get()] { impl->run_worker(); });
+
+    impl_ = std::move(impl);
+    return true;
+}
+
+void AsyncFile::prefetch(u64, u64)
+{
+    ASSERT(impl_ != nullptr);
+
+    // Windows has no read-ahead hint for a range of a file handle. The cache manager detects
+    // sequential reads on its own.
+}
+
+void AsyncFile::submit(std::vector<AsyncReadRequest>&& requests)
+{
+    ASSERT(impl_ != nullptr);
+
+    {
+        std::lock_guard lock{impl_->mutex};
+
+        for (AsyncReadRequest& request : requests)
+            impl_->requests.push_back(std::move(request));
+    }
+
+    impl_->request_available.notify_all();
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <windows.h>
+
+#include <limits>
+
+#include <core/finally.h>
+#include <system/debug.h>
+#include <system/mapping.h>
+
+#include "win32.h"
+
+using namespace geo;
+
+FileMapping::FileMapping(FileMapping&& other)
+    : data_{other.data_}
+    , size_{other.size_}
+    , is_open_{other.is_open_}
+{
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.is_open_ = false;
+}
+
+FileMapping::FileMapping(const oschar_t* path, Error& out_error)
+{
+    open(path, out_error);
+}
+
+FileMapping::~FileMapping()
+{
+    close();
+}
+
+FileMapping& FileMapping::operator=(FileMapping&& other)
+{
+    if (&other != this) {
+        close();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(is_open_, other.is_open_);
+    }
+    return *this;
+}
+
+void FileMapping::close()
+{
+    if (data_ && !UnmapViewOfFile(data_))
+        LOG_ERROR("UnmapViewOfFile failed: {}", win32::strerror(GetLastError()));
+
+    data_ = nullptr;
+    size_ = 0;
+    is_open_ = false;
+}
+
+bool FileMapping::open(const oschar_t* path, Error& out_error)
+{
+    close();
+
+    HANDLE hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        out_error = {.description = "CreateFileW failed", .code = {int(GetLastError()), std::system_category()}};
+        return false;
+    }
+
+    Finally close_file = [&] { CloseHandle(hFile); };
+
+    // Get the file size.
+    LARGE_INTEGER file_size;
+
+    if (!GetFileSizeEx(hFile, &file_size)) {
+        out_error = {.description = "GetFileSizeEx failed", .code = {int(GetLastError()), std::system_category()}};
+        return false;
+    } else if (u64(file_size.QuadPart) > std::numeric_limits<size_t>::max()) {
+        out_error = {.description = "File is too large to map", .code = std::make_error_code(std::errc::file_too_large)};
+        return false;
+    }
+
+    // Empty files can't be mapped, but are still valid.
+    if (file_size.QuadPart > 0) {
+        HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (!hMapping) {
+            out_error = {.description = "CreateFileMappingW failed", .code = {int(GetLastError()), std::system_category()}};
+            return false;
+        }
+
+        // The view keeps the mapping object alive after its handle is closed.
+        void* addr = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        DWORD errnum = GetLastError();
+
+        CloseHandle(hMapping);
+
+        if (!addr) {
+            out_error = {.description = "MapViewOfFile failed", .code = {int(errnum), std::system_category()}};
+            return false;
+        }
+
+        data_ = static_cast<const u8*>(addr);
+        size_ = size_t(file_size.QuadPart);
+    }
+
+    is_open_ = true;
+    return true;
+}
+
+void FileMapping::prefetch(std::span<const u8> range) const
+{
+    if (range.empty() || range.data() < data_ || range.data() + range.size() > data_ + size_)
+        return;
+
+    // Failure is harmless, since this is only a hint.
+    WIN32_MEMORY_RANGE_ENTRY entry = {const_cast<u8*>(range.data()), range.size()};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &entry, 0);
+}
@@ -50,7 +50,33 @@ namespace {
 
 } // namespace
 
+OsString system::get_cache_dir()
+{
+    const wchar_t* local_app_data = _wgetenv(L"LOCALAPPDATA");
+
+    if (local_app_data && local_app_data[0])
+        return std::wstring{local_app_data} + L"\\" GAME_ID;
+    else
+        return {};
+}
+
 OsString system::get_default_pak_path()
 {
     return get_exe_dir() + L"\\" PAK_FILENAME;
 }
+
+bool system::get_file_info(const oschar_t* path, FileInfo& out_info, Error& out_error)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &data)) {
+        out_error = {.description = "GetFileAttributesExW failed",
+                     .code = {int(GetLastError()), std::system_category()}};
+        return false;
+    }
+
+    // FILETIME is in 100-nanosecond intervals.
+    out_info.size = (u64(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    out_info.mtime = i64((u64(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime) * 100;
+    return true;
+}
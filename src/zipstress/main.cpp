@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2024 Martin Mills <daggerbot@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <io/crc32.h>
+#include <io/zip.h>
+#include <math/math.h>
+#include <system/command_line.h>
+#include <system/debug.h>
+#include <system/mapping.h>
+
+using namespace geo;
+
+// Stress test for concurrent ZipArchive::open_stream calls. Every thread reads every entry of a PAK
+// through the same archive, each starting at a different entry so that the threads contend for the
+// same entries and handles, and checks the decoded data against the central directory's CRC-32.
+
+//==================================================================================================
+// Command line
+//==================================================================================================
+
+namespace {
+
+    size_t num_threads = 0; // One per hardware thread if zero
+    size_t num_iterations = 4;
+    const oschar_t* pak_path = nullptr;
+
+    const CommandLineOption command_line_options[] = {
+        {OSSTR "iterations", true, [](const oschar_t* param) { num_iterations = command_line::parse_size(param); }},
+        {OSSTR "threads", true, [](const oschar_t* param) { num_threads = command_line::parse_size(param); }},
+    };
+
+    void handle_command_line(int argc, const oschar_t* const argv[])
+    {
+        // The argument that isn't an option is the PAK.
+        command_line::parse(argc, argv, command_line_options, [](const oschar_t* arg) {
+            if (pak_path)
+                FATAL("Unexpected argument: {}", arg);
+
+            pak_path = arg;
+        });
+
+        if (!pak_path)
+            FATAL("Missing PAK path");
+    }
+
+} // namespace
+
+//==================================================================================================
+// Entry point
+//==================================================================================================
+
+namespace {
+
+    struct StressState {
+        ZipArchive* archive = nullptr;
+        std::vector<const ZipDirectoryEntry*> entries{};
+        std::atomic<size_t> num_reads = 0;
+        std::atomic<size_t> num_failed = 0;
+        std::atomic<u64> num_bytes = 0;
+    };
+
+    // Reads an entry through the archive and checks its size and CRC-32.
+    bool check_entry(ZipArchive& archive, const ZipDirectoryEntry& entry, std::vector<u8>& buffer, Error& out_error)
+    {
+        std::unique_ptr<Stream> stream = archive.open_stream(entry.name.c_str(), out_error);
+
+        if (!stream)
+            return false;
+
+        u64 size = 0;
+        u32 crc = 0;
+
+        for (;;) {
+            size_t result = stream->read(buffer.data(), buffer.size(), out_error);
+
+            if (out_error)
+                return false;
+            else if (!result)
+                break;
+
+            crc = crc32::update(crc, {buffer.data(), result});
+            size += result;
+        }
+
+        if (size != entry.size) {
+            out_error = {.description = fmt::format("Read {} of {} bytes", size, entry.size),
+                         .code = IoErrorCode::end_of_stream};
+            return false;
+        } else if (crc != entry.crc) {
+            out_error = {.code = IoErrorCode::checksum_mismatch};
+            return false;
+        }
+
+        return true;
+    }
+
+    void stress_thread(StressState& state, size_t thread_index)
+    {
+        std::vector<u8> buffer(64 * 1024);
+        size_t num_entries = state.entries.size();
+        size_t first = num_entries * thread_index / math::max<size_t>(num_threads, 1);
+
+        for (size_t iteration = 0; iteration < num_iterations; ++iteration) {
+            for (size_t i = 0; i < num_entries; ++i) {
+                const ZipDirectoryEntry& entry = *state.entries[(first + i) % num_entries];
+                Error error;
+
+                if (!check_entry(*state.archive, entry, buffer, error)) {
+                    LOG_ERROR("{}: {}", entry.name, error);
+                    state.num_failed.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                state.num_reads.fetch_add(1, std::memory_order_relaxed);
+                state.num_bytes.fetch_add(entry.size, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    int zipstress_main(int argc, const oschar_t* const argv[])
+    {
+        debug::init_logger();
+        debug::set_max_log_level(LogLevel::info);
+        handle_command_line(argc, argv);
+
+        // The central directory is parsed separately so the CRCs don't come from the code under
+        // test.
+        FileMapping mapping;
+        ZipDirectory directory;
+        ZipArchive archive;
+        StressState state;
+        Error error;
+
+        if (!mapping.open(pak_path, error) || !directory.parse(mapping.bytes(), error)
+            || !archive.open(pak_path, error))
+        {
+            FATAL("{}: {}", pak_path, error);
+        }
+
+        for (const ZipDirectoryEntry& entry : directory.entries()) {
+            if (ZipDirectory::is_stream_name(entry.name))
+                state.entries.push_back(&entry);
+        }
+
+        if (state.entries.empty())
+            FATAL("{}: No entries to read", pak_path);
+
+        if (!num_threads)
+            num_threads = math::max(1u, std::thread::hardware_concurrency());
+
+        state.archive = &archive;
+        auto start_time = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+
+        for (size_t i = 0; i < num_threads; ++i)
+            threads.emplace_back([&state, i] { stress_thread(state, i); });
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        size_t num_failed = state.num_failed.load(std::memory_order_relaxed);
+
+        LOG_INFO("Read {} entries ({} bytes) on {} threads in {:.2f} s, {} failed",
+                 state.num_reads.load(std::memory_order_relaxed), state.num_bytes.load(std::memory_order_relaxed),
+                 num_threads, elapsed, num_failed);
+
+        archive.close();
+        debug::shut_down_logger();
+        return num_failed ? 1 : 0;
+    }
+
+} // namespace
+
+#ifdef _WIN32
+
+int wmain(int argc, wchar_t* argv[])
+{
+    return zipstress_main(argc, argv);
+}
+
+#else // !defined(_WIN32)
+
+int main(int argc, char* argv[])
+{
+    return zipstress_main(argc, argv);
+}
+
+#endif // !defined(_WIN32)